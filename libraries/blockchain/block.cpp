@@ -64,7 +64,7 @@ namespace bts { namespace blockchain {
    {
       digest_block db( (signed_block_header&)*this );
       db.user_transaction_ids.reserve( user_transactions.size() );
-      for( auto item : user_transactions )
+      for( const auto& item : user_transactions )
          db.user_transaction_ids.push_back( item.id() );
       return db;
    }
@@ -4,17 +4,29 @@
 #include <bts/blockchain/time.hpp>
 #include <bts/blockchain/operation_factory.hpp>
 #include <bts/blockchain/fire_operation.hpp>
+#include <bts/blockchain/transaction_pool.hpp>
+#include <bts/blockchain/undo_data.hpp>
 
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/append_log.hpp>
+#include <bts/db/level_database.hpp>
 #include <bts/db/level_map.hpp>
 #include <bts/db/level_pod_map.hpp>
+#include <bts/db/record_cache.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/io/raw_variant.hpp>
 #include <fc/io/fstream.hpp>
+#include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <set>
+#include <thread>
 
 using namespace bts::blockchain;
 
@@ -37,23 +49,39 @@ struct vote_del
 };
 FC_REFLECT( vote_del, (votes)(delegate_id) )
 
-struct fee_index
-{
-   fee_index( share_type fees = 0, transaction_id_type trx = transaction_id_type() )
-   :_fees(fees),_trx(trx){}
-   share_type          _fees;
-   transaction_id_type _trx;
-   friend bool operator == ( const fee_index& a, const fee_index& b )
-   {
-      return a._fees == b._fees && a._trx == b._trx;
-   }
-   friend bool operator < ( const fee_index& a, const fee_index& b )
+/**
+ *  Byte comparable key encodings for the tables of the single chain database, market
+ *  keys are grouped by asset pair and then sorted by price.
+ */
+BTS_DB_KEY_ENCODING( bts::blockchain::address, (addr) )
+BTS_DB_KEY_ENCODING( bts::blockchain::price, (quote_asset_id)(base_asset_id)(ratio) )
+BTS_DB_KEY_ENCODING( bts::blockchain::market_index_key, (order_price)(owner) )
+BTS_DB_KEY_ENCODING( bts::blockchain::proposal_vote_id_type, (proposal_id)(delegate_id) )
+
+namespace bts { namespace db {
+   /** sorts by votes descending, the complement of the int64 encoding reverses the order */
+   template<> struct key_encoding<vote_del>
    {
-      if( a._fees == b._fees ) return a._trx < b._trx; /* Lowest id wins in ties */
-      return a._fees > b._fees; /* Reverse so that highest fee is placed first in sorted maps */
-   }
-};
-FC_REFLECT( fee_index, (_fees)(_trx) )
+      static const bool is_defined = true;
+      static void encode( std::string& out, const vote_del& v )
+      {
+         std::string votes;
+         key_encoding<int64_t>::encode( votes, v.votes );
+         for( auto& c : votes ) c = ~c;
+         out += votes;
+         key_encoding<fc::signed_int>::encode( out, v.delegate_id );
+      }
+      static void decode( fc::datastream<const char*>& ds, vote_del& v )
+      {
+         char votes[sizeof(v.votes)];
+         ds.read( votes, sizeof(votes) );
+         for( auto& c : votes ) c = ~c;
+         fc::datastream<const char*> votes_ds( votes, sizeof(votes) );
+         key_encoding<int64_t>::decode( votes_ds, v.votes );
+         key_encoding<fc::signed_int>::decode( ds, v.delegate_id );
+      }
+   };
+} } // bts::db
 
 struct block_fork_data
 {
@@ -84,6 +112,26 @@ struct block_fork_data
    bool                       is_included; ///< is included in the current chain database
 };
 FC_REFLECT( block_fork_data, (next_blocks)(is_linked)(is_valid)(is_included) )
+
+/**
+ *  Totals maintained as records are stored so that sanity_check does not have to scan
+ *  every balance and account, every base asset share is either in a balance or owed
+ *  to a delegate and is voted for or against exactly one delegate.
+ */
+struct chain_totals
+{
+   chain_totals():base_balances(0),delegate_pay(0),votes(0){}
+
+   friend bool operator == ( const chain_totals& a, const chain_totals& b )
+   {
+      return a.base_balances == b.base_balances && a.delegate_pay == b.delegate_pay && a.votes == b.votes;
+   }
+
+   share_type base_balances;
+   share_type delegate_pay;
+   share_type votes;
+};
+FC_REFLECT( chain_totals, (base_balances)(delegate_pay)(votes) )
 FC_REFLECT_TYPENAME( std::vector<bts::blockchain::block_id_type> )
 
 
@@ -91,32 +139,230 @@ namespace bts { namespace blockchain {
 
    namespace detail
    {
+      /**
+       *  The addresses that signed each transaction of a block, empty if the signatures could
+       *  not be recovered in which case evaluating the transaction reports the error.
+       */
+      typedef std::vector< fc::optional< std::unordered_set<address> > > block_signers;
+
+      /** the transactions of the next block, assembled from the pending transactions ahead of time */
+      struct block_template
+      {
+         block_template():size(0),fees(0),min_priority(0),stale(false){}
+
+         block_id_type              head_id;      ///< the block the template was built on
+         pending_chain_state_ptr    state;        ///< the head block state with trxs applied
+         pending_chain_state_ptr    trx_state;    ///< the layer a transaction is evaluated in before it is added to state
+         signed_transactions        trxs;
+         size_t                     size;
+         share_type                 fees;         ///< base asset fees paid by trxs
+         share_type                 min_priority; ///< lowest fee priority of trxs
+         bool                       stale;        ///< a pending transaction that did not fit outranks one of trxs
+      };
+
+      /** the fork data of a block and the block it links to, every block in _fork_db has one in memory */
+      struct fork_node
+      {
+         block_fork_data            data;
+         block_id_type              previous;     ///< unknown until the block itself has been received
+      };
+
+      /**
+       *  Key prefixes of the tables stored in the single chain database, these
+       *  values are persisted and must never be reused or reordered.
+       */
+      enum chain_table_id
+      {
+         fork_number_table             = 1,
+         fork_table                    = 2,
+         property_table                = 3,
+         proposal_table                = 4,
+         proposal_vote_table           = 5,
+         undo_state_table              = 6,
+         block_num_to_id_table         = 7,
+         block_id_to_block_table       = 8,
+         pending_transaction_table     = 9,
+         asset_table                   = 10,
+         balance_table                 = 11,
+         account_table                 = 12,
+         address_to_account_table      = 13,
+         account_index_table           = 14,
+         symbol_index_table            = 15,
+         delegate_vote_index_table     = 16,
+         ask_table                     = 17,
+         bid_table                     = 18,
+         short_table                   = 19,
+         collateral_table              = 20,
+         processed_transaction_table   = 21,
+         block_header_table            = 22,
+         block_location_table          = 23,
+         undo_data_table               = 24
+      };
 
       class chain_database_impl
       {
          public:
-            chain_database_impl():self(nullptr),_observer(nullptr){}
+            chain_database_impl():self(nullptr),_observer(nullptr),
+                                  _audit_interval(BTS_BLOCKCHAIN_DEFAULT_AUDIT_INTERVAL),
+                                  _trusted_replay(false),_undo_history_start(0),
+                                  _undo_history(BTS_BLOCKCHAIN_DEFAULT_UNDO_HISTORY),_switching_fork(false)
+            {
+               set_record_cache_size( BTS_BLOCKCHAIN_DEFAULT_RECORD_CACHE_SIZE );
+            }
+
+            void                       open_database( const fc::path& data_dir );
+            void                       close_database();
+            /** indexes blocks appended to the log after the last indexed one, truncating a partial record */
+            void                       replay_block_log();
+            /** moves the blocks of data directories that stored them in _block_id_to_block_db to the log */
+            void                       migrate_blocks_to_log();
+
+            /** starts the batch that applies or undoes a block */
+            void                       start_batch();
+            /** discards the pending writes and any cached records, totals and fork nodes they produced */
+            void                       abort_batch();
+
+            void                       load_fork_tree();
+            /**
+             *  Applies modify to the node of id, creating it if it does not exist, and writes its
+             *  fork data.  Inside of a batch the previous node is kept so abort_batch() can restore it.
+             */
+            template<typename Modify>
+            fork_node&                 modify_fork_node( const block_id_type& id, Modify&& modify )
+            {
+               auto itr = _fork_tree.find( id );
+               if( _chain_db.in_batch() && _fork_tree_changes.find( id ) == _fork_tree_changes.end() )
+                  _fork_tree_changes[id] = itr != _fork_tree.end() ? fc::optional<fork_node>( itr->second )
+                                                                   : fc::optional<fork_node>();
+               fork_node& node = itr != _fork_tree.end() ? itr->second : _fork_tree[id];
+               modify( node );
+               _fork_db.store( id, node.data );
+               return node;
+            }
+
+            void                       load_delegate_votes();
+            /** moves the delegate to its new position in the ranking if its votes changed */
+            void                       update_delegate_votes( const oaccount_record& old_rec,
+                                                              const account_record& new_rec );
+
+            void                       add_to_totals( const balance_record& r, int64_t sign );
+            void                       add_to_totals( const account_record& r, int64_t sign );
+            chain_totals               scan_totals()const;
+            void                       set_record_cache_size( size_t max_records );
+            void                       clear_record_caches();
+
+            /**
+             *  Attaches the table to _chain_db, if the data directory was created before the single
+             *  database existed the table's own database is moved into it once _chain_db is open.
+             */
+            template<typename Table>
+            void                       open_table( Table& table, const fc::path& data_dir,
+                                                   const char* name, chain_table_id table_id )
+            {
+               table.open( _chain_db, table_id );
+               auto legacy_dir = data_dir / name;
+               if( fc::exists( legacy_dir ) )
+                  _legacy_tables.push_back( [this,&table,legacy_dir]() { migrate_legacy_table( table, legacy_dir ); } );
+            }
+
+            /**
+             *  Copies the records of a table stored in a database of its own into _chain_db and then
+             *  removes its directory.  A copy that is interrupted is repeated on the next start.
+             */
+            template<typename Table>
+            void                       migrate_legacy_table( Table& table, const fc::path& legacy_dir )
+            { try {
+               {
+                  Table legacy;
+                  legacy.open( legacy_dir, false );
+                  uint32_t count = 0;
+                  _chain_db.start_batch();
+                  try {
+                     for( auto itr = legacy.begin(); itr.valid(); ++itr )
+                     {
+                        table.store( itr.key(), itr.value() );
+                        if( ++count % 10000 == 0 )
+                        {
+                           _chain_db.commit_batch();
+                           _chain_db.start_batch();
+                        }
+                     }
+                     _chain_db.commit_batch();
+                  }
+                  catch ( ... )
+                  {
+                     _chain_db.abort_batch();
+                     throw;
+                  }
+               }
+               fc::remove_all( legacy_dir );
+            } FC_RETHROW_EXCEPTIONS( warn, "", ("legacy_dir",legacy_dir) ) }
 
             void                       initialize_genesis(fc::path genesis_file);
 
 
             block_fork_data            store_and_index( const block_id_type& id, const full_block& blk );
-            void                       clear_pending(  const full_block& blk );
+            block_fork_data            index_block( const block_id_type& id, const full_block& blk, uint64_t log_offset );
+            full_block                 read_block( uint64_t log_offset );
+            void                       clear_pending( const std::vector<transaction_id_type>& trx_ids );
+            /** rebuilds the pool and the block template from the pending transactions in the database */
+            void                       load_pending_transactions();
+            /**
+             *  Evaluates trx against the head block state after the pending transactions it depends
+             *  on or shares balances with, then adds it to the pool.
+             */
+            transaction_evaluation_state_ptr add_pending_transaction( const signed_transaction& trx,
+                                                                      const std::unordered_set<address>& signed_addresses );
+            /** drops expired pending transactions and validates those touching records changed by a new block again */
+            void                       revalidate_pending( const pending_chain_state& block_changes );
+            /** the work of revalidate_pending(), which runs it in a batch */
+            void                       revalidate_pending_transactions( const pending_chain_state& block_changes );
+            /** the fees paid by trx_state converted to the base asset per 1000 bytes */
+            share_type                 get_fee_priority( const transaction_evaluation_state& trx_state )const;
+            /** applies as many pending transactions to tmpl as fit in a block, highest fee priority first */
+            void                       pack_transactions( block_template& tmpl );
+            /** evaluates item on top of the transactions already in tmpl and adds it, throws if it is invalid */
+            void                       apply_to_template( block_template& tmpl, const transaction_evaluation_state_ptr& item,
+                                                          share_type priority );
+            bool                       block_template_is_current()const;
+            /** adds a new pending transaction to the block template if it is current and there is room */
+            void                       add_to_block_template( const transaction_evaluation_state_ptr& trx_state );
+            /**
+             *  Pops the blocks after the common ancestor and applies the fork in a single batch that
+             *  is only committed if every block of the fork is valid, otherwise the current chain is
+             *  left as it was.
+             */
             void                       switch_to_fork( const block_id_type& block_id );
-            void                       extend_chain( const full_block& blk );
+            /** adds the records changed by a block applied or popped during a fork switch to _fork_changes */
+            void                       add_fork_changes( const pending_chain_state_ptr& changes );
+            /** updates the pending transactions and notifies the observer once a fork switch is committed */
+            void                       finish_fork_switch( bool committed );
+            /** calls the observer now or, during a fork switch, once the switch is committed */
+            void                       notify_observer( const std::function<void()>& notification );
+            void                       extend_chain( const block_id_type& id, const full_block& blk,
+                                                     const block_signers& signers );
+            /**
+             *  Recovers the signers of every transaction in blk on the signature threads, this
+             *  does not read the chain state so it is done before a block is applied.
+             */
+            block_signers              recover_signers( const full_block& blk );
             std::vector<block_id_type> get_fork_history( const block_id_type& id );
             void                       pop_block();
             void                       mark_invalid( const block_id_type& id );
             void                       mark_included( const block_id_type& id, bool state );
-            void                       verify_header( const full_block& );
+            void                       verify_header( const full_block&, const digest_block& );
             void                       apply_transactions( uint32_t block_num,
                                                            const std::vector<signed_transaction>&,
+                                                           const block_signers& signers,
                                                            const pending_chain_state_ptr& );
             void                       pay_delegate( fc::time_point_sec time_slot, share_type amount,
                                                            const pending_chain_state_ptr& );
-            void                       save_undo_state( const block_id_type& id,
-                                                           const pending_chain_state_ptr& );
-            void                       update_head_block( const full_block& blk );
+            void                       save_undo_state( const block_id_type& id, uint32_t block_num,
+                                                           const pending_chain_state& undo_state );
+            pending_chain_state_ptr    fetch_undo_state( const block_id_type& id );
+            /** removes the undo data of every block more than _undo_history blocks below the head */
+            void                       prune_undo_history();
+            void                       update_head_block( const block_id_type& id, const full_block& blk );
             std::vector<block_id_type> fetch_blocks_at_number( uint32_t block_num );
             void                       recursive_mark_as_linked( const std::unordered_set<block_id_type>& ids );
             void                       recursive_mark_as_invalid( const std::unordered_set<block_id_type>& ids );
@@ -132,19 +378,36 @@ namespace bts { namespace blockchain {
             chain_observer*                                                     _observer;
             digest_type                                                         _chain_id;
 
+            /** every table below lives in this database */
+            bts::db::level_database                                             _chain_db;
+            /** moves the tables of a data directory that kept one database per table into _chain_db */
+            std::vector< std::function<void()> >                                _legacy_tables;
+
             bts::db::level_map<uint32_t, std::vector<block_id_type> >           _fork_number_db;
             bts::db::level_map<block_id_type,block_fork_data>                   _fork_db;
+            /** every entry of _fork_db, the fork graph is only read from here */
+            std::unordered_map<block_id_type, fork_node>                        _fork_tree;
+            /** nodes as they were before the current batch, an invalid optional was created in it */
+            std::unordered_map<block_id_type, fc::optional<fork_node> >         _fork_tree_changes;
             bts::db::level_map<uint32_t, fc::variant >                          _property_db;
             bts::db::level_map<proposal_id_type, proposal_record >              _proposal_db;
             bts::db::level_map<proposal_vote_id_type, proposal_vote >           _proposal_vote_db;
 
-            /** the data required to 'undo' the changes a block made to the database */
+            /** full undo states written by earlier versions, read until they are pruned */
             bts::db::level_map<block_id_type,pending_chain_state>               _undo_state_db;
+            /** the data required to 'undo' the changes a block made to the database */
+            bts::db::level_map<block_id_type,undo_data>                         _undo_data_db;
 
             // blocks in the current 'official' chain.
             bts::db::level_map<uint32_t,block_id_type>                          _block_num_to_id_db;
-            // all blocks from any fork..
+            // all blocks from any fork, blocks are only read from here to move them to _block_log
             bts::db::level_map<block_id_type,full_block>                        _block_id_to_block_db;
+            // all blocks from any fork, in the order they were received
+            bts::db::append_log                                                 _block_log;
+            // offset in _block_log of every block
+            bts::db::level_map<block_id_type,uint64_t>                          _block_location_db;
+            // headers of every block in _block_log
+            bts::db::level_map<block_id_type,block_header_record>               _block_header_db;
 
             // used to revert block state in the event of a fork
             // bts::db::level_map<uint32_t,undo_data>                              _block_num_to_undo_data_db;
@@ -153,7 +416,10 @@ namespace bts { namespace blockchain {
             block_id_type                                                       _head_block_id;
 
             bts::db::level_map< transaction_id_type, signed_transaction>        _pending_transaction_db;
-            std::map< fee_index, transaction_evaluation_state_ptr >             _pending_fee_index;
+            transaction_pool                                                    _pending_pool;
+            /** rates used to rank fees paid in other assets, indexed by the other asset */
+            std::unordered_map<asset_id_type, price>                            _fee_prices;
+            block_template                                                      _block_template;
 
 
             bts::db::level_map< asset_id_type, asset_record >                   _asset_db;
@@ -165,6 +431,8 @@ namespace bts { namespace blockchain {
             bts::db::level_map< string, account_id_type >                       _account_index_db;
             bts::db::level_map< string, asset_id_type >                         _symbol_index_db;
             bts::db::level_pod_map< vote_del, int >                             _delegate_vote_index_db;
+            /** every delegate ordered by net votes, kept in step with _delegate_vote_index_db */
+            std::set<vote_del>                                                  _delegate_votes;
 
 
             bts::db::level_map< market_index_key, order_record >                _ask_db;
@@ -174,8 +442,331 @@ namespace bts { namespace blockchain {
 
             /** used to prevent duplicate processing */
             bts::db::level_pod_map< transaction_id_type, transaction_location > _processed_transaction_id_db;
+
+            /** decoded records, every store_*_record / set_property writes through these */
+            bts::db::record_cache< int32_t, account_record >                    _account_cache;
+            bts::db::record_cache< int32_t, asset_record >                      _asset_cache;
+            bts::db::record_cache< balance_id_type, balance_record >            _balance_cache;
+            bts::db::record_cache< uint32_t, fc::variant >                      _property_cache;
+
+            chain_totals                                                        _totals;
+            chain_totals                                                        _totals_at_batch_start;
+            uint32_t                                                            _audit_interval;
+
+            std::vector< std::unique_ptr<fc::thread> >                          _signature_threads;
+
+            /** set while replaying blocks that were validated before, skips signature checks */
+            bool                                                                _trusted_replay;
+            /** undo states are not saved for blocks below this number */
+            uint32_t                                                            _undo_history_start;
+            /** the number of blocks below the head block that can be popped */
+            uint32_t                                                            _undo_history;
+
+            /** set while switch_to_fork applies a fork, defers the side effects below until it is committed */
+            bool                                                                _switching_fork;
+            /** every record changed by the blocks popped and applied by the fork switch */
+            pending_chain_state_ptr                                             _fork_changes;
+            std::vector<transaction_id_type>                                    _fork_included_trxs;
+            std::vector< std::function<void()> >                                _fork_notifications;
       };
 
+      void chain_database_impl::open_database( const fc::path& data_dir )
+      { try {
+          open_table( _fork_number_db,              data_dir, "fork_number_db",              fork_number_table );
+          open_table( _fork_db,                     data_dir, "fork_db",                     fork_table );
+          open_table( _property_db,                 data_dir, "property_db",                 property_table );
+          open_table( _proposal_db,                 data_dir, "proposal_db",                 proposal_table );
+          open_table( _proposal_vote_db,            data_dir, "proposal_vote_db",            proposal_vote_table );
+
+          open_table( _undo_state_db,               data_dir, "undo_state_db",               undo_state_table );
+          open_table( _undo_data_db,                data_dir, "undo_data_db",                undo_data_table );
+
+          open_table( _block_num_to_id_db,          data_dir, "block_num_to_id_db",          block_num_to_id_table );
+          open_table( _block_id_to_block_db,        data_dir, "block_id_to_block_db",        block_id_to_block_table );
+          open_table( _block_header_db,             data_dir, "block_header_db",             block_header_table );
+          open_table( _block_location_db,           data_dir, "block_location_db",           block_location_table );
+
+          open_table( _pending_transaction_db,      data_dir, "pending_transaction_db",      pending_transaction_table );
+
+          open_table( _asset_db,                    data_dir, "asset_db",                    asset_table );
+          open_table( _balance_db,                  data_dir, "balance_db",                  balance_table );
+          open_table( _account_db,                  data_dir, "account_db",                  account_table );
+          open_table( _address_to_account_db,       data_dir, "address_to_account_db",       address_to_account_table );
+
+          open_table( _account_index_db,            data_dir, "account_index_db",            account_index_table );
+          open_table( _symbol_index_db,             data_dir, "symbol_index_db",             symbol_index_table );
+          open_table( _delegate_vote_index_db,      data_dir, "delegate_vote_index_db",      delegate_vote_index_table );
+
+          open_table( _ask_db,                      data_dir, "ask_db",                      ask_table );
+          open_table( _bid_db,                      data_dir, "bid_db",                      bid_table );
+          open_table( _short_db,                    data_dir, "short_db",                    short_table );
+          open_table( _collateral_db,               data_dir, "collateral_db",               collateral_table );
+
+          open_table( _processed_transaction_id_db, data_dir, "processed_transaction_id_db", processed_transaction_table );
+
+          _chain_db.open( data_dir / "chain_db" );
+          if( !_legacy_tables.empty() )
+          {
+             ilog( "moving the tables of ${dir} into a single database", ("dir",data_dir) );
+             for( const auto& migrate : _legacy_tables )
+                migrate();
+             _legacy_tables.clear();
+          }
+
+          load_fork_tree();
+
+          _block_log.open( data_dir / "block_log" );
+          replay_block_log();
+
+          if( _block_id_to_block_db.begin().valid() )
+             migrate_blocks_to_log();
+
+          load_delegate_votes();
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("data_dir",data_dir) ) }
+
+      void chain_database_impl::replay_block_log()
+      { try {
+          uint64_t offset = 0;
+          auto log_end = _property_db.fetch_optional( chain_property_enum::block_log_end_id );
+          if( log_end.valid() ) offset = log_end->as_uint64();
+
+          uint32_t count = 0;
+          bts::db::append_log::record r;
+          uint64_t next = 0;
+          while( _block_log.read_next( offset, r, next ) )
+          {
+             fc::datastream<const char*> ds( r.data, r.size );
+             full_block block_data;
+             fc::raw::unpack( ds, block_data );
+
+             start_batch();
+             try {
+                index_block( block_data.id(), block_data, offset );
+                self->set_property( chain_property_enum::block_log_end_id, fc::variant(next) );
+                _chain_db.commit_batch();
+             }
+             catch ( ... )
+             {
+                abort_batch();
+                throw;
+             }
+             offset = next;
+             ++count;
+          }
+          if( count ) ilog( "indexed ${n} blocks from the end of the block log", ("n",count) );
+
+          // anything left is a record that was only partially written
+          _block_log.truncate( offset );
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::migrate_blocks_to_log()
+      { try {
+          ilog( "moving blocks to the block log" );
+          uint32_t count = 0;
+          for( auto itr = _block_id_to_block_db.begin(); itr.valid(); ++itr )
+          {
+             auto block_id   = itr.key();
+             auto block_data = itr.value();
+             if( !_block_location_db.fetch_optional( block_id ).valid() )
+             {
+                auto packed = fc::raw::pack( block_data );
+                auto offset = _block_log.append( packed.data(), packed.size() );
+                _block_log.flush();
+                _block_location_db.store( block_id, offset );
+                _block_header_db.store( block_id, block_header_record( block_data, block_id ) );
+                self->set_property( chain_property_enum::block_log_end_id, fc::variant(_block_log.size()) );
+             }
+             _block_id_to_block_db.remove( block_id );
+             ++count;
+          }
+          ilog( "moved ${n} blocks", ("n",count) );
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      full_block chain_database_impl::read_block( uint64_t log_offset )
+      { try {
+          auto r = _block_log.read( log_offset );
+          fc::datastream<const char*> ds( r.data, r.size );
+          full_block block_data;
+          fc::raw::unpack( ds, block_data );
+          return block_data;
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("log_offset",log_offset) ) }
+
+      void chain_database_impl::close_database()
+      { try {
+          _fork_number_db.close();
+          _fork_db.close();
+          _property_db.close();
+          _proposal_db.close();
+          _proposal_vote_db.close();
+
+          _undo_state_db.close();
+          _undo_data_db.close();
+
+          _block_num_to_id_db.close();
+          _block_id_to_block_db.close();
+          _block_header_db.close();
+          _block_location_db.close();
+          _block_log.close();
+
+          _pending_transaction_db.close();
+
+          _asset_db.close();
+          _balance_db.close();
+          _account_db.close();
+          _address_to_account_db.close();
+
+          _account_index_db.close();
+          _symbol_index_db.close();
+          _delegate_vote_index_db.close();
+
+          _ask_db.close();
+          _bid_db.close();
+          _short_db.close();
+          _collateral_db.close();
+
+          _processed_transaction_id_db.close();
+
+          _chain_db.close();
+
+          clear_record_caches();
+          _delegate_votes.clear();
+          _fork_tree.clear();
+          _fork_tree_changes.clear();
+          _legacy_tables.clear();
+          _head_block_header = signed_block_header();
+          _head_block_id     = block_id_type();
+          _pending_pool.clear();
+          _block_template = block_template();
+          _totals            = chain_totals();
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::start_batch()
+      {
+         if( !_chain_db.in_batch() )
+         {
+            _totals_at_batch_start = _totals;
+            _fork_tree_changes.clear();
+         }
+         _chain_db.start_batch();
+      }
+
+      void chain_database_impl::abort_batch()
+      {
+         // an inner batch that failed already aborted everything up to the outermost one
+         if( !_chain_db.in_batch() ) return;
+         _chain_db.abort_batch();
+         clear_record_caches();
+         _totals = _totals_at_batch_start;
+         // the aborted batch discards every write since the outermost start_batch()
+         load_delegate_votes();
+         for( auto& item : _fork_tree_changes )
+         {
+            if( item.second.valid() ) _fork_tree[item.first] = std::move( *item.second );
+            else _fork_tree.erase( item.first );
+         }
+         _fork_tree_changes.clear();
+      }
+
+      void chain_database_impl::load_fork_tree()
+      { try {
+         _fork_tree.clear();
+         _fork_tree_changes.clear();
+         for( auto itr = _fork_db.begin(); itr.valid(); ++itr )
+         {
+            auto id = itr.key();
+            auto& node = _fork_tree[id];
+            node.data = itr.value();
+            for( const auto& next_id : node.data.next_blocks )
+               _fork_tree[next_id].previous = id;
+         }
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::load_delegate_votes()
+      { try {
+         _delegate_votes.clear();
+         for( auto itr = _delegate_vote_index_db.begin(); itr.valid(); ++itr )
+            _delegate_votes.insert( _delegate_votes.end(), itr.key() );
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::update_delegate_votes( const oaccount_record& old_rec, const account_record& new_rec )
+      { try {
+         bool was_delegate = old_rec.valid() && old_rec->is_delegate();
+         bool is_delegate  = !new_rec.is_null() && new_rec.is_delegate();
+         if( was_delegate && is_delegate && old_rec->net_votes() == new_rec.net_votes() )
+            return;
+
+         if( was_delegate )
+         {
+            vote_del old_key( old_rec->net_votes(), new_rec.id );
+            _delegate_votes.erase( old_key );
+            _delegate_vote_index_db.remove( old_key );
+         }
+         if( is_delegate )
+         {
+            vote_del new_key( new_rec.net_votes(), new_rec.id );
+            _delegate_votes.insert( new_key );
+            _delegate_vote_index_db.store( new_key, 0/*dummy value*/ );
+         }
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("record",new_rec) ) }
+
+      void chain_database_impl::add_to_totals( const balance_record& r, int64_t sign )
+      {
+         auto balance = r.get_balance();
+         if( balance.asset_id == 0 )
+            _totals.base_balances += sign * balance.amount;
+      }
+
+      void chain_database_impl::add_to_totals( const account_record& r, int64_t sign )
+      {
+         if( !r.is_delegate() ) return;
+         _totals.delegate_pay += sign * r.delegate_info->pay_balance;
+         _totals.votes        += sign * (r.delegate_info->votes_for + r.delegate_info->votes_against);
+      }
+
+      chain_totals chain_database_impl::scan_totals()const
+      { try {
+         chain_totals totals;
+         auto itr = _balance_db.begin();
+         while( itr.valid() )
+         {
+            auto ind = itr.value().get_balance();
+            if( ind.asset_id == 0 )
+            {
+               FC_ASSERT( ind.amount >= 0, "", ("record",itr.value()) );
+               totals.base_balances += ind.amount;
+            }
+            ++itr;
+         }
+         auto aitr = _account_db.begin();
+         while( aitr.valid() )
+         {
+            auto v = aitr.value();
+            if( v.is_delegate() )
+            {
+               totals.delegate_pay += v.delegate_info->pay_balance;
+               totals.votes        += v.delegate_info->votes_for + v.delegate_info->votes_against;
+            }
+            ++aitr;
+         }
+         return totals;
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      void chain_database_impl::set_record_cache_size( size_t max_records )
+      {
+         _account_cache.set_max_size( max_records );
+         _asset_cache.set_max_size( max_records );
+         _balance_cache.set_max_size( max_records );
+         _property_cache.set_max_size( max_records );
+      }
+
+      void chain_database_impl::clear_record_caches()
+      {
+         _account_cache.clear();
+         _asset_cache.clear();
+         _balance_cache.clear();
+         _property_cache.clear();
+      }
+
       std::vector<block_id_type> chain_database_impl::fetch_blocks_at_number( uint32_t block_num )
       {
          std::vector<block_id_type> current_blocks;
@@ -184,59 +775,303 @@ namespace bts { namespace blockchain {
          return current_blocks;
       }
 
-      void  chain_database_impl::clear_pending(  const full_block& blk )
+      void  chain_database_impl::clear_pending( const std::vector<transaction_id_type>& trx_ids )
       {
-         std::unordered_set<transaction_id_type> confirmed_trx_ids;
+         start_batch();
+         try {
+            for( const auto& id : trx_ids )
+               _pending_transaction_db.remove( id );
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
+         {
+            abort_batch();
+            throw;
+         }
+         for( const auto& id : trx_ids )
+            _pending_pool.remove( id );
+      }
 
-         for( auto trx : blk.user_transactions )
+      void chain_database_impl::load_pending_transactions()
+      { try {
+         _pending_pool.clear();
+         _block_template = block_template();
+
+         // signatures can only be checked once the chain id is known
+         std::vector<signed_transaction> pending_trxs;
+         for( auto pending_itr = _pending_transaction_db.begin(); pending_itr.valid(); ++pending_itr )
+            pending_trxs.push_back( pending_itr.value() );
+         for( const auto& trx : pending_trxs )
          {
-            auto id = trx.id();
-            confirmed_trx_ids.insert( id );
+            try {
+               add_pending_transaction( trx, trx.get_signed_addresses( _chain_id ) );
+            }
+            catch ( const fc::exception& e )
+            {
+               wlog( "error processing pending transaction: ${e}", ("e",e.to_detail_string() ) );
+               _pending_transaction_db.remove( trx.id() );
+            }
+         }
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      transaction_evaluation_state_ptr chain_database_impl::add_pending_transaction( const signed_transaction& trx,
+                                                                                     const std::unordered_set<address>& signed_addresses )
+      { try {
+         FC_ASSERT( !trx.expiration || *trx.expiration >= _head_block_header.timestamp, "transaction has expired" );
+
+         // trx may spend balances created by pending transactions and must stay valid
+         // when it is included together with the pending transactions spending the same balances
+         chain_interface_ptr base_state = self->shared_from_this();
+         auto dependencies = _pending_pool.get_dependencies( trx );
+         if( !dependencies.empty() )
+         {
+            pending_chain_state_ptr combined_state   = std::make_shared<pending_chain_state>(base_state);
+            pending_chain_state_ptr dependency_state = std::make_shared<pending_chain_state>(combined_state);
+            for( const auto& dependency : dependencies )
+            {
+               transaction_evaluation_state dependency_eval_state( dependency_state, _chain_id );
+               try {
+                  dependency_eval_state.evaluate( dependency->trx, dependency->signed_keys );
+                  dependency_state->squash();
+               }
+               catch ( const fc::exception& )
+               {
+                  dependency_state->clear();
+               }
+            }
+            base_state = combined_state;
+         }
+
+         pending_chain_state_ptr          pending_state = std::make_shared<pending_chain_state>(base_state);
+         transaction_evaluation_state_ptr trx_state = std::make_shared<transaction_evaluation_state>(pending_state,_chain_id);
+         trx_state->evaluate( trx, signed_addresses );
+
+         auto evicted = _pending_pool.insert( trx_state, *pending_state );
+         for( const auto& id : evicted )
             _pending_transaction_db.remove( id );
+         // the template may hold the evicted transactions
+         if( !evicted.empty() ) _block_template.stale = true;
+         _pending_transaction_db.store( trx_state->trx_id, trx );
+         add_to_block_template( trx_state );
+
+         return trx_state;
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx) ) }
+
+      share_type chain_database_impl::get_fee_priority( const transaction_evaluation_state& trx_state )const
+      {
+         if( trx_state.trx_size == 0 ) return 0;
+
+         share_type value = 0;
+         for( const auto& item : trx_state.balance )
+         {
+            if( item.second <= 0 ) continue;
+            if( item.first == BASE_ASSET_ID )
+            {
+               value += item.second;
+               continue;
+            }
+            auto price_itr = _fee_prices.find( item.first );
+            if( price_itr == _fee_prices.end() ) continue;
+            value += (asset( item.second, item.first ) * price_itr->second).amount;
          }
+         return (value * 1000) / int64_t(trx_state.trx_size);
+      }
+
+      void chain_database_impl::apply_to_template( block_template& tmpl, const transaction_evaluation_state_ptr& item,
+                                                   share_type priority )
+      {
+         // one layer is reused for every transaction, a failed evaluation leaves changes behind
+         if( !tmpl.trx_state ) tmpl.trx_state = std::make_shared<pending_chain_state>(tmpl.state);
+         tmpl.trx_state->clear();
+
+         transaction_evaluation_state trx_eval_state( tmpl.trx_state, _chain_id );
+         trx_eval_state.evaluate( item->trx, item->signed_keys );
+         // only base asset fees are paid to delegates, the others are collected by their asset
+         tmpl.fees += trx_eval_state.get_fees(0);
+         tmpl.trx_state->squash();
+         tmpl.trxs.push_back( item->trx );
+         tmpl.size += item->trx_size;
+         tmpl.min_priority = tmpl.trxs.size() == 1 ? priority : std::min( tmpl.min_priority, priority );
+      }
+
+      void chain_database_impl::pack_transactions( block_template& tmpl )
+      {
+         // the pool ranks its transactions with get_fee_priority, highest first
+         auto pending_trxs = _pending_pool.get_transactions();
+
+         size_t min_trx_size = BTS_BLOCKCHAIN_MAX_BLOCK_SIZE;
+         for( const auto& item : pending_trxs )
+            min_trx_size = std::min( min_trx_size, item->trx_size );
 
-         auto temp_pending_fee_index( _pending_fee_index );
-         for( auto pair : temp_pending_fee_index )
+         // a transaction spending the outputs of another pending transaction fails until that one
+         // is included, so they are retried once nothing else fits
+         std::vector< std::pair<share_type,transaction_evaluation_state_ptr> > deferred;
+         for( const auto& item : pending_trxs )
          {
-            auto fee_index = pair.first;
+            if( BTS_BLOCKCHAIN_MAX_BLOCK_SIZE - tmpl.size < min_trx_size )
+               break;
 
-            if( confirmed_trx_ids.count( fee_index._trx ) > 0 )
-               _pending_fee_index.erase( fee_index );
+            // keep going, smaller transactions further down may still fit
+            if( tmpl.size + item->trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+               continue;
+
+            auto priority = _pending_pool.get_priority( item->trx_id );
+            try {
+               apply_to_template( tmpl, item, priority );
+            }
+            catch ( const fc::exception& e )
+            {
+               if( !_pending_pool.get_dependencies( item->trx ).empty() )
+               {
+                  deferred.push_back( std::make_pair( priority, item ) );
+                  continue;
+               }
+               wlog( "pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
+                     ("trx",fc::json::to_pretty_string(item->trx) )("e",e.to_detail_string()) );
+            }
+         }
+
+         bool included_any = true;
+         while( included_any && !deferred.empty() )
+         {
+            included_any = false;
+            std::vector< std::pair<share_type,transaction_evaluation_state_ptr> > still_deferred;
+            for( const auto& item : deferred )
+            {
+               if( tmpl.size + item.second->trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+                  continue;
+               try {
+                  apply_to_template( tmpl, item.second, item.first );
+                  included_any = true;
+               }
+               catch ( const fc::exception& )
+               {
+                  still_deferred.push_back( item );
+               }
+            }
+            deferred.swap( still_deferred );
          }
       }
 
-      void chain_database_impl::recursive_mark_as_linked( const std::unordered_set<block_id_type>& ids )
+      bool chain_database_impl::block_template_is_current()const
+      {
+         return _block_template.state && !_block_template.stale && _block_template.head_id == _head_block_id;
+      }
+
+      void chain_database_impl::add_to_block_template( const transaction_evaluation_state_ptr& trx_state )
+      {
+         if( !block_template_is_current() ) return;
+
+         auto priority = get_fee_priority( *trx_state );
+         if( _block_template.size + trx_state->trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
+         {
+            // the template has to be packed again to make room for it
+            if( priority > _block_template.min_priority ) _block_template.stale = true;
+            return;
+         }
+
+         try {
+            apply_to_template( _block_template, trx_state, priority );
+         }
+         catch ( const fc::exception& )
+         {
+            // it conflicts with or depends on transactions that are not in the template,
+            // the next time the template is packed they are ranked together
+         }
+      }
+
+      void chain_database_impl::revalidate_pending( const pending_chain_state& block_changes )
+      {
+         start_batch();
+         try {
+            revalidate_pending_transactions( block_changes );
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
+         {
+            // the pool was changed along with the aborted writes, bring it back in line with the database
+            abort_batch();
+            load_pending_transactions();
+            throw;
+         }
+      }
+
+      void chain_database_impl::revalidate_pending_transactions( const pending_chain_state& block_changes )
       {
-         std::unordered_set<block_id_type> next_ids = ids;
-         while( next_ids.size() )
+         for( const auto& id : _pending_pool.get_expired( _head_block_header.timestamp ) )
+         {
+            _pending_pool.remove( id );
+            _pending_transaction_db.remove( id );
+         }
+
+         // the fee rate changes with every block, the transactions that no longer pay it are at the
+         // end of the fee order and everything else only depends on the records that it touches
+         auto affected = _pending_pool.get_affected( block_changes );
+         auto underpaying = _pending_pool.get_below_fee_rate( self->get_fee_rate() );
+         affected.insert( affected.end(), underpaying.begin(), underpaying.end() );
+
+         std::unordered_set<transaction_id_type> revalidated;
+         for( size_t i = 0; i < affected.size(); ++i )
          {
-            std::unordered_set<block_id_type> pending;
-            for( auto item : next_ids )
+            auto trx_state = affected[i];
+            auto trx_id = trx_state->trx_id;
+            if( !revalidated.insert( trx_id ).second || !_pending_pool.contains( trx_id ) )
+               continue;
+
+            // transactions spending the outputs of one that is dropped have to be checked as well
+            auto dependents = _pending_pool.get_dependents( trx_id );
+            _pending_pool.remove( trx_id );
+            try {
+               add_pending_transaction( trx_state->trx, trx_state->signed_keys );
+            }
+            catch ( const fc::exception& e )
             {
-                block_fork_data record = _fork_db.fetch( item );
-                record.is_linked = true;
-                pending.insert( record.next_blocks.begin(), record.next_blocks.end() );
-                //ilog( "store: ${id} => ${data}", ("id",item)("data",record) );
-                _fork_db.store( item, record );
+               wlog( "dropping pending transaction ${id} that is no longer valid: ${e}", ("id",trx_id)("e",e.to_string()) );
+               _pending_transaction_db.remove( trx_id );
+               for( const auto& dependent : dependents )
+                  if( !revalidated.count( dependent->trx_id ) ) affected.push_back( dependent );
             }
-            next_ids = pending;
          }
       }
-      void chain_database_impl::recursive_mark_as_invalid( const std::unordered_set<block_id_type>& ids )
+
+      void chain_database_impl::recursive_mark_as_linked( const std::unordered_set<block_id_type>& ids )
       {
-         std::unordered_set<block_id_type> next_ids = ids;
-         while( next_ids.size() )
+         std::vector<block_id_type> next_ids( ids.begin(), ids.end() );
+         start_batch();
+         try {
+            while( !next_ids.empty() )
+            {
+               auto id = next_ids.back();
+               next_ids.pop_back();
+               const auto& node = modify_fork_node( id, []( fork_node& n ) { n.data.is_linked = true; } );
+               next_ids.insert( next_ids.end(), node.data.next_blocks.begin(), node.data.next_blocks.end() );
+            }
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
          {
-            std::unordered_set<block_id_type> pending;
-            for( auto item : next_ids )
+            abort_batch();
+            throw;
+         }
+      }
+      void chain_database_impl::recursive_mark_as_invalid( const std::unordered_set<block_id_type>& ids )
+      {
+         std::vector<block_id_type> next_ids( ids.begin(), ids.end() );
+         start_batch();
+         try {
+            while( !next_ids.empty() )
             {
-                block_fork_data record = _fork_db.fetch( item );
-                record.is_valid = false;
-                pending.insert( record.next_blocks.begin(), record.next_blocks.end() );
-                //ilog( "store: ${id} => ${data}", ("id",item)("data",record) );
-                _fork_db.store( item, record );
+               auto id = next_ids.back();
+               next_ids.pop_back();
+               const auto& node = modify_fork_node( id, []( fork_node& n ) { n.data.is_valid = false; } );
+               next_ids.insert( next_ids.end(), node.data.next_blocks.begin(), node.data.next_blocks.end() );
             }
-            next_ids = pending;
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
+         {
+            abort_batch();
+            throw;
          }
       }
 
@@ -260,131 +1095,289 @@ namespace bts { namespace blockchain {
        */
       block_fork_data chain_database_impl::store_and_index( const block_id_type& block_id,
                                                             const full_block& block_data )
+      { try {
+          // the block is written to the log before the batch that indexes it so that a crash
+          // in between leaves a record that replay_block_log() indexes on the next start
+          auto offset = _block_location_db.fetch_optional( block_id );
+          if( !offset.valid() )
+          {
+             auto packed = fc::raw::pack( block_data );
+             offset = _block_log.append( packed.data(), packed.size() );
+             _block_log.flush();
+          }
+
+          start_batch();
+          try {
+             auto fork = index_block( block_id, block_data, *offset );
+             self->set_property( chain_property_enum::block_log_end_id, fc::variant(_block_log.size()) );
+             _chain_db.commit_batch();
+             return fork;
+          }
+          catch ( ... )
+          {
+             abort_batch();
+             throw;
+          }
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
+
+      block_fork_data chain_database_impl::index_block( const block_id_type& block_id,
+                                                        const full_block& block_data,
+                                                        uint64_t log_offset )
       { try {
           //ilog( "block_number: ${n}   id: ${id}  prev: ${prev}",
            //     ("n",block_data.block_num)("id",block_id)("prev",block_data.previous) );
 
           // first of all store this block at the given block number
-          _block_id_to_block_db.store( block_id, block_data );
+          _block_location_db.store( block_id, log_offset );
+          _block_header_db.store( block_id, block_header_record( block_data, block_id ) );
 
           // update the parallel block list
           std::vector<block_id_type> parallel_blocks = fetch_blocks_at_number( block_data.block_num );
-          std::find( parallel_blocks.begin(), parallel_blocks.end(), block_id );
-          parallel_blocks.push_back( block_id );
-          _fork_number_db.store( block_data.block_num, parallel_blocks );
-
-
-          // now find how it links in.
-          block_fork_data prev_fork_data;
-          auto prev_itr = _fork_db.find( block_data.previous );
-          if( prev_itr.valid() ) // we already know about its previous
+          if( std::find( parallel_blocks.begin(), parallel_blocks.end(), block_id ) == parallel_blocks.end() )
           {
-             ilog( "           we already know about its previous: ${p}", ("p",block_data.previous) );
-             prev_fork_data = prev_itr.value();
-             prev_fork_data.next_blocks.insert(block_id);
-             //ilog( "              ${id} = ${record}", ("id",prev_itr.key())("record",prev_fork_data) );
-             _fork_db.store( prev_itr.key(), prev_fork_data );
+             parallel_blocks.push_back( block_id );
+             _fork_number_db.store( block_data.block_num, parallel_blocks );
           }
-          else
+
+          // now find how it links in, if the previous block is unknown a node is created for
+          // it that is only linked if it is the genesis block
+          bool previous_known = _fork_tree.find( block_data.previous ) != _fork_tree.end();
+          const auto& prev_node = modify_fork_node( block_data.previous, [&]( fork_node& n )
           {
-             ilog( "           we don't know about its previous: ${p}", ("p",block_data.previous) );
-             // create it... we do not know about the previous block so
-             // we must create it and assume it is not linked...
-             prev_fork_data.next_blocks.insert(block_id);
-             prev_fork_data.is_linked = block_data.previous == block_id_type(); //false;
-             //ilog( "              ${id} = ${record}", ("id",block_data.previous)("record",prev_fork_data) );
-             _fork_db.store( block_data.previous, prev_fork_data );
-          }
+             if( !previous_known ) n.data.is_linked = block_data.previous == block_id_type();
+             n.data.next_blocks.insert( block_id );
+          });
 
-          block_fork_data current_fork;
-          auto cur_itr = _fork_db.find( block_id );
-          if( cur_itr.valid() )
+          bool found_link = false;
+          const auto& current = modify_fork_node( block_id, [&]( fork_node& n )
           {
-             current_fork = cur_itr.value();
-             ilog( "          current_fork: ${fork}", ("fork",current_fork) );
-             ilog( "          prev_fork: ${prev_fork}", ("prev_fork",prev_fork_data) );
-             if( !current_fork.is_linked && prev_fork_data.is_linked )
+             n.previous = block_data.previous;
+             if( !n.data.is_linked && prev_node.data.is_linked )
              {
-                // we found the missing link
-                current_fork.is_linked = true;
-                recursive_mark_as_linked( current_fork.next_blocks );
-                _fork_db.store( block_id, current_fork );
+                // either a new block or the missing link of blocks that were received before it
+                n.data.is_linked = true;
+                found_link = !n.data.next_blocks.empty();
              }
-          }
-          else
-          {
-             current_fork.is_linked = prev_fork_data.is_linked;
-             //ilog( "          current_fork: ${id} = ${fork}", ("id",block_id)("fork",current_fork) );
-             _fork_db.store( block_id, current_fork );
-          }
-          return current_fork;
+          });
+          if( found_link )
+             recursive_mark_as_linked( current.data.next_blocks );
+          return current.data;
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
       void chain_database_impl::mark_invalid( const block_id_type& block_id )
       {
-         // fetch the fork data for block_id, mark it as invalid and
-         // then mark every item after it as invalid as well.
-         auto fork_data = _fork_db.fetch( block_id );
-         fork_data.is_valid = false;
-         _fork_db.store( block_id, fork_data );
-         recursive_mark_as_invalid( fork_data.next_blocks );
+         // mark the block as invalid and then every block after it as well
+         start_batch();
+         try {
+            const auto& node = modify_fork_node( block_id, []( fork_node& n ) { n.data.is_valid = false; } );
+            recursive_mark_as_invalid( node.data.next_blocks );
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
+         {
+            abort_batch();
+            throw;
+         }
       }
 
       void chain_database_impl::mark_included( const block_id_type& block_id, bool included )
       { try {
-         //ilog( "included: ${block_id} = ${state}", ("block_id",block_id)("state",included) );
-         auto fork_data = _fork_db.fetch( block_id );
-       //  if( fork_data.is_included != included )
+         modify_fork_node( block_id, [&]( fork_node& n )
          {
-            fork_data.is_included = included;
-            if( included )
-            {
-               fork_data.is_valid  = true;
-            }
-            //ilog( "store: ${id} => ${data}", ("id",block_id)("data",fork_data) );
-            _fork_db.store( block_id, fork_data );
-         }
-         // fetch the fork data for block_id, mark it as included and
+            n.data.is_included = included;
+            if( included ) n.data.is_valid = true;
+         });
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id)("included",included) ) }
 
       void chain_database_impl::switch_to_fork( const block_id_type& block_id )
       { try {
          ilog( "switch from fork ${id} to ${to_id}", ("id",_head_block_id)("to_id",block_id) );
-         std::vector<block_id_type> history = get_fork_history( block_id );
-         FC_ASSERT( history.size() > 0 );
-         while( history.back() != _head_block_id )
+
+         // recover the signers before popping anything because waiting on the signature
+         // threads lets other tasks see the database, if they moved the head meanwhile the
+         // history of the fork is computed again from the new head
+         std::vector<block_id_type> history;
+         std::vector<full_block>    fork_blocks;
+         std::vector<block_signers> fork_signers;
+         std::unordered_map<block_id_type,block_signers> recovered;
+         while( true )
          {
-            ilog( "    pop ${id}", ("id",_head_block_id) );
-            pop_block();
+            auto history_head = _head_block_id;
+            history = get_fork_history( block_id );
+            FC_ASSERT( history.size() > 1 );
+
+            fork_blocks.clear();
+            fork_signers.clear();
+            for( int32_t i = history.size()-2; i >= 0 ; --i )
+            {
+               fork_blocks.push_back( self->get_block( history[i] ) );
+               auto signers = recovered.find( history[i] );
+               if( signers == recovered.end() )
+                  signers = recovered.insert( std::make_pair( history[i], recover_signers( fork_blocks.back() ) ) ).first;
+               fork_signers.push_back( signers->second );
+            }
+            if( history_head == _head_block_id )
+               break;
+
+            ilog( "the head moved to ${id} while the signers of the fork were recovered", ("id",_head_block_id) );
+            auto fork_head = _fork_tree.find( block_id );
+            if( fork_head != _fork_tree.end() && fork_head->second.data.is_included )
+               return;
+            if( fork_blocks.back().block_num <= _head_block_header.block_num )
+               return;
+         }
+
+         auto original_head_id     = _head_block_id;
+         auto original_head_header = _head_block_header;
+
+         // reads inside of the batch see its pending writes, so the fork is evaluated on top of the
+         // common ancestor before anything is written to disk
+         _switching_fork = true;
+         _fork_changes   = std::make_shared<pending_chain_state>( self->shared_from_this() );
+         start_batch();
+         try {
+            while( history.back() != _head_block_id )
+            {
+               ilog( "    pop ${id}", ("id",_head_block_id) );
+               pop_block();
+            }
+            for( uint32_t i = 0; i < fork_blocks.size(); ++i )
+            {
+               ilog( "    extend ${id}", ("id",history[history.size()-2-i]) );
+               extend_chain( history[history.size()-2-i], fork_blocks[i], fork_signers[i] );
+            }
+            _chain_db.commit_batch();
          }
-         for( int32_t i = history.size()-2; i >= 0 ; --i )
+         catch ( ... )
          {
-            ilog( "    extend ${i}", ("i",history[i]) );
-            extend_chain( self->get_block( history[i] ) );
+            // extend_chain aborts the batch itself before it marks the block invalid
+            abort_batch();
+            _head_block_id     = original_head_id;
+            _head_block_header = original_head_header;
+            finish_fork_switch( false );
+            throw;
          }
+         finish_fork_switch( true );
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
+      void chain_database_impl::add_fork_changes( const pending_chain_state_ptr& changes )
+      {
+         auto prev_state = changes->_prev_state;
+         changes->set_prev_state( _fork_changes );
+         changes->apply_changes();
+         changes->set_prev_state( prev_state );
+      }
+
+      void chain_database_impl::finish_fork_switch( bool committed )
+      {
+         _switching_fork = false;
+         auto changes       = std::move( _fork_changes );
+         auto included      = std::move( _fork_included_trxs );
+         auto notifications = std::move( _fork_notifications );
+         _fork_changes.reset();
+         _fork_included_trxs.clear();
+         _fork_notifications.clear();
+         if( !committed ) return;
+
+         try {
+            clear_pending( included );
+            revalidate_pending( *changes );
+         }
+         catch ( const fc::exception& e )
+         {
+            wlog( "error updating the pending transactions: ${e}", ("e",e.to_detail_string() ) );
+         }
+         for( const auto& notification : notifications )
+            notify_observer( notification );
+      }
+
+      void chain_database_impl::notify_observer( const std::function<void()>& notification )
+      {
+         if( !_observer ) return;
+         if( _switching_fork )
+         {
+            _fork_notifications.push_back( notification );
+            return;
+         }
+         try {
+            notification();
+         }
+         catch ( const fc::exception& e )
+         {
+            wlog( "${e}", ("e",e.to_detail_string() ) );
+         }
+      }
+
+
+      block_signers chain_database_impl::recover_signers( const full_block& blk )
+      {
+         const auto& trxs = blk.user_transactions;
+         block_signers signers( trxs.size() );
+
+         auto recover = [&]( uint32_t first, uint32_t stride )
+         {
+            for( uint32_t i = first; i < trxs.size(); i += stride )
+            {
+               try {
+                  signers[i] = trxs[i].get_signed_addresses( _chain_id );
+               }
+               catch ( const fc::exception& )
+               {
+                  // left empty, evaluate() recovers again and reports the error in context
+               }
+            }
+         };
+
+         if( trxs.size() < 2 )
+         {
+            recover( 0, 1 );
+            return signers;
+         }
+
+         if( _signature_threads.empty() )
+         {
+            auto num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+            for( uint32_t i = 0; i < num_threads; ++i )
+               _signature_threads.emplace_back( new fc::thread( "signature recovery " + fc::to_string( uint64_t(i) ) ) );
+         }
+
+         uint32_t num_tasks = std::min<uint32_t>( _signature_threads.size(), trxs.size() );
+         std::vector< fc::future<void> > recovered;
+         for( uint32_t i = 0; i < num_tasks; ++i )
+            recovered.push_back( _signature_threads[i]->async( [&recover,i,num_tasks](){ recover( i, num_tasks ); } ) );
+         for( auto& task : recovered )
+            task.wait();
+
+         return signers;
+      }
 
       void chain_database_impl::apply_transactions( uint32_t block_num,
                                                     const std::vector<signed_transaction>& user_transactions,
+                                                    const block_signers& signers,
                                                     const pending_chain_state_ptr& pending_state )
       {
          //ilog( "apply transactions ${block_num}", ("block_num",block_num) );
          uint32_t trx_num = 0;
          try {
             // apply changes from each transaction
-            for( auto trx : user_transactions )
+            for( const auto& trx : user_transactions )
             {
                transaction_evaluation_state_ptr trx_eval_state =
                       std::make_shared<transaction_evaluation_state>(pending_state,_chain_id);
-               trx_eval_state->evaluate( trx );
+               trx_eval_state->skip_signature_check = _trusted_replay;
+               if( _trusted_replay )
+                  trx_eval_state->evaluate( trx, std::unordered_set<address>() );
+               else if( trx_num < signers.size() && signers[trx_num].valid() )
+                  trx_eval_state->evaluate( trx, *signers[trx_num] );
+               else
+                  trx_eval_state->evaluate( trx );
                //ilog( "evaluation: ${e}", ("e",*trx_eval_state) );
               // TODO:  capture the evaluation state with a callback for wallets...
               // summary.transaction_states.emplace_back( std::move(trx_eval_state) );
 
                transaction_location trx_loc( block_num, trx_num );
                //ilog( "store trx location: ${loc}", ("loc",trx_loc) );
-               pending_state->store_transaction_location( trx.id(), trx_loc );
+               pending_state->store_transaction_location( trx_eval_state->trx_id, trx_loc );
                ++trx_num;
             }
       } FC_RETHROW_EXCEPTIONS( warn, "", ("trx_num",trx_num) ) }
@@ -407,16 +1400,56 @@ namespace bts { namespace blockchain {
 
       } FC_RETHROW_EXCEPTIONS( warn, "", ("time_slot",time_slot)("amount",amount) ) }
 
-      void chain_database_impl::save_undo_state( const block_id_type& block_id,
-                                               const pending_chain_state_ptr& pending_state )
+      /** called after the changes of the block were applied, the deltas are taken against the new state */
+      void chain_database_impl::save_undo_state( const block_id_type& block_id, uint32_t block_num,
+                                                 const pending_chain_state& undo_state )
       { try {
-           pending_chain_state_ptr undo_state = std::make_shared<pending_chain_state>(nullptr);
-           pending_state->get_undo_state( undo_state );
-           _undo_state_db.store( block_id, *undo_state );
+           _undo_data_db.store( block_id, undo_data::encode( block_num, undo_state, *self ) );
+
+           if( block_num <= _undo_history ) return;
+           auto irreversible_id = _block_num_to_id_db.fetch_optional( block_num - _undo_history );
+           if( irreversible_id.valid() )
+           {
+              _undo_data_db.remove( *irreversible_id );
+              _undo_state_db.remove( *irreversible_id );
+           }
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
+      pending_chain_state_ptr chain_database_impl::fetch_undo_state( const block_id_type& block_id )
+      { try {
+           auto data = _undo_data_db.fetch_optional( block_id );
+           if( data.valid() ) return data->decode( *self );
+
+           auto legacy_state = _undo_state_db.fetch_optional( block_id );
+           FC_ASSERT( legacy_state.valid(), "block ${id} is more than ${n} blocks below the head and can not be undone",
+                      ("id",block_id)("n",_undo_history) );
+           return std::make_shared<pending_chain_state>( *legacy_state );
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
+
+      void chain_database_impl::prune_undo_history()
+      { try {
+           uint32_t head_num = _head_block_header.block_num;
+           if( head_num <= _undo_history ) return;
+           uint32_t irreversible_num = head_num - _undo_history;
+
+           std::vector<block_id_type> pruned;
+           for( auto itr = _undo_data_db.begin(); itr.valid(); ++itr )
+              if( itr.value().block_num <= irreversible_num ) pruned.push_back( itr.key() );
+           for( const auto& id : pruned )
+              _undo_data_db.remove( id );
+
+           pruned.clear();
+           for( auto itr = _undo_state_db.begin(); itr.valid(); ++itr )
+           {
+              auto header = _block_header_db.fetch_optional( itr.key() );
+              if( !header.valid() || header->block_num <= irreversible_num ) pruned.push_back( itr.key() );
+           }
+           for( const auto& id : pruned )
+              _undo_state_db.remove( id );
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
-      void chain_database_impl::verify_header( const full_block& block_data )
+
+      void chain_database_impl::verify_header( const full_block& block_data, const digest_block& digest_data )
       { try {
             // validate preliminaries:
             FC_ASSERT( block_data.block_num == _head_block_header.block_num + 1 );
@@ -433,22 +1466,21 @@ namespace bts { namespace blockchain {
 
             FC_ASSERT( block_data.fee_rate  == expected_next_fee );
 
-            digest_block digest_data(block_data);
             FC_ASSERT( digest_data.validate_digest() );
             FC_ASSERT( digest_data.validate_unique() );
 
             // signign delegate id: 
             auto signing_delegate_id = self->get_signing_delegate_id( block_data.timestamp );
-            FC_ASSERT( block_data.validate_signee( self->get_signing_delegate_key(block_data.timestamp) ),
+            FC_ASSERT( _trusted_replay || block_data.validate_signee( self->get_signing_delegate_key(block_data.timestamp) ),
                        "", ("signing_delegate_key", self->get_signing_delegate_key(block_data.timestamp))
                            ("signing_delegate_id", signing_delegate_id ) );
 
       } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
-      void chain_database_impl::update_head_block( const full_block& block_data )
+      void chain_database_impl::update_head_block( const block_id_type& block_id, const full_block& block_data )
       {
          _head_block_header = block_data;
-         _head_block_id = block_data.id();
+         _head_block_id = block_id;
       }
 
       /**
@@ -543,12 +1575,18 @@ namespace bts { namespace blockchain {
       /**
        *  Performs all of the block validation steps and throws if error.
        */
-      void chain_database_impl::extend_chain( const full_block& block_data )
+      void chain_database_impl::extend_chain( const block_id_type& block_id, const full_block& block_data,
+                                              const block_signers& signers )
       { try {
-         auto block_id = block_data.id();
          block_summary summary;
+         std::vector<transaction_id_type> included_trx_ids;
+         auto previous_head_id = _head_block_id;
+         signed_block_header previous_head = _head_block_header;
          try {
-            verify_header( block_data );
+            // hashes every transaction once, the ids are reused below
+            digest_block digest_data( block_data );
+            included_trx_ids = digest_data.user_transaction_ids;
+            verify_header( block_data, digest_data );
 
             summary.block_data = block_data;
 
@@ -565,7 +1603,7 @@ namespace bts { namespace blockchain {
             //apply_deterministic_updates(pending_state);
 
             //ilog( "block data: ${block_data}", ("block_data",block_data) );
-            apply_transactions( block_data.block_num, block_data.user_transactions, pending_state );
+            apply_transactions( block_data.block_num, block_data.user_transactions, signers, pending_state );
 
             pay_delegate( block_data.timestamp, block_data.delegate_pay_rate, pending_state );
 
@@ -573,7 +1611,16 @@ namespace bts { namespace blockchain {
 
             update_random_seed( block_data.previous_secret, pending_state );
 
-            save_undo_state( block_id, pending_state );
+            // everything from here until the commit is written to disk as a single batch, any
+            // error before the commit leaves the database and the head block as they were
+            start_batch();
+
+            pending_chain_state_ptr undo_state;
+            if( block_data.block_num >= _undo_history_start )
+            {
+               undo_state = std::make_shared<pending_chain_state>();
+               pending_state->get_undo_state( undo_state );
+            }
 
             // TODO: verify that apply changes can be called any number of
             // times without changing the database other than the first
@@ -581,28 +1628,55 @@ namespace bts { namespace blockchain {
             // ilog( "apply changes\n${s}", ("s",fc::json::to_pretty_string( *pending_state) ) );
             pending_state->apply_changes();
 
-            mark_included( block_id, true );
-
-            update_head_block( block_data );
+            if( undo_state )
+               save_undo_state( block_id, block_data.block_num, *undo_state );
 
-            clear_pending( block_data );
+            mark_included( block_id, true );
 
             _block_num_to_id_db.store( block_data.block_num, block_id );
 
+            self->set_property( chain_property_enum::chain_totals_id, fc::variant(_totals) );
+
+            // checked before the commit so that a block breaking the totals is never written
             self->sanity_check();
+
+            update_head_block( block_id, block_data );
+
+            _chain_db.commit_batch();
          }
          catch ( const fc::exception& e )
          {
             wlog( "error applying block: ${e}", ("e",e.to_detail_string() ));
+            abort_batch();
+            _head_block_id     = previous_head_id;
+            _head_block_header = previous_head;
             mark_invalid( block_id );
             throw;
          }
-         if( _observer ) try { 
-            _observer->block_applied( summary );
-         } catch ( const fc::exception& e )
+
+         // the block is committed, nothing below makes it invalid
+         if( _switching_fork )
          {
-            wlog( "${e}", ("e",e.to_detail_string() ) );
+            _fork_included_trxs.insert( _fork_included_trxs.end(), included_trx_ids.begin(), included_trx_ids.end() );
+            add_fork_changes( summary.applied_changes );
+         }
+         else
+         {
+            try {
+               clear_pending( included_trx_ids );
+               revalidate_pending( *summary.applied_changes );
+            }
+            catch ( const fc::exception& e )
+            {
+               wlog( "error updating the pending transactions: ${e}", ("e",e.to_detail_string() ) );
+            }
          }
+
+         // the audit scans the tables, which does not see the writes of an uncommitted fork switch
+         if( _audit_interval != 0 && block_data.block_num % _audit_interval == 0 && !_switching_fork )
+            self->audit_state();
+
+         notify_observer( [this,summary]() { _observer->block_applied( summary ); } );
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block",block_data) ) }
 
       /**
@@ -613,57 +1687,67 @@ namespace bts { namespace blockchain {
        */
       std::vector<block_id_type> chain_database_impl::get_fork_history( const block_id_type& id )
       { try {
-         ilog( "" );
          std::vector<block_id_type> history;
          history.push_back( id );
 
          block_id_type next_id = id;
          while( true )
          {
-            auto header = self->get_block_header( next_id );
-            //ilog( "header: ${h}", ("h",header) );
-            history.push_back( header.previous );
-            if( header.previous == block_id_type() )
-            {
-               ilog( "return: ${h}", ("h",history) );
+            auto node_itr = _fork_tree.find( next_id );
+            FC_ASSERT( node_itr != _fork_tree.end(), "unknown block ${id}", ("id",next_id) );
+            const block_id_type& previous = node_itr->second.previous;
+            history.push_back( previous );
+            if( previous == block_id_type() )
                return history;
-            }
-            auto prev_fork_data = _fork_db.fetch( header.previous );
+
+            auto prev_itr = _fork_tree.find( previous );
 
             /// this shouldn't happen if the database invariants are properly maintained 
-            FC_ASSERT( prev_fork_data.is_linked, "we hit a dead end, this fork isn't really linked!" );
-            if( prev_fork_data.is_included )
-            {
-               ilog( "return: ${h}", ("h",history) );
+            FC_ASSERT( prev_itr != _fork_tree.end() && prev_itr->second.data.is_linked,
+                       "we hit a dead end, this fork isn't really linked!" );
+            if( prev_itr->second.data.is_included )
                return history;
-            }
-            next_id = header.previous;
+            next_id = previous;
          }
-         ilog( "${h}", ("h",history) );
-         return history;
       } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",id) ) }
 
       void  chain_database_impl::pop_block()
       { try {
          FC_ASSERT( _head_block_header.block_num > 0 );
 
-         // update the is_included flag on the fork data
-         mark_included( _head_block_id, false );
-
-         // update the block_num_to_block_id index
-         _block_num_to_id_db.remove( _head_block_header.block_num );
-
          auto previous_block_id = _head_block_header.previous;
 
          // fetch the undo state for the head block
-         auto undo_state = _undo_state_db.fetch( _head_block_id );
-         undo_state.set_prev_state( self->shared_from_this() );
-         undo_state.apply_changes();
+         auto undo_state = fetch_undo_state( _head_block_id );
+
+         start_batch();
+         try {
+            // update the is_included flag on the fork data
+            mark_included( _head_block_id, false );
+
+            // update the block_num_to_block_id index
+            _block_num_to_id_db.remove( _head_block_header.block_num );
+            _undo_data_db.remove( _head_block_id );
+            _undo_state_db.remove( _head_block_id );
+
+            undo_state->set_prev_state( self->shared_from_this() );
+            undo_state->apply_changes();
+
+            self->set_property( chain_property_enum::chain_totals_id, fc::variant(_totals) );
+
+            _chain_db.commit_batch();
+         }
+         catch ( ... )
+         {
+            abort_batch();
+            throw;
+         }
 
          _head_block_id = previous_block_id;
          _head_block_header = self->get_block_header( _head_block_id );
 
-         if( _observer ) _observer->state_changed(undo_state.shared_from_this());
+         if( _switching_fork ) add_fork_changes( undo_state );
+         notify_observer( [this,undo_state]() { _observer->state_changed( undo_state ); } );
 
       } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
@@ -673,6 +1757,12 @@ namespace bts { namespace blockchain {
    :my( new detail::chain_database_impl() )
    {
       my->self = this;
+      // the pool evicts in the order blocks are packed
+      auto impl = my.get();
+      my->_pending_pool.set_priority_function( [impl]( const transaction_evaluation_state& trx_state )
+      {
+         return impl->get_fee_priority( trx_state );
+      });
    }
 
    chain_database::~chain_database()
@@ -699,14 +1789,14 @@ namespace bts { namespace blockchain {
     */
    std::vector<account_id_type> chain_database::get_delegates_by_vote(uint32_t first, uint32_t count )const
    { try {
-      auto del_vote_itr = my->_delegate_vote_index_db.begin();
       std::vector<account_id_type> sorted_delegates;
-      uint32_t pos = 0;
-      while( sorted_delegates.size() < count && del_vote_itr.valid() )
+      if( first >= my->_delegate_votes.size() ) return sorted_delegates;
+      sorted_delegates.reserve( std::min<size_t>( count, my->_delegate_votes.size() - first ) );
+
+      auto del_vote_itr = std::next( my->_delegate_votes.begin(), first );
+      while( sorted_delegates.size() < count && del_vote_itr != my->_delegate_votes.end() )
       {
-         if( pos >= first )
-            sorted_delegates.push_back( del_vote_itr.key().delegate_id );
-         ++pos;
+         sorted_delegates.push_back( del_vote_itr->delegate_id );
          ++del_vote_itr;
       }
       return sorted_delegates;
@@ -717,16 +1807,9 @@ namespace bts { namespace blockchain {
     */
    std::vector<account_record> chain_database::get_delegate_records_by_vote(uint32_t first, uint32_t count )const
    { try {
-      auto del_vote_itr = my->_delegate_vote_index_db.begin();
       std::vector<account_record> sorted_delegates;
-      uint32_t pos = 0;
-      while( sorted_delegates.size() < count && del_vote_itr.valid() )
-      {
-         if( pos >= first )
-            sorted_delegates.push_back( *get_account_record(del_vote_itr.value()) );
-         ++pos;
-         ++del_vote_itr;
-      }
+      for( const auto& delegate_id : get_delegates_by_vote( first, count ) )
+         sorted_delegates.push_back( *get_account_record( delegate_id ) );
       return sorted_delegates;
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
@@ -737,37 +1820,16 @@ namespace bts { namespace blockchain {
       {
           fc::create_directories( data_dir );
 
-          my->_fork_number_db.open( data_dir / "fork_number_db" );
-          my->_fork_db.open( data_dir / "fork_db" );
-          my->_property_db.open( data_dir / "property_db" );
-          my->_proposal_db.open( data_dir / "proposal_db" );
-          my->_proposal_vote_db.open( data_dir / "proposal_vote_db" );
-
-          my->_undo_state_db.open( data_dir / "undo_state_db" );
-
-          my->_block_num_to_id_db.open( data_dir / "block_num_to_id_db" );
-          my->_block_id_to_block_db.open( data_dir / "block_id_to_block_db" );
-
-          my->_pending_transaction_db.open( data_dir / "pending_transaction_db" );
-
-          my->_asset_db.open( data_dir / "asset_db" );
-          my->_balance_db.open( data_dir / "balance_db" );
-          my->_account_db.open( data_dir / "account_db" );
-          my->_address_to_account_db.open( data_dir / "address_to_account_db" );
-
-          my->_account_index_db.open( data_dir / "account_index_db" );
-          my->_symbol_index_db.open( data_dir / "symbol_index_db" );
-          my->_delegate_vote_index_db.open( data_dir / "delegate_vote_index_db" );
+          my->open_database( data_dir );
 
-          my->_ask_db.open( data_dir / "ask_db" );
-          my->_bid_db.open( data_dir / "bid_db" );
-          my->_short_db.open( data_dir / "short_db" );
-          my->_collateral_db.open( data_dir / "collateral_db" );
+          auto totals = my->_property_db.fetch_optional( chain_property_enum::chain_totals_id );
+          if( totals.valid() )
+             my->_totals = totals->as<chain_totals>();
+          else // written before the totals were tracked, they are stored with the next block
+             my->_totals = my->scan_totals();
 
-          my->_processed_transaction_id_db.open( data_dir / "processed_transaction_id_db" );
-
-          // TODO: check to see if we crashed during the last write
-          //   if so, then apply the last undo operation stored.
+          // every block is applied with one atomic write so
+          // the head block recorded in _block_num_to_id_db always matches the rest of the state.
 
           uint32_t       last_block_num = -1;
           block_id_type  last_block_id;
@@ -778,28 +1840,12 @@ namespace bts { namespace blockchain {
              my->_head_block_id = last_block_id;
           }
 
-          //  process the pending transactions to cache by fees
-          auto pending_itr = my->_pending_transaction_db.begin();
-          while( pending_itr.valid() )
-          {
-             try {
-                auto trx = pending_itr.value();
-                auto trx_id = trx.id();
-                auto eval_state = evaluate_transaction( trx );
-                share_type fees = eval_state->get_fees();
-                my->_pending_fee_index[ fee_index( fees, trx_id ) ] = eval_state;
-                my->_pending_transaction_db.store( trx_id, trx );
-             }
-             catch ( const fc::exception& e )
-             {
-                wlog( "error processing pending transaction: ${e}", ("e",e.to_detail_string() ) );
-             }
-             ++pending_itr;
-          }
-
           if( last_block_num == uint32_t(-1) )
              my->initialize_genesis(genesis_file);
           my->_chain_id = get_property( bts::blockchain::chain_id ).as<digest_type>();
+          my->prune_undo_history();
+
+          my->load_pending_transactions();
       }
       catch( ... )
       {
@@ -812,35 +1858,147 @@ namespace bts { namespace blockchain {
 
    void chain_database::close()
    { try {
-      my->_fork_number_db.close();
-      my->_fork_db.close();
-      my->_property_db.close();
-      my->_proposal_db.close();
-      my->_proposal_vote_db.close();
+      my->close_database();
+   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+   void chain_database::replay( const fc::path& data_dir, fc::path genesis_file,
+                                function<void( uint32_t, uint32_t )> progress )
+   { try {
+      FC_ASSERT( !my->_block_log.is_open(), "the database must be closed to replay it" );
 
-      my->_undo_state_db.close();
+      // the blocks are replayed from this copy of the block log, if it exists a previous replay
+      // was interrupted and it is the only copy of the blocks left
+      auto replay_log_file = data_dir / "block_log.replay";
+      FC_ASSERT( fc::exists( data_dir / "block_log" ) || fc::exists( replay_log_file ),
+                 "there is no block log to replay in ${dir}", ("dir",data_dir) );
 
-      my->_block_num_to_id_db.close();
-      my->_block_id_to_block_db.close();
+      // the chain as of the last time the database was open, these blocks were validated then
+      std::vector<block_id_type> trusted_chain;
+      if( !fc::exists( replay_log_file ) )
+      {
+         try {
+            open( data_dir, genesis_file );
+            for( uint32_t block_num = 1; block_num <= get_head_block_num(); ++block_num )
+               trusted_chain.push_back( get_block_id( block_num ) );
+            close();
+         }
+         catch ( const fc::exception& e )
+         {
+            wlog( "unable to open ${dir}, every block will be validated: ${e}", ("dir",data_dir)("e",e.to_detail_string()) );
+            close();
+         }
+         fc::rename( data_dir / "block_log", replay_log_file );
+      }
+      else
+      {
+         wlog( "resuming an interrupted replay, every block will be validated" );
+      }
 
-      my->_pending_transaction_db.close();
+      // only the chain database and the per table databases that predate it are removed, anything
+      // else that shares the directory is left alone
+      std::vector<fc::path> old_files;
+      for( fc::directory_iterator itr( data_dir ); itr != fc::directory_iterator(); ++itr )
+      {
+         const auto name = (*itr).filename().generic_string();
+         if( name == "chain_db" || (name.size() > 3 && name.compare( name.size() - 3, 3, "_db" ) == 0) )
+            old_files.push_back( *itr );
+      }
+      for( auto file : old_files )
+         fc::remove_all( file );
+
+      bts::db::append_log replay_log;
+      replay_log.open( replay_log_file );
+
+      // headers are packed first so the block ids can be read without unpacking the transactions
+      std::unordered_map<block_id_type, std::pair<signed_block_header,uint64_t> > stored_blocks;
+      bts::db::append_log::record r;
+      uint64_t offset = 0;
+      uint64_t next = 0;
+      while( replay_log.read_next( offset, r, next ) )
+      {
+         fc::datastream<const char*> ds( r.data, r.size );
+         signed_block_header header;
+         fc::raw::unpack( ds, header );
+         stored_blocks[ header.id() ] = std::make_pair( header, offset );
+         offset = next;
+      }
 
-      my->_asset_db.close();
-      my->_balance_db.close();
-      my->_account_db.close();
-      my->_address_to_account_db.close();
+      if( trusted_chain.empty() )
+      {
+         // the longest chain of stored blocks that links to genesis
+         std::vector< std::pair<uint32_t,block_id_type> > by_number;
+         for( const auto& item : stored_blocks )
+            by_number.push_back( std::make_pair( item.second.first.block_num, item.first ) );
+         std::sort( by_number.begin(), by_number.end() );
+
+         std::unordered_set<block_id_type> linked;
+         linked.insert( block_id_type() );
+         block_id_type best;
+         uint32_t      best_num = 0;
+         for( const auto& item : by_number )
+         {
+            if( !linked.count( stored_blocks[item.second].first.previous ) ) continue;
+            linked.insert( item.second );
+            if( item.first > best_num ) { best = item.second; best_num = item.first; }
+         }
+         for( auto id = best; id != block_id_type(); id = stored_blocks[id].first.previous )
+            trusted_chain.push_back( id );
+         std::reverse( trusted_chain.begin(), trusted_chain.end() );
+      }
+      else
+      {
+         my->_trusted_replay = true;
+      }
 
-      my->_account_index_db.close();
-      my->_symbol_index_db.close();
-      my->_delegate_vote_index_db.close();
+      uint32_t total = trusted_chain.size();
+      if( total > my->_undo_history )
+         my->_undo_history_start = total - my->_undo_history + 1;
 
-      my->_ask_db.close();
-      my->_bid_db.close();
-      my->_short_db.close();
-      my->_collateral_db.close();
+      try {
+         open( data_dir, genesis_file );
+         ilog( "replaying ${n} blocks", ("n",total) );
+         for( uint32_t i = 0; i < total; ++i )
+         {
+            auto stored = stored_blocks.find( trusted_chain[i] );
+            FC_ASSERT( stored != stored_blocks.end(), "block ${id} is missing from the block log", ("id",trusted_chain[i]) );
 
-      my->_processed_transaction_id_db.close();
-   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+            auto block_record = replay_log.read( stored->second.second );
+            fc::datastream<const char*> ds( block_record.data, block_record.size );
+            full_block block_data;
+            fc::raw::unpack( ds, block_data );
+
+            if( my->_trusted_replay )
+            {
+               my->store_and_index( trusted_chain[i], block_data );
+               my->extend_chain( trusted_chain[i], block_data, detail::block_signers() );
+            }
+            else
+            {
+               try {
+                  push_block( block_data );
+               }
+               catch ( const fc::exception& e )
+               {
+                  wlog( "stopping the replay at invalid block ${n}: ${e}", ("n",block_data.block_num)("e",e.to_detail_string()) );
+                  break;
+               }
+            }
+            if( progress ) progress( block_data.block_num, total );
+         }
+      }
+      catch ( ... )
+      {
+         my->_trusted_replay = false;
+         my->_undo_history_start = 0;
+         throw;
+      }
+      my->_trusted_replay = false;
+      my->_undo_history_start = 0;
+
+      replay_log.close();
+      fc::remove( replay_log_file );
+      ilog( "replayed ${n} blocks", ("n",get_head_block_num()) );
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("data_dir",data_dir) ) }
 
    account_id_type chain_database::get_signing_delegate_id( fc::time_point_sec sec )const
    { try {
@@ -874,17 +2032,27 @@ namespace bts { namespace blockchain {
 
    signed_block_header  chain_database::get_block_header( const block_id_type& block_id )const
    { try {
-      return get_block( block_id );
+      return my->_block_header_db.fetch( block_id );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
    signed_block_header  chain_database::get_block_header( uint32_t block_num )const
    { try {
-      return get_block( block_num );
+      return get_block_header( get_block_id( block_num ) );
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
+
+   oblock_header_record chain_database::get_block_header_record( const block_id_type& block_id )const
+   { try {
+      return my->_block_header_db.fetch_optional( block_id );
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
+
+   block_id_type        chain_database::get_block_id( uint32_t block_num )const
+   { try {
+      return my->_block_num_to_id_db.fetch( block_num );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
 
    full_block           chain_database::get_block( const block_id_type& block_id )const
    { try {
-      return my->_block_id_to_block_db.fetch(block_id);
+      return my->read_block( my->_block_location_db.fetch( block_id ) );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("block_id",block_id) ) }
 
    full_block           chain_database::get_block( uint32_t block_num )const
@@ -909,6 +2077,9 @@ namespace bts { namespace blockchain {
     */
    void chain_database::push_block( const full_block& block_data )
    { try {
+      // this may yield to other tasks so it must happen before the head block is read
+      auto signers         = my->recover_signers( block_data );
+
       auto block_id        = block_data.id();
       auto current_head_id = my->_head_block_id;
 
@@ -918,7 +2089,7 @@ namespace bts { namespace blockchain {
       if( block_data.previous == current_head_id )
       {
          // attempt to extend chain
-         return my->extend_chain( block_data );
+         return my->extend_chain( block_id, block_data, signers );
       }
       else if( fork.can_link() && block_data.block_num > my->_head_block_header.block_num )
       {
@@ -927,8 +2098,8 @@ namespace bts { namespace blockchain {
          }
          catch ( const fc::exception& e )
          {
-            wlog( "attempt to switch to fork failed: ${e}, reverting", ("e",e.to_detail_string() ) );
-            my->switch_to_fork( current_head_id );
+            // the fork is applied in one batch, a failed switch leaves the current chain as it was
+            wlog( "attempt to switch to fork failed: ${e}", ("e",e.to_detail_string() ) );
          }
       }
    } FC_RETHROW_EXCEPTIONS( warn, "", ("block",block_data) ) }
@@ -956,31 +2127,41 @@ namespace bts { namespace blockchain {
 
    oasset_record        chain_database::get_asset_record( asset_id_type id )const
    {
-      auto itr = my->_asset_db.find( id );
-      if( itr.valid() )
-      {
-         return itr.value(); 
-      }
-      return oasset_record();
+      auto cached = my->_asset_cache.find( id.value );
+      if( cached ) return *cached;
+
+      auto record = my->_asset_db.fetch_optional( id );
+      my->_asset_cache.store( id.value, record );
+      return record;
    }
    oaccount_record      chain_database::get_account_record( const address& owner )const
    { try {
-      auto itr = my->_address_to_account_db.find( owner );
-      if( itr.valid() )
+      auto account_id = my->_address_to_account_db.fetch_optional( owner );
+      if( account_id.valid() )
       {
-         return get_account_record( itr.value() );
+         return get_account_record( *account_id );
       }
       return oaccount_record();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("owner",owner) ) }
 
    obalance_record      chain_database::get_balance_record( const balance_id_type& balance_id )const
    {
-      return my->_balance_db.fetch_optional( balance_id );
+      auto cached = my->_balance_cache.find( balance_id );
+      if( cached ) return *cached;
+
+      auto record = my->_balance_db.fetch_optional( balance_id );
+      my->_balance_cache.store( balance_id, record );
+      return record;
    }
 
    oaccount_record         chain_database::get_account_record( account_id_type account_id )const
    {
-      return my->_account_db.fetch_optional( account_id );
+      auto cached = my->_account_cache.find( account_id.value );
+      if( cached ) return *cached;
+
+      auto record = my->_account_db.fetch_optional( account_id );
+      my->_account_cache.store( account_id.value, record );
+      return record;
    }
 
    asset_id_type        chain_database::get_asset_id( const string& symbol )const
@@ -997,10 +2178,10 @@ namespace bts { namespace blockchain {
    
    oasset_record        chain_database::get_asset_record( const string& symbol )const
    { try {
-       auto symbol_id_itr = my->_symbol_index_db.find( symbol );
-       if( symbol_id_itr.valid() )
+       auto symbol_id = my->_symbol_index_db.fetch_optional( symbol );
+       if( symbol_id.valid() )
        {
-          return get_asset_record( symbol_id_itr.value() );
+          return get_asset_record( *symbol_id );
        }
        else
           wlog( "    unable to find '${symbol}'", ("symbol",symbol) );
@@ -1009,9 +2190,9 @@ namespace bts { namespace blockchain {
 
    oaccount_record         chain_database::get_account_record( const string& name )const
    { try {
-       auto account_id_itr = my->_account_index_db.find( name );
-       if( account_id_itr.valid() )
-          return get_account_record( account_id_itr.value() );
+       auto account_id = my->_account_index_db.fetch_optional( name );
+       if( account_id.valid() )
+          return get_account_record( *account_id );
        return oaccount_record();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("name",name) ) }
 
@@ -1022,24 +2203,33 @@ namespace bts { namespace blockchain {
        {
           my->_asset_db.remove( r.id );
           my->_symbol_index_db.remove( r.symbol );
+          my->_asset_cache.store( r.id.value, oasset_record() );
        }
        else
        {
           my->_asset_db.store( r.id, r );
           my->_symbol_index_db.store( r.symbol, r.id );
+          my->_asset_cache.store( r.id.value, r );
        }
    } FC_RETHROW_EXCEPTIONS( warn, "", ("record", r) ) }
 
 
    void chain_database::store_balance_record( const balance_record& r )
    { try {
+       FC_ASSERT( r.balance >= 0, "balance can not be negative" );
+       auto old_rec = get_balance_record( r.id() );
+       if( old_rec.valid() ) my->add_to_totals( *old_rec, -1 );
+
        if( r.is_null() )
        {
           my->_balance_db.remove( r.id() );
+          my->_balance_cache.store( r.id(), obalance_record() );
        }
        else
        {
           my->_balance_db.store( r.id(), r );
+          my->_balance_cache.store( r.id(), r );
+          my->add_to_totals( r, 1 );
        }
    } FC_RETHROW_EXCEPTIONS( warn, "", ("record", r) ) }
 
@@ -1047,75 +2237,32 @@ namespace bts { namespace blockchain {
    void chain_database::store_account_record( const account_record& record_to_store )
    { try {
        oaccount_record old_rec = get_account_record( record_to_store.id );
+       if( old_rec.valid() ) my->add_to_totals( *old_rec, -1 );
 
        if( record_to_store.is_null() && old_rec)
        {
           my->_account_db.remove( record_to_store.id );
           my->_account_index_db.remove( record_to_store.name );
+          my->_account_cache.store( record_to_store.id.value, oaccount_record() );
 
           for( auto item : old_rec->active_key_history )
              my->_address_to_account_db.remove( address(item.second) );
 
-          if( old_rec->is_delegate() )
-          {
-              auto itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-              my->_delegate_vote_index_db.remove( vote_del( old_rec->net_votes(), 
-                                                            record_to_store.id ) );
-              itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-          }
+          my->update_delegate_votes( old_rec, record_to_store );
        }
        else if( !record_to_store.is_null() )
        {
           my->_account_db.store( record_to_store.id, record_to_store );
           my->_account_index_db.store( record_to_store.name, record_to_store.id );
+          my->_account_cache.store( record_to_store.id.value, record_to_store );
+          my->add_to_totals( record_to_store, 1 );
 
           for( auto item : record_to_store.active_key_history )
           { // re-index all keys for this record
              my->_address_to_account_db.store( address(item.second), record_to_store.id );
           }
 
-
-          if( old_rec.valid() && old_rec->is_delegate() )
-          {
-              auto itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-              my->_delegate_vote_index_db.remove( vote_del( old_rec->net_votes(), 
-                                                            record_to_store.id ) );
-              itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-          }
-
-
-          if( record_to_store.is_delegate() )
-          {
-              auto itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-              my->_delegate_vote_index_db.store( vote_del( record_to_store.net_votes(),
-                                                           record_to_store.id ), 
-                                                0/*dummy value*/ );
-              itr = my->_delegate_vote_index_db.begin();
-              while( itr.valid() )
-              {
-                  ++itr;
-              }
-          }
+          my->update_delegate_votes( old_rec, record_to_store );
        }
    } FC_RETHROW_EXCEPTIONS( warn, "", ("record", record_to_store) ) }
 
@@ -1134,7 +2281,7 @@ namespace bts { namespace blockchain {
       ilog( "block_number: ${trx_loc}", ("trx_loc",trx_loc) );
       if( !trx_loc ) return osigned_transaction();
       auto block_id = my->_block_num_to_id_db.fetch( trx_loc->block_num );
-      auto block_data = my->_block_id_to_block_db.fetch( block_id );
+      auto block_data = get_block( block_id );
       FC_ASSERT( block_data.user_transactions.size() > trx_loc->trx_num );
 
       return block_data.user_transactions[ trx_loc->trx_num ];
@@ -1172,32 +2319,47 @@ namespace bts { namespace blockchain {
    /** this should throw if the trx is invalid */
    transaction_evaluation_state_ptr chain_database::store_pending_transaction( const signed_transaction& trx )
    { try {
-      auto trx_id = trx.id();
-      auto current_itr = my->_pending_transaction_db.find( trx_id );
-      if( current_itr.valid() ) return nullptr;
-
-      auto eval_state = evaluate_transaction( trx );
-      share_type fees = eval_state->get_fees();
-      my->_pending_fee_index[ fee_index( fees, trx_id ) ] = eval_state;
-      my->_pending_transaction_db.store( trx_id, trx );
-
-      return eval_state;
+      if( my->_pending_pool.contains( trx.id() ) ) return nullptr;
+      return my->add_pending_transaction( trx, trx.get_signed_addresses( my->_chain_id ) );
    } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx) ) }
 
-   /** returns all transactions that are valid (indepdnent of eachother) sorted by fee */
+   /** returns all transactions that are valid (indepdnent of eachother) sorted by fee per byte */
    std::vector<transaction_evaluation_state_ptr> chain_database::get_pending_transactions()const
    {
-      std::vector<transaction_evaluation_state_ptr> trxs;
-      for( auto item : my->_pending_fee_index )
-      {
-          trxs.push_back( item.second );
-      }
-      return trxs;
+      return my->_pending_pool.get_transactions();
+   }
+   void chain_database::update_block_template()
+   { try {
+      if( my->block_template_is_current() ) return;
+
+      detail::block_template tmpl;
+      tmpl.head_id = my->_head_block_id;
+      tmpl.state   = std::make_shared<pending_chain_state>(shared_from_this());
+      my->pack_transactions( tmpl );
+      my->_block_template = std::move( tmpl );
+   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+   void chain_database::set_pending_queue_size( size_t max_size )
+   {
+      auto evicted = my->_pending_pool.set_max_size( max_size );
+      for( const auto& id : evicted )
+         my->_pending_transaction_db.remove( id );
+      if( !evicted.empty() ) my->_block_template.stale = true;
    }
+
+   void chain_database::set_fee_price( const price& base_per_asset )
+   { try {
+      FC_ASSERT( base_per_asset.base_asset_id == BASE_ASSET_ID || base_per_asset.quote_asset_id == BASE_ASSET_ID );
+      FC_ASSERT( base_per_asset.base_asset_id != base_per_asset.quote_asset_id );
+      auto asset_id = base_per_asset.base_asset_id == BASE_ASSET_ID ? base_per_asset.quote_asset_id : base_per_asset.base_asset_id;
+      my->_fee_prices[asset_id] = base_per_asset;
+      my->_pending_pool.reprioritize();
+      my->_block_template.stale = true;
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("base_per_asset",base_per_asset) ) }
+
    bool chain_database::is_known_transaction( const transaction_id_type& trx_id )
    {
-      auto pending_itr = my->_pending_transaction_db.find( trx_id );
-      if( pending_itr.valid() ) return true;
+      if( my->_pending_pool.contains( trx_id ) ) return true;
       return !!get_transaction_location( trx_id );
    }
 
@@ -1205,36 +2367,10 @@ namespace bts { namespace blockchain {
    {
       full_block next_block;
 
-      pending_chain_state_ptr pending_state = std::make_shared<pending_chain_state>(shared_from_this());
-      auto pending_trx = get_pending_transactions();
-
-      size_t block_size = 0;
-      share_type total_fees = 0;
-      for( auto item : pending_trx )
-      {
-         auto trx_size = item->trx.data_size();
-         if( block_size + trx_size > BTS_BLOCKCHAIN_MAX_BLOCK_SIZE )
-            break;
-         block_size += trx_size;
-         // make modifications to tempoary state...
-         pending_chain_state_ptr pending_trx_state = std::make_shared<pending_chain_state>(pending_state);
-         transaction_evaluation_state_ptr trx_eval_state = 
-             std::make_shared<transaction_evaluation_state>(pending_trx_state,my->_chain_id);
-
-         try {
-            trx_eval_state->evaluate( item->trx );
-            // TODO: what about fees in other currencies?
-            total_fees += trx_eval_state->get_fees(0);
-            // apply temporary state to block state
-            pending_trx_state->apply_changes();
-            next_block.user_transactions.push_back( item->trx );
-         }
-         catch ( const fc::exception& e )
-         {
-            wlog( "pending transaction was found to be invalid in context of block\n ${trx} \n${e}",
-                  ("trx",fc::json::to_pretty_string(item->trx) )("e",e.to_detail_string()) );
-         }
-      }
+      update_block_template();
+      next_block.user_transactions = my->_block_template.trxs;
+      size_t     block_size = my->_block_template.size;
+      share_type total_fees = my->_block_template.fees;
 
       next_block.block_num          = my->_head_block_header.block_num + 1;
       next_block.previous           = my->_head_block_id;
@@ -1364,17 +2500,19 @@ namespace bts { namespace blockchain {
       base_asset.collected_fees = 0;
       self->store_asset_record( base_asset );
 
-      block_fork_data gen_fork;
-      gen_fork.is_valid = true;
-      gen_fork.is_included = true;
-      gen_fork.is_linked = true;
-      _fork_db.store( block_id_type(), gen_fork );
+      modify_fork_node( block_id_type(), []( fork_node& gen_fork )
+      {
+         gen_fork.data.is_valid = true;
+         gen_fork.data.is_included = true;
+         gen_fork.data.is_linked = true;
+      });
 
       self->set_property( chain_property_enum::active_delegate_list_id, fc::variant(self->next_round_active_delegates()) );
       self->set_property( chain_property_enum::last_asset_id, 0 );
       self->set_property( chain_property_enum::last_proposal_id, 0 );
       self->set_property( chain_property_enum::last_account_id, uint64_t(config.names.size()) );
       self->set_property( chain_property_enum::last_random_seed_id, fc::variant(secret_hash_type()) );
+      self->set_property( chain_property_enum::chain_totals_id, fc::variant(_totals) );
 
       self->sanity_check();
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
@@ -1385,14 +2523,13 @@ namespace bts { namespace blockchain {
    }
    bool chain_database::is_known_block( const block_id_type& block_id )const
    {
-      auto itr = my->_block_id_to_block_db.find( block_id );
-      return itr.valid();
+      return my->_block_header_db.fetch_optional( block_id ).valid();
    }
    uint32_t chain_database::get_block_num( const block_id_type& block_id )const
    { try {
       if( block_id == block_id_type() )
          return 0;
-      return my->_block_id_to_block_db.fetch( block_id ).block_num;
+      return my->_block_header_db.fetch( block_id ).block_num;
    } FC_RETHROW_EXCEPTIONS( warn, "Unable to find block ${block_id}", ("block_id", block_id) ) }
 
     uint32_t         chain_database::get_head_block_num()const
@@ -1434,35 +2571,59 @@ namespace bts { namespace blockchain {
        std::ofstream out( filename.generic_string().c_str() );
        out << "digraph G { \n"; 
        out << "rankdir=RL;\n";
-          auto fork_itr = my->_fork_db.begin();
-          while( fork_itr.valid() )
+          for( const auto& item : my->_fork_tree )
           {
-             auto fork_data = fork_itr.value();
-             ilog( "${id} => ${r}", ("id",fork_itr.key())("r",fork_data) );
+             const auto& fork_data = item.second.data;
+             ilog( "${id} => ${r}", ("id",item.first)("r",fork_data) );
              for( auto next : fork_data.next_blocks )
              {
-                out << '"' << string ( fork_itr.key() ).substr(0,5) <<"\" "
+                out << '"' << string ( item.first ).substr(0,5) <<"\" "
                     << "[color=" << (fork_data.is_included ? "green" : "lightblue") << ",style=filled,"
                     << " shape=" << (fork_data.is_linked  ? "ellipse" : "box" ) << "];\n";
-                out << '"' << string ( next ).substr(0,5) <<"\" -> \"" << string( fork_itr.key() ).substr(0,5) << "\";\n";
+                out << '"' << string ( next ).substr(0,5) <<"\" -> \"" << string( item.first ).substr(0,5) << "\";\n";
             }
-             ++fork_itr;
           }
        out << "}"; 
     }
 
    fc::variant chain_database::get_property( chain_property_enum property_id )const
    { try {
-      return my->_property_db.fetch( property_id );
+      auto cached = my->_property_cache.find( property_id );
+      if( cached && cached->valid() ) return **cached;
+
+      auto value = my->_property_db.fetch( property_id );
+      my->_property_cache.store( property_id, value );
+      return value;
    } FC_RETHROW_EXCEPTIONS( warn, "", ("property_id",property_id) ) }
 
    void  chain_database::set_property( chain_property_enum property_id, 
                                                      const fc::variant& property_value )
    {
       if( property_value.is_null() )
+      {
          my->_property_db.remove( property_id );
+         my->_property_cache.remove( property_id );
+      }
       else
+      {
          my->_property_db.store( property_id, property_value );
+         my->_property_cache.store( property_id, property_value );
+      }
+   }
+
+   void chain_database::set_record_cache_size( size_t max_records )
+   {
+      my->set_record_cache_size( max_records );
+   }
+
+   fc::variant_object chain_database::get_record_cache_stats()const
+   {
+      fc::mutable_variant_object stats;
+      stats["accounts"]   = my->_account_cache.get_stats();
+      stats["assets"]     = my->_asset_cache.get_stats();
+      stats["balances"]   = my->_balance_cache.get_stats();
+      stats["properties"] = my->_property_cache.get_stats();
+      return stats;
    }
    void chain_database::store_proposal_record( const proposal_record& r )
    {
@@ -1589,30 +2750,8 @@ namespace bts { namespace blockchain {
 
    void chain_database::sanity_check()const
    { try {
-      asset total;
-      auto itr = my->_balance_db.begin();
-      while( itr.valid() )
-      {
-         auto ind = itr.value().get_balance();
-         if( ind.asset_id == 0 )
-         {
-            FC_ASSERT( ind.amount >= 0, "", ("record",itr.value()) );
-            total += ind;
-         }
-         ++itr;
-      }
-      int64_t total_votes = 0;
-      auto aitr = my->_account_db.begin();
-      while( aitr.valid() )
-      {
-         auto v = aitr.value();
-         if( v.is_delegate() )
-         {
-            total += asset(v.delegate_info->pay_balance);
-            total_votes += v.delegate_info->votes_for + v.delegate_info->votes_against;
-         }
-         ++aitr;
-      }
+      asset total( my->_totals.base_balances + my->_totals.delegate_pay );
+      int64_t total_votes = my->_totals.votes;
 
       FC_ASSERT( total_votes == total.amount, "", 
                  ("total_votes",total_votes)
@@ -1625,4 +2764,25 @@ namespace bts { namespace blockchain {
       //std::cerr << "Total Balances: " << to_pretty_asset( total ) << "\n";
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   fc::variant_object chain_database::audit_state()const
+   { try {
+      auto totals = my->scan_totals();
+      FC_ASSERT( totals == my->_totals, "running totals do not match the chain state",
+                 ("scanned",totals)("running",my->_totals) );
+      sanity_check();
+      return fc::variant( totals ).get_object();
+   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+   void chain_database::set_audit_interval( uint32_t interval )
+   {
+      my->_audit_interval = interval;
+   }
+
+   void chain_database::set_undo_history( uint32_t blocks )
+   { try {
+      FC_ASSERT( blocks > 0 );
+      my->_undo_history = blocks;
+      if( my->_block_log.is_open() ) my->prune_undo_history();
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("blocks",blocks) ) }
+
 } } // namespace bts::blockchain
@@ -5,6 +5,7 @@
 #include <bts/blockchain/block.hpp>
 
 #include <fc/filesystem.hpp>
+#include <fc/variant_object.hpp>
 
 #include <functional>
 
@@ -13,6 +14,20 @@ namespace bts { namespace blockchain {
 
    namespace detail { class chain_database_impl; }
 
+   /** the header of a stored block with the values that otherwise require loading the whole block */
+   struct block_header_record : public signed_block_header
+   {
+      block_header_record():block_size(0),transaction_count(0){}
+      block_header_record( const full_block& block_data, const block_id_type& block_id )
+      :signed_block_header(block_data),id(block_id),
+       block_size(block_data.block_size()),transaction_count(block_data.user_transactions.size()){}
+
+      block_id_type                                 id;
+      uint32_t                                      block_size;
+      uint32_t                                      transaction_count;
+   };
+   typedef fc::optional<block_header_record> oblock_header_record;
+
    struct block_summary
    {
       full_block                                    block_data;
@@ -44,18 +59,63 @@ namespace bts { namespace blockchain {
          void open( const fc::path& data_dir, fc::path genesis_file );
          void close();
 
+         /**
+          *  Rebuilds the chain state in data_dir from the blocks in its block log without
+          *  using the network and leaves the database open.  Blocks that were part of the
+          *  chain before the replay are not verified again and undo states are only saved for
+          *  the blocks within the undo history of the new head block.
+          *
+          *  @param progress called after every block with the block number and the number of blocks
+          */
+         void replay( const fc::path& data_dir, fc::path genesis_file,
+                      function<void( uint32_t, uint32_t )> progress = function<void( uint32_t, uint32_t )>() );
+
          void set_observer( chain_observer* observer );
+
+         /** bounds the number of decoded records of each type kept in memory, 0 disables caching */
+         void set_record_cache_size( size_t max_records );
+         /** hit / miss counters and sizes of the record caches */
+         fc::variant_object get_record_cache_stats()const;
+
+         /** checks the running supply and vote totals, this is cheap and done after every block */
          void sanity_check()const;
+         /**
+          *  Recomputes the totals from every balance and account record, verifies that they match
+          *  the running totals and returns them.
+          */
+         fc::variant_object audit_state()const;
+         /** run audit_state() every interval blocks, 0 disables the periodic audit */
+         void set_audit_interval( uint32_t interval );
+         /**
+          *  Blocks more than this many blocks below the head block are irreversible, their undo
+          *  data is discarded and forks branching off before them can not be switched to.
+          */
+         void set_undo_history( uint32_t blocks );
 
          transaction_evaluation_state_ptr         store_pending_transaction( const signed_transaction& trx );
          vector<transaction_evaluation_state_ptr> get_pending_transactions()const;
          bool                                     is_known_transaction( const transaction_id_type& trx_id );
+         /** the maximum total size in bytes of the pending transactions */
+         void                                     set_pending_queue_size( size_t max_size );
+         /**
+          *  Sets the rate used to rank pending transactions paying fees in an asset other than the base
+          *  asset when producing blocks, fees in assets without a rate do not add to their priority.
+          *
+          *  @param base_per_asset a price between the base asset and the fee asset
+          */
+         void                                     set_fee_price( const price& base_per_asset );
          void                                     export_fork_graph( const fc::path& filename )const;
 
          /** Produce a block for the given timeslot, the block is not signed because that is the
           *  role of the wallet.
           */
          full_block                    generate_block( time_point_sec timestamp );
+         /**
+          *  Packs the transactions of the next block if the head block changed or a pending transaction
+          *  that did not fit outranks one in it.  Once packed, new pending transactions are added as
+          *  they arrive so that generate_block only has to fill in the header.
+          */
+         void                          update_block_template();
 
          /**
           *  The chain ID is the hash of the initial_config loaded when the
@@ -69,8 +129,11 @@ namespace bts { namespace blockchain {
          public_key_type               get_signing_delegate_key( time_point_sec )const;
          account_id_type               get_signing_delegate_id( time_point_sec )const;
          uint32_t                      get_block_num( const block_id_type& )const;
+         /** the id of the block at block_num in the current chain, without loading the block */
+         block_id_type                 get_block_id( uint32_t block_num )const;
          signed_block_header           get_block_header( const block_id_type& )const;
          signed_block_header           get_block_header( uint32_t block_num )const;
+         oblock_header_record          get_block_header_record( const block_id_type& )const;
          full_block                    get_block( const block_id_type& )const;
          full_block                    get_block( uint32_t block_num )const;
          signed_block_header           get_head_block()const;
@@ -161,3 +224,6 @@ namespace bts { namespace blockchain {
 
 } } // bts::blockchain
 
+FC_REFLECT_DERIVED( bts::blockchain::block_header_record, (bts::blockchain::signed_block_header),
+                    (id)(block_size)(transaction_count) )
+
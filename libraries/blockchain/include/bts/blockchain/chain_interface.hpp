@@ -18,7 +18,9 @@ namespace bts { namespace blockchain {
       last_proposal_id         = 2,
       last_random_seed_id      = 3,
       active_delegate_list_id  = 4,
-      chain_id                 = 5 // hash of initial state
+      chain_id                 = 5, // hash of initial state
+      chain_totals_id          = 6, // running supply and vote totals checked by sanity_check
+      block_log_end_id         = 7  // end of the last block indexed from the block log
    };
    typedef uint32_t chain_property_type;
 
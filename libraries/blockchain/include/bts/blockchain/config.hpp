@@ -107,3 +107,27 @@
 
 #define BTS_BLOCKCHAIN_MAX_NAME_SIZE                (63)
 #define BTS_BLOCKCHAIN_MAX_NAME_DATA_SIZE           (1024*4)
+
+/**
+ *  The number of decoded account, asset, balance and property records that the chain
+ *  database keeps in memory (per record type) for lookups during validation and RPC.
+ */
+#define BTS_BLOCKCHAIN_DEFAULT_RECORD_CACHE_SIZE    (100000)
+
+/**
+ *  Every this many blocks the chain database verifies its running totals against a
+ *  full scan of the balances and accounts, 0 only audits on request.
+ */
+#define BTS_BLOCKCHAIN_DEFAULT_AUDIT_INTERVAL       (0)
+
+/**
+ *  Undo data is kept for this many blocks below the head block, which limits how deep a
+ *  fork can be switched to.  Older blocks are considered irreversible.
+ */
+#define BTS_BLOCKCHAIN_DEFAULT_UNDO_HISTORY         (1000)
+
+/**
+ *  The maximum total size of the transactions waiting to be included in a block, when it is
+ *  reached the transactions paying the lowest fee rate are dropped.
+ */
+#define BTS_BLOCKCHAIN_MAX_PENDING_QUEUE_SIZE       (BTS_BLOCKCHAIN_MAX_BLOCK_SIZE * 10)
@@ -63,6 +63,17 @@ namespace bts { namespace blockchain {
          /** apply changes from this pending state to the previous state */
          virtual void                       apply_changes()const;
 
+         /**
+          *  Moves the changes into the previous state and leaves this state empty, so that one
+          *  layer can be reused for a sequence of changes on top of the same previous state.
+          *  When the previous state is a pending_chain_state the records are merged directly
+          *  into its maps, which costs O(changes) and no virtual store calls.
+          */
+         void                               squash();
+
+         /** discards every change, the memory allocated by the maps is kept for reuse */
+         void                               clear();
+
          /** populate undo state with everything that would be necessary to revert this
           * pending state to the previous state.
           */
@@ -135,6 +135,8 @@ namespace bts { namespace blockchain {
       transaction_id_type                     id()const;
       size_t                                  data_size()const;
       void                                    sign( const fc::ecc::private_key& signer, const digest_type& chain_id );
+      /** recovers the key of every signature and returns all of the address forms it may be referenced by */
+      std::unordered_set<address>             get_signed_addresses( const digest_type& chain_id )const;
 
       std::vector<fc::ecc::compact_signature> signatures;
    };
@@ -157,7 +159,7 @@ namespace bts { namespace blockchain {
    {
       public:
          transaction_evaluation_state( const chain_interface_ptr& blockchain, digest_type chain_id );
-         transaction_evaluation_state(){};
+         transaction_evaluation_state():trx_size(0),skip_signature_check(false){};
 
          virtual ~transaction_evaluation_state();
          virtual share_type get_fees( asset_id_type id = 0)const;
@@ -165,6 +167,8 @@ namespace bts { namespace blockchain {
          virtual void reset();
          
          virtual void evaluate( const signed_transaction& trx );
+         /** evaluates trx with signed_addresses already recovered by signed_transaction::get_signed_addresses */
+         virtual void evaluate( const signed_transaction& trx, const std::unordered_set<address>& signed_addresses );
          virtual void evaluate_operation( const operation& op );
 
          /** perform any final operations based upon the current state of 
@@ -223,6 +227,11 @@ namespace bts { namespace blockchain {
          void sub_vote( name_id_type delegate_id, share_type amount );
          
          signed_transaction                               trx;
+         /** trx.id() and trx.data_size(), computed once by evaluate() */
+         transaction_id_type                              trx_id;
+         size_t                                           trx_size;
+         /** treat every required signature as present, used to replay blocks that were already validated */
+         bool                                             skip_signature_check;
          std::unordered_set<address>                      signed_keys;
          std::unordered_set<address>                      required_keys;
          
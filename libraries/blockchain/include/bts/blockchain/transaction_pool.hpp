@@ -0,0 +1,150 @@
+#pragma once
+#include <bts/blockchain/pending_chain_state.hpp>
+#include <bts/blockchain/transaction.hpp>
+#include <bts/blockchain/config.hpp>
+
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace bts { namespace blockchain {
+
+   /** orders pending transactions by fee per 1000 bytes or by priority, highest first */
+   struct fee_index
+   {
+      fee_index( share_type fees = 0, transaction_id_type trx = transaction_id_type() )
+      :_fees(fees),_trx(trx){}
+      share_type          _fees;
+      transaction_id_type _trx;
+      friend bool operator == ( const fee_index& a, const fee_index& b )
+      {
+         return a._fees == b._fees && a._trx == b._trx;
+      }
+      friend bool operator < ( const fee_index& a, const fee_index& b )
+      {
+         if( a._fees == b._fees ) return a._trx < b._trx; /* Lowest id wins in ties */
+         return a._fees > b._fees; /* Reverse so that highest fee is placed first in sorted maps */
+      }
+   };
+
+   /**
+    *  @brief the validated transactions waiting to be included in a block
+    *
+    *  Transactions are hashed by id and ordered by their priority, by default the base asset
+    *  fee they pay per 1000 bytes, which is the unit of the chain fee rate.  The owner of the
+    *  pool can rank them like it packs blocks instead.  Every transaction is also indexed by the
+    *  balances, accounts and assets its evaluation changed so that after a block only the
+    *  transactions touching records the block changed have to be validated again, and so that
+    *  a transaction can be evaluated after the pending transactions that fund it or spend
+    *  the same balances.
+    *
+    *  The pool does not evaluate anything itself, chain_database decides what is valid and
+    *  tells the pool what to add and remove.  The total size of the pooled transactions is
+    *  bounded, when it is exceeded the transactions with the lowest priority are evicted along
+    *  with the transactions withdrawing from the balances they changed.
+    */
+   class transaction_pool
+   {
+      public:
+         /** ranks a transaction for inclusion in a block, higher first */
+         typedef std::function<share_type(const transaction_evaluation_state&)> priority_function;
+
+         transaction_pool( size_t max_size = BTS_BLOCKCHAIN_MAX_PENDING_QUEUE_SIZE );
+
+         /** ranks every transaction again with priority, call reprioritize() when what it depends on changes */
+         void                                      set_priority_function( priority_function priority );
+         void                                      reprioritize();
+
+         /** @return the ids of transactions that were evicted to fit the new bound, with their dependents */
+         std::vector<transaction_id_type>          set_max_size( size_t max_size );
+
+         bool                                      contains( const transaction_id_type& id )const;
+         transaction_evaluation_state_ptr          find( const transaction_id_type& id )const;
+
+         /**
+          *  @param changes the state changes trx_state made when it was evaluated
+          *  @return the ids of transactions that were evicted to stay within the size bound, a
+          *          transaction is evicted together with the transactions that depend on it
+          *  @throw if the pool is full of transactions with a higher priority
+          */
+         std::vector<transaction_id_type>          insert( const transaction_evaluation_state_ptr& trx_state,
+                                                           const pending_chain_state& changes );
+         void                                      remove( const transaction_id_type& id );
+         void                                      clear();
+
+         /**
+          *  The pending transactions that changed a balance trx withdraws from, and recursively
+          *  the ones those depend on, in the order they were added to the pool.  Evaluating them
+          *  in this order before trx checks that trx is valid together with the transactions it
+          *  spends the outputs of and the ones spending the same balances.
+          */
+         std::vector<transaction_evaluation_state_ptr> get_dependencies( const signed_transaction& trx )const;
+
+         /** the pending transactions that withdraw from a balance the transaction id changed */
+         std::vector<transaction_evaluation_state_ptr> get_dependents( const transaction_id_type& id )const;
+
+         /**
+          *  Pending transactions whose validity may have changed because of changes, this
+          *  includes every transaction touching markets or proposals when changes does.
+          */
+         std::vector<transaction_evaluation_state_ptr> get_affected( const pending_chain_state& changes )const;
+
+         /** pending transactions that pay a base asset fee per 1000 bytes that is lower than fee_rate */
+         std::vector<transaction_evaluation_state_ptr> get_below_fee_rate( share_type fee_rate )const;
+
+         std::vector<transaction_id_type>          get_expired( const fc::time_point_sec& now )const;
+
+         /** every pending transaction, highest priority first */
+         std::vector<transaction_evaluation_state_ptr> get_transactions()const;
+         /** the priority of a pending transaction when it was last ranked */
+         share_type                                get_priority( const transaction_id_type& id )const;
+
+         size_t                                    size()const      { return _transactions.size(); }
+         /** the sum of the packed sizes of the pending transactions */
+         size_t                                    data_size()const { return _data_size; }
+
+      private:
+         struct entry
+         {
+            entry():sequence(0),market_or_proposal(false){}
+
+            transaction_evaluation_state_ptr     trx_state;
+            fee_index                            fee_rate;
+            fee_index                            priority;
+            uint64_t                             sequence;
+            fc::optional<fc::time_point_sec>     expiration;
+            std::vector<balance_id_type>         withdrawals;
+            std::vector<balance_id_type>         balances;
+            std::vector<account_id_type>         accounts;
+            std::vector<asset_id_type>           assets;
+            bool                                 market_or_proposal;
+         };
+
+         typedef std::unordered_set<transaction_id_type> transaction_ids;
+
+         static share_type                         calculate_fee_rate( const transaction_evaluation_state& trx_state );
+         static bool                               changes_market_or_proposal( const pending_chain_state& changes );
+         static std::vector<balance_id_type>       get_withdrawals( const signed_transaction& trx );
+
+         std::vector<transaction_id_type>          make_room( size_t required_space, share_type priority );
+         void                                      evict( const transaction_id_type& id, std::vector<transaction_id_type>& evicted );
+         std::vector<transaction_evaluation_state_ptr> sorted( const transaction_ids& ids )const;
+
+         size_t                                                       _max_size;
+         size_t                                                       _data_size;
+         uint64_t                                                     _next_sequence;
+         priority_function                                            _priority;
+         std::unordered_map<transaction_id_type, entry>               _transactions;
+         std::set<fee_index>                                          _by_fee_rate;
+         std::set<fee_index>                                          _by_priority;
+         std::set< std::pair<fc::time_point_sec,transaction_id_type> > _by_expiration;
+         std::unordered_map<balance_id_type, transaction_ids>         _by_balance;
+         std::unordered_map<account_id_type, transaction_ids>         _by_account;
+         std::unordered_map<asset_id_type, transaction_ids>           _by_asset;
+         transaction_ids                                              _market_or_proposal;
+   };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::fee_index, (_fees)(_trx) )
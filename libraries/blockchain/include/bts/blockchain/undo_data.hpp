@@ -0,0 +1,35 @@
+#pragma once
+#include <bts/blockchain/pending_chain_state.hpp>
+
+namespace bts { namespace blockchain {
+
+   /**
+    *  @brief the changes needed to revert the state produced by a block to the state before it
+    *
+    *  Every record the block changed is stored as the bytes of its packed value before the
+    *  block that differ from its packed value after the block, so a record that had one field
+    *  updated costs a few bytes instead of a full copy.  Decoding requires the state the block
+    *  produced, undo data can only be applied while its block is the head block.
+    */
+   struct undo_data
+   {
+      undo_data():block_num(0){}
+
+      /**
+       *  @param undo_state the values of the changed records before the block, as produced
+       *                    by pending_chain_state::get_undo_state()
+       *  @param current    the state after the changes of the block were applied
+       */
+      static undo_data        encode( uint32_t block_num, const pending_chain_state& undo_state,
+                                      const chain_interface& current );
+
+      /** @param current the state that was passed to encode() */
+      pending_chain_state_ptr decode( const chain_interface& current )const;
+
+      uint32_t                block_num;
+      std::vector<char>       deltas;
+   };
+
+} } // bts::blockchain
+
+FC_REFLECT( bts::blockchain::undo_data, (block_num)(deltas) )
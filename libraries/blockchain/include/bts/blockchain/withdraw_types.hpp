@@ -106,6 +106,9 @@ namespace bts { namespace blockchain {
       :owner(owner_arg){}
 
       omemo_status decrypt_memo_data( const fc::ecc::private_key& receiver_key )const;
+      /** @param receiver_public_key the public key of receiver_key, saves deriving it on every trial */
+      omemo_status decrypt_memo_data( const fc::ecc::private_key& receiver_key,
+                                      const fc::ecc::public_key& receiver_public_key )const;
       void         encrypt_memo_data( const fc::ecc::private_key& one_time_private_key, 
                                       const fc::ecc::public_key&  to_public_key,
                                       const fc::ecc::private_key& from_private_key,
@@ -121,6 +124,35 @@ namespace bts { namespace blockchain {
       address                 owner; 
    };
 
+   /**
+    *  @brief trial decrypts withdraw_by_account memos with a fixed set of receiver keys
+    *
+    *  The public key and address of every receiver key are derived once when the set is
+    *  built, so each trial only costs the shared secret and the derivation of the owner
+    *  key it implies, and the memo is only decrypted when that owner matches the deposit.
+    */
+   class memo_key_set
+   {
+      public:
+         memo_key_set(){}
+         memo_key_set( const std::vector<fc::ecc::private_key>& receiver_keys );
+
+         size_t                      size()const                    { return _keys.size(); }
+         const fc::ecc::private_key& get_key( uint32_t index )const     { return _keys[index].key; }
+         const address&              get_address( uint32_t index )const { return _keys[index].key_address; }
+
+         /** trial decrypts the memo of deposit with the key at index */
+         omemo_status decrypt_memo_data( const withdraw_by_account& deposit, uint32_t index )const;
+
+      private:
+         struct receiver_key
+         {
+            fc::ecc::private_key key;
+            fc::ecc::public_key  public_key;
+            address              key_address;
+         };
+         std::vector<receiver_key> _keys;
+   };
 
    struct withdraw_with_multi_sig
    {
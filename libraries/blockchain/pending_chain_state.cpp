@@ -2,7 +2,41 @@
 #include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
 
+#include <typeinfo>
+
 namespace bts { namespace blockchain {
+
+   namespace detail
+   {
+      template<typename Map>
+      void merge_changes( const Map& changes, Map& into )
+      {
+         for( const auto& item : changes )
+            into[item.first] = item.second;
+      }
+
+      template<typename Map>
+      void move_changes( Map& changes, Map& into )
+      {
+         if( into.empty() )
+         {
+            into.swap( changes );
+            return;
+         }
+         for( auto& item : changes )
+            into[item.first] = std::move( item.second );
+      }
+
+      /**
+       *  @return prev_state if it is exactly a pending_chain_state, in that case its store
+       *  methods only record the changes and they can be merged without calling them
+       */
+      pending_chain_state* as_pending_state( const chain_interface_ptr& prev_state )
+      {
+         if( !prev_state || typeid(*prev_state) != typeid(pending_chain_state) ) return nullptr;
+         return static_cast<pending_chain_state*>( prev_state.get() );
+      }
+   }
    pending_chain_state::pending_chain_state( chain_interface_ptr prev_state )
    :_prev_state( prev_state )
    {
@@ -41,20 +75,86 @@ namespace bts { namespace blockchain {
    void  pending_chain_state::apply_changes()const
    {
       if( !_prev_state ) return;
-      for( auto item   : properties )     _prev_state->set_property( (chain_property_enum)item.first, item.second );
-      for( auto record : assets )         _prev_state->store_asset_record( record.second );
-      for( auto record : accounts )       _prev_state->store_account_record( record.second );
-      for( auto record : balances )       _prev_state->store_balance_record( record.second );
-      for( auto record : proposals )      _prev_state->store_proposal_record( record.second );
-      for( auto record : proposal_votes ) _prev_state->store_proposal_vote( record.second );
-      for( auto record : bids )           _prev_state->store_bid_record( record.first, record.second );
-      for( auto record : asks )           _prev_state->store_ask_record( record.first, record.second );
-      for( auto record : shorts )         _prev_state->store_short_record( record.first, record.second );
-      for( auto record : collateral )     _prev_state->store_collateral_record( record.first, record.second );
-      for( auto record : unique_transactions ) 
+
+      auto prev_pending = detail::as_pending_state( _prev_state );
+      if( prev_pending )
+      {
+         detail::merge_changes( properties,          prev_pending->properties );
+         detail::merge_changes( assets,              prev_pending->assets );
+         detail::merge_changes( symbol_id_index,     prev_pending->symbol_id_index );
+         detail::merge_changes( accounts,            prev_pending->accounts );
+         detail::merge_changes( account_id_index,    prev_pending->account_id_index );
+         detail::merge_changes( key_to_account,      prev_pending->key_to_account );
+         detail::merge_changes( balances,            prev_pending->balances );
+         detail::merge_changes( proposals,           prev_pending->proposals );
+         detail::merge_changes( proposal_votes,      prev_pending->proposal_votes );
+         detail::merge_changes( bids,                prev_pending->bids );
+         detail::merge_changes( asks,                prev_pending->asks );
+         detail::merge_changes( shorts,              prev_pending->shorts );
+         detail::merge_changes( collateral,          prev_pending->collateral );
+         detail::merge_changes( unique_transactions, prev_pending->unique_transactions );
+         return;
+      }
+
+      for( const auto& item   : properties )     _prev_state->set_property( (chain_property_enum)item.first, item.second );
+      for( const auto& record : assets )         _prev_state->store_asset_record( record.second );
+      for( const auto& record : accounts )       _prev_state->store_account_record( record.second );
+      for( const auto& record : balances )       _prev_state->store_balance_record( record.second );
+      for( const auto& record : proposals )      _prev_state->store_proposal_record( record.second );
+      for( const auto& record : proposal_votes ) _prev_state->store_proposal_vote( record.second );
+      for( const auto& record : bids )           _prev_state->store_bid_record( record.first, record.second );
+      for( const auto& record : asks )           _prev_state->store_ask_record( record.first, record.second );
+      for( const auto& record : shorts )         _prev_state->store_short_record( record.first, record.second );
+      for( const auto& record : collateral )     _prev_state->store_collateral_record( record.first, record.second );
+      for( const auto& record : unique_transactions ) 
          _prev_state->store_transaction_location( record.first, record.second );
    }
 
+   void  pending_chain_state::squash()
+   {
+      auto prev_pending = detail::as_pending_state( _prev_state );
+      if( !prev_pending )
+      {
+         apply_changes();
+         clear();
+         return;
+      }
+
+      detail::move_changes( properties,          prev_pending->properties );
+      detail::move_changes( assets,              prev_pending->assets );
+      detail::move_changes( symbol_id_index,     prev_pending->symbol_id_index );
+      detail::move_changes( accounts,            prev_pending->accounts );
+      detail::move_changes( account_id_index,    prev_pending->account_id_index );
+      detail::move_changes( key_to_account,      prev_pending->key_to_account );
+      detail::move_changes( balances,            prev_pending->balances );
+      detail::move_changes( proposals,           prev_pending->proposals );
+      detail::move_changes( proposal_votes,      prev_pending->proposal_votes );
+      detail::move_changes( bids,                prev_pending->bids );
+      detail::move_changes( asks,                prev_pending->asks );
+      detail::move_changes( shorts,              prev_pending->shorts );
+      detail::move_changes( collateral,          prev_pending->collateral );
+      detail::move_changes( unique_transactions, prev_pending->unique_transactions );
+      clear();
+   }
+
+   void  pending_chain_state::clear()
+   {
+      assets.clear();
+      accounts.clear();
+      balances.clear();
+      account_id_index.clear();
+      symbol_id_index.clear();
+      unique_transactions.clear();
+      properties.clear();
+      proposals.clear();
+      key_to_account.clear();
+      proposal_votes.clear();
+      bids.clear();
+      asks.clear();
+      shorts.clear();
+      collateral.clear();
+   }
+
    void  pending_chain_state::get_undo_state( const chain_interface_ptr& undo_state_arg )const
    {
       auto undo_state = std::dynamic_pointer_cast<pending_chain_state>(undo_state_arg);
@@ -39,8 +39,24 @@ namespace bts { namespace blockchain {
       signatures.push_back( signer.sign_compact( digest(chain_id) ) );
    }
 
+   std::unordered_set<address> signed_transaction::get_signed_addresses( const digest_type& chain_id )const
+   { try {
+      std::unordered_set<address> signed_addresses;
+      auto trx_digest = digest( chain_id );
+      for( auto sig : signatures )
+      {
+         auto key = fc::ecc::public_key( sig, trx_digest ).serialize();
+         signed_addresses.insert( address(key) );
+         signed_addresses.insert( address(pts_address(key,false,56) ) );
+         signed_addresses.insert( address(pts_address(key,true,56) )  );
+         signed_addresses.insert( address(pts_address(key,false,0) )  );
+         signed_addresses.insert( address(pts_address(key,true,0) )   );
+      }
+      return signed_addresses;
+   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
    transaction_evaluation_state::transaction_evaluation_state( const chain_interface_ptr& current_state, digest_type chain_id )
-   :_current_state( current_state ),_chain_id(chain_id)
+   :trx_size(0),skip_signature_check(false),_current_state( current_state ),_chain_id(chain_id)
    {
    }
 
@@ -60,25 +76,23 @@ namespace bts { namespace blockchain {
    }
 
    void transaction_evaluation_state::evaluate( const signed_transaction& trx_arg )
+   { try {
+      evaluate( trx_arg, trx_arg.get_signed_addresses( _chain_id ) );
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("trx",trx_arg) ) }
+
+   void transaction_evaluation_state::evaluate( const signed_transaction& trx_arg,
+                                                const std::unordered_set<address>& signed_addresses )
    { try {
       reset();
 
-      auto trx_id = trx_arg.id();
+      trx_id = trx_arg.id();
       otransaction_location current_loc = _current_state->get_transaction_location( trx_id );
       if( !!current_loc )
          fail( BTS_DUPLICATE_TRANSACTION, "transaction has already been processed" );
 
       trx = trx_arg;
-      auto digest = trx_arg.digest( _chain_id );
-      for( auto sig : trx.signatures )
-      {
-         auto key = fc::ecc::public_key( sig, digest ).serialize();
-         signed_keys.insert( address(key) );
-         signed_keys.insert( address(pts_address(key,false,56) ) );
-         signed_keys.insert( address(pts_address(key,true,56) )  );
-         signed_keys.insert( address(pts_address(key,false,0) )  );
-         signed_keys.insert( address(pts_address(key,true,0) )   );
-      }
+      trx_size = trx.data_size();
+      signed_keys = signed_addresses;
       for( auto op : trx.operations )
       {
          evaluate_operation( op );
@@ -93,7 +107,7 @@ namespace bts { namespace blockchain {
     */
    void transaction_evaluation_state::post_evaluate()
    { try {
-      required_fees += asset((fc::raw::pack_size(trx) * _current_state->get_fee_rate())/1000,0);
+      required_fees += asset((trx_size * _current_state->get_fee_rate())/1000,0);
       for( auto fee : balance )
       {
          if( fee.second < 0 ) fail( BTS_INSUFFICIENT_FUNDS, fc::variant(fee) );
@@ -119,7 +133,7 @@ namespace bts { namespace blockchain {
 
       for( auto sig : required_keys )
       {
-         if( signed_keys.find( sig ) == signed_keys.end() )
+         if( !check_signature( sig ) )
             fail( BTS_MISSING_SIGNATURE, fc::variant(sig) );
       }
 
@@ -127,7 +141,7 @@ namespace bts { namespace blockchain {
 
    void transaction_evaluation_state::validate_required_fee()
    { try {
-      share_type required_fee = (_current_state->get_fee_rate() * trx.data_size())/1000;
+      share_type required_fee = (_current_state->get_fee_rate() * trx_size)/1000;
       auto fee_itr = balance.find( 0 );
       FC_ASSERT( fee_itr != balance.end() );
       if( fee_itr->second < required_fee ) 
@@ -294,7 +308,7 @@ namespace bts { namespace blockchain {
    }
    bool transaction_evaluation_state::check_signature( const address& a )const
    {
-      return  signed_keys.find( a ) != signed_keys.end();
+      return  skip_signature_check || signed_keys.find( a ) != signed_keys.end();
    }
 
    void transaction_evaluation_state::add_required_signature( const address& a )
@@ -0,0 +1,330 @@
+#include <bts/blockchain/transaction_pool.hpp>
+#include <bts/blockchain/balance_operations.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace blockchain {
+
+   namespace detail
+   {
+      template<typename Key>
+      void index_transaction( std::unordered_map<Key, std::unordered_set<transaction_id_type> >& index,
+                              const std::vector<Key>& keys, const transaction_id_type& trx_id )
+      {
+         for( const auto& key : keys )
+            index[key].insert( trx_id );
+      }
+
+      template<typename Key>
+      void unindex_transaction( std::unordered_map<Key, std::unordered_set<transaction_id_type> >& index,
+                                const std::vector<Key>& keys, const transaction_id_type& trx_id )
+      {
+         for( const auto& key : keys )
+         {
+            auto itr = index.find( key );
+            if( itr == index.end() ) continue;
+            itr->second.erase( trx_id );
+            if( itr->second.empty() ) index.erase( itr );
+         }
+      }
+
+      template<typename Key, typename Value>
+      void find_transactions( const std::unordered_map<Key, std::unordered_set<transaction_id_type> >& index,
+                              const std::unordered_map<Key, Value>& changed,
+                              std::unordered_set<transaction_id_type>& result )
+      {
+         for( const auto& item : changed )
+         {
+            auto itr = index.find( item.first );
+            if( itr != index.end() ) result.insert( itr->second.begin(), itr->second.end() );
+         }
+      }
+   }
+
+   transaction_pool::transaction_pool( size_t max_size )
+   :_max_size(max_size),_data_size(0),_next_sequence(0),_priority(&transaction_pool::calculate_fee_rate){}
+
+   void transaction_pool::set_priority_function( priority_function priority )
+   {
+      _priority = priority;
+      reprioritize();
+   }
+
+   void transaction_pool::reprioritize()
+   {
+      _by_priority.clear();
+      for( auto& item : _transactions )
+      {
+         item.second.priority = fee_index( _priority( *item.second.trx_state ), item.first );
+         _by_priority.insert( item.second.priority );
+      }
+   }
+
+   std::vector<transaction_id_type> transaction_pool::set_max_size( size_t max_size )
+   {
+      std::vector<transaction_id_type> evicted;
+      _max_size = max_size;
+      while( _data_size > _max_size )
+         evict( _by_priority.rbegin()->_trx, evicted );
+      return evicted;
+   }
+
+   bool transaction_pool::contains( const transaction_id_type& id )const
+   {
+      return _transactions.find( id ) != _transactions.end();
+   }
+
+   transaction_evaluation_state_ptr transaction_pool::find( const transaction_id_type& id )const
+   {
+      auto itr = _transactions.find( id );
+      if( itr == _transactions.end() ) return transaction_evaluation_state_ptr();
+      return itr->second.trx_state;
+   }
+
+   std::vector<transaction_id_type> transaction_pool::insert( const transaction_evaluation_state_ptr& trx_state,
+                                                              const pending_chain_state& changes )
+   { try {
+      FC_ASSERT( trx_state );
+      auto trx_id = trx_state->trx_id;
+      FC_ASSERT( !contains( trx_id ) );
+
+      entry e;
+      e.trx_state  = trx_state;
+      e.fee_rate   = fee_index( calculate_fee_rate( *trx_state ), trx_id );
+      e.priority   = fee_index( _priority( *trx_state ), trx_id );
+      e.sequence   = _next_sequence++;
+      e.expiration = trx_state->trx.expiration;
+      e.withdrawals = get_withdrawals( trx_state->trx );
+      for( const auto& item : changes.balances )
+         e.balances.push_back( item.first );
+      for( const auto& item : changes.accounts )
+         e.accounts.push_back( item.first );
+      // every transaction pays its fees into the base asset record, indexing it would make
+      // every block affect every pending transaction
+      for( const auto& item : changes.assets )
+         if( item.first != BASE_ASSET_ID ) e.assets.push_back( item.first );
+      e.market_or_proposal = changes_market_or_proposal( changes );
+
+      auto evicted = make_room( trx_state->trx_size, e.priority._fees );
+
+      _by_fee_rate.insert( e.fee_rate );
+      _by_priority.insert( e.priority );
+      if( e.expiration ) _by_expiration.insert( std::make_pair( *e.expiration, trx_id ) );
+      detail::index_transaction( _by_balance, e.balances, trx_id );
+      detail::index_transaction( _by_account, e.accounts, trx_id );
+      detail::index_transaction( _by_asset, e.assets, trx_id );
+      if( e.market_or_proposal ) _market_or_proposal.insert( trx_id );
+
+      _data_size += trx_state->trx_size;
+      _transactions[trx_id] = std::move( e );
+      return evicted;
+   } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+   void transaction_pool::remove( const transaction_id_type& id )
+   {
+      auto itr = _transactions.find( id );
+      if( itr == _transactions.end() ) return;
+
+      const entry& e = itr->second;
+      _by_fee_rate.erase( e.fee_rate );
+      _by_priority.erase( e.priority );
+      if( e.expiration ) _by_expiration.erase( std::make_pair( *e.expiration, id ) );
+      detail::unindex_transaction( _by_balance, e.balances, id );
+      detail::unindex_transaction( _by_account, e.accounts, id );
+      detail::unindex_transaction( _by_asset, e.assets, id );
+      _market_or_proposal.erase( id );
+
+      _data_size -= e.trx_state->trx_size;
+      _transactions.erase( itr );
+   }
+
+   void transaction_pool::clear()
+   {
+      _data_size = 0;
+      _transactions.clear();
+      _by_fee_rate.clear();
+      _by_priority.clear();
+      _by_expiration.clear();
+      _by_balance.clear();
+      _by_account.clear();
+      _by_asset.clear();
+      _market_or_proposal.clear();
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::get_dependencies( const signed_transaction& trx )const
+   {
+      std::vector< std::pair<uint64_t,transaction_id_type> > dependencies;
+      transaction_ids                                          visited;
+      std::vector<balance_id_type>                             balances = get_withdrawals( trx );
+      visited.insert( trx.id() );
+      while( !balances.empty() )
+      {
+         auto balance_itr = _by_balance.find( balances.back() );
+         balances.pop_back();
+         if( balance_itr == _by_balance.end() ) continue;
+
+         for( const auto& id : balance_itr->second )
+         {
+            if( !visited.insert( id ).second ) continue;
+            const entry& e = _transactions.find( id )->second;
+            dependencies.push_back( std::make_pair( e.sequence, id ) );
+            balances.insert( balances.end(), e.withdrawals.begin(), e.withdrawals.end() );
+         }
+      }
+      std::sort( dependencies.begin(), dependencies.end() );
+
+      std::vector<transaction_evaluation_state_ptr> result;
+      result.reserve( dependencies.size() );
+      for( const auto& item : dependencies )
+         result.push_back( _transactions.find( item.second )->second.trx_state );
+      return result;
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::get_dependents( const transaction_id_type& id )const
+   {
+      transaction_ids ids;
+      auto itr = _transactions.find( id );
+      if( itr == _transactions.end() ) return sorted( ids );
+
+      for( const auto& balance : itr->second.balances )
+      {
+         auto balance_itr = _by_balance.find( balance );
+         if( balance_itr == _by_balance.end() ) continue;
+
+         for( const auto& other : balance_itr->second )
+         {
+            if( other == id ) continue;
+            const auto& withdrawals = _transactions.find( other )->second.withdrawals;
+            if( std::find( withdrawals.begin(), withdrawals.end(), balance ) != withdrawals.end() )
+               ids.insert( other );
+         }
+      }
+      return sorted( ids );
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::get_affected( const pending_chain_state& changes )const
+   {
+      transaction_ids ids;
+      detail::find_transactions( _by_balance, changes.balances, ids );
+      detail::find_transactions( _by_account, changes.accounts, ids );
+      detail::find_transactions( _by_asset, changes.assets, ids );
+      if( changes_market_or_proposal( changes ) )
+         ids.insert( _market_or_proposal.begin(), _market_or_proposal.end() );
+      return sorted( ids );
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::get_below_fee_rate( share_type fee_rate )const
+   {
+      std::vector<transaction_evaluation_state_ptr> result;
+      for( auto itr = _by_fee_rate.rbegin(); itr != _by_fee_rate.rend() && itr->_fees < fee_rate; ++itr )
+         result.push_back( _transactions.find( itr->_trx )->second.trx_state );
+      return result;
+   }
+
+   std::vector<transaction_id_type> transaction_pool::get_expired( const fc::time_point_sec& now )const
+   {
+      std::vector<transaction_id_type> result;
+      for( auto itr = _by_expiration.begin(); itr != _by_expiration.end() && itr->first < now; ++itr )
+         result.push_back( itr->second );
+      return result;
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::get_transactions()const
+   {
+      std::vector<transaction_evaluation_state_ptr> result;
+      result.reserve( _by_priority.size() );
+      for( const auto& item : _by_priority )
+         result.push_back( _transactions.find( item._trx )->second.trx_state );
+      return result;
+   }
+
+   share_type transaction_pool::get_priority( const transaction_id_type& id )const
+   {
+      auto itr = _transactions.find( id );
+      FC_ASSERT( itr != _transactions.end(), "unknown transaction ${id}", ("id",id) );
+      return itr->second.priority._fees;
+   }
+
+   share_type transaction_pool::calculate_fee_rate( const transaction_evaluation_state& trx_state )
+   {
+      if( trx_state.trx_size == 0 ) return 0;
+      return (trx_state.get_fees() * 1000) / int64_t(trx_state.trx_size);
+   }
+
+   bool transaction_pool::changes_market_or_proposal( const pending_chain_state& changes )
+   {
+      return !changes.bids.empty() || !changes.asks.empty() || !changes.shorts.empty() || !changes.collateral.empty() ||
+             !changes.proposals.empty() || !changes.proposal_votes.empty();
+   }
+
+   std::vector<balance_id_type> transaction_pool::get_withdrawals( const signed_transaction& trx )
+   {
+      std::vector<balance_id_type> withdrawals;
+      for( const auto& op : trx.operations )
+         if( operation_type_enum( op.type ) == withdraw_op_type )
+            withdrawals.push_back( op.as<withdraw_operation>().balance_id );
+      return withdrawals;
+   }
+
+   /** evicts transactions with a lower priority until required_space is available */
+   std::vector<transaction_id_type> transaction_pool::make_room( size_t required_space, share_type priority )
+   { try {
+      std::vector<transaction_id_type> evicted;
+      if( _data_size + required_space <= _max_size ) return evicted;
+
+      // evicting a transaction also evicts its dependents, so the candidates free at least this much
+      std::vector<transaction_id_type> candidates;
+      size_t available = _max_size > _data_size ? _max_size - _data_size : 0;
+      for( auto itr = _by_priority.rbegin(); itr != _by_priority.rend() && available < required_space; ++itr )
+      {
+         if( itr->_fees >= priority ) break;
+         candidates.push_back( itr->_trx );
+         available += _transactions.find( itr->_trx )->second.trx_state->trx_size;
+      }
+      FC_ASSERT( available >= required_space,
+                 "the pending transaction pool is full of transactions with a priority of at least ${priority}",
+                 ("priority",priority)("max_size",_max_size) );
+
+      for( const auto& id : candidates )
+      {
+         if( _data_size + required_space <= _max_size ) break;
+         evict( id, evicted );
+      }
+      return evicted;
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("required_space",required_space) ) }
+
+   /** removes id and the transactions that depend on it, which cannot be valid without it */
+   void transaction_pool::evict( const transaction_id_type& id, std::vector<transaction_id_type>& evicted )
+   {
+      std::vector<transaction_id_type> ids( 1, id );
+      while( !ids.empty() )
+      {
+         auto next = ids.back();
+         ids.pop_back();
+         if( !contains( next ) ) continue;
+
+         for( const auto& dependent : get_dependents( next ) )
+            ids.push_back( dependent->trx_id );
+         remove( next );
+         evicted.push_back( next );
+      }
+   }
+
+   std::vector<transaction_evaluation_state_ptr> transaction_pool::sorted( const transaction_ids& ids )const
+   {
+      std::vector<fee_index> rates;
+      rates.reserve( ids.size() );
+      for( const auto& id : ids )
+         rates.push_back( _transactions.find( id )->second.priority );
+      std::sort( rates.begin(), rates.end() );
+
+      std::vector<transaction_evaluation_state_ptr> result;
+      result.reserve( rates.size() );
+      for( const auto& rate : rates )
+         result.push_back( _transactions.find( rate._trx )->second.trx_state );
+      return result;
+   }
+
+} } // bts::blockchain
@@ -0,0 +1,216 @@
+#include <bts/blockchain/undo_data.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/io/raw_variant.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <algorithm>
+
+namespace bts { namespace blockchain {
+
+   namespace detail
+   {
+      /** a literal ends at the first run of this many bytes that are equal in the base */
+      static const size_t min_copy_size = 4;
+
+      template<typename T>
+      void append( std::vector<char>& out, const T& value )
+      {
+         auto packed = fc::raw::pack( value );
+         out.insert( out.end(), packed.begin(), packed.end() );
+      }
+
+      /**
+       *  Encodes target as the bytes that differ from base at the same offsets, followed by
+       *  the bytes both end with.  When only part of a record changed its size the fields
+       *  after the change still match through the common suffix.
+       *
+       *  format: target size, suffix size, then (copy size, literal size, literal bytes)*
+       */
+      std::vector<char> make_delta( const std::vector<char>& base, const std::vector<char>& target )
+      {
+         size_t suffix = 0;
+         if( base.size() != target.size() )
+         {
+            while( suffix < base.size() && suffix < target.size() &&
+                   base[base.size() - 1 - suffix] == target[target.size() - 1 - suffix] )
+               ++suffix;
+         }
+         const size_t end = target.size() - suffix;
+
+         std::vector<char> delta;
+         append( delta, fc::unsigned_int( target.size() ) );
+         append( delta, fc::unsigned_int( suffix ) );
+
+         auto matches = [&]( size_t pos ) { return pos < base.size() && base[pos] == target[pos]; };
+         size_t pos = 0;
+         while( pos < end )
+         {
+            size_t copy = 0;
+            while( pos + copy < end && matches( pos + copy ) ) ++copy;
+
+            size_t literal_start = pos + copy;
+            size_t literal_end   = literal_start;
+            while( literal_end < end )
+            {
+               size_t needed = std::min( min_copy_size, end - literal_end );
+               size_t run = 0;
+               while( run < needed && matches( literal_end + run ) ) ++run;
+               if( run == needed ) break;
+               literal_end += run + 1;
+            }
+
+            append( delta, fc::unsigned_int( copy ) );
+            append( delta, fc::unsigned_int( literal_end - literal_start ) );
+            delta.insert( delta.end(), target.begin() + literal_start, target.begin() + literal_end );
+            pos = literal_end;
+         }
+         return delta;
+      }
+
+      std::vector<char> apply_delta( const std::vector<char>& base, const std::vector<char>& delta )
+      { try {
+         fc::datastream<const char*> ds( delta.data(), delta.size() );
+         fc::unsigned_int target_size;
+         fc::unsigned_int suffix;
+         fc::raw::unpack( ds, target_size );
+         fc::raw::unpack( ds, suffix );
+         FC_ASSERT( suffix.value <= base.size() && suffix.value <= target_size.value );
+
+         const size_t end = target_size.value - suffix.value;
+         std::vector<char> target;
+         target.reserve( target_size.value );
+         while( target.size() < end )
+         {
+            fc::unsigned_int copy;
+            fc::unsigned_int literal;
+            fc::raw::unpack( ds, copy );
+            fc::raw::unpack( ds, literal );
+            size_t pos = target.size();
+            FC_ASSERT( copy.value + literal.value > 0 );
+            FC_ASSERT( pos + copy.value <= base.size() && pos + copy.value + literal.value <= end );
+
+            target.insert( target.end(), base.begin() + pos, base.begin() + pos + copy.value );
+            target.resize( pos + copy.value + literal.value );
+            if( literal.value ) ds.read( target.data() + pos + copy.value, literal.value );
+         }
+         target.insert( target.end(), base.end() - suffix.value, base.end() );
+         return target;
+      } FC_RETHROW_EXCEPTIONS( warn, "" ) }
+
+      /** properties that were never set are only missing before or after the block that sets them */
+      fc::optional<fc::variant> fetch_property( const chain_interface& current, chain_property_type id )
+      {
+         try {
+            return current.get_property( chain_property_enum( id ) );
+         }
+         catch ( const fc::key_not_found_exception& )
+         {
+            return fc::optional<fc::variant>();
+         }
+      }
+
+      /** @param fetch_current returns the optional value of a key after the block */
+      template<typename Map, typename FetchCurrent>
+      void encode_records( std::vector<char>& out, const Map& records, FetchCurrent&& fetch_current )
+      {
+         append( out, fc::unsigned_int( records.size() ) );
+         for( const auto& item : records )
+         {
+            std::vector<char> base;
+            auto current = fetch_current( item.first );
+            if( current.valid() ) base = fc::raw::pack( *current );
+
+            append( out, item.first );
+            append( out, make_delta( base, fc::raw::pack( item.second ) ) );
+         }
+      }
+
+      template<typename Key, typename Record, typename FetchCurrent, typename Store>
+      void decode_records( fc::datastream<const char*>& ds, FetchCurrent&& fetch_current, Store&& store )
+      {
+         fc::unsigned_int count;
+         fc::raw::unpack( ds, count );
+         for( uint32_t i = 0; i < count.value; ++i )
+         {
+            Key               key;
+            std::vector<char> delta;
+            fc::raw::unpack( ds, key );
+            fc::raw::unpack( ds, delta );
+
+            std::vector<char> base;
+            auto current = fetch_current( key );
+            if( current.valid() ) base = fc::raw::pack( *current );
+
+            store( key, fc::raw::unpack<Record>( apply_delta( base, delta ) ) );
+         }
+      }
+   }
+
+   undo_data undo_data::encode( uint32_t block_num, const pending_chain_state& undo_state, const chain_interface& current )
+   { try {
+      undo_data result;
+      result.block_num = block_num;
+      auto& out = result.deltas;
+
+      detail::encode_records( out, undo_state.properties,
+                              [&]( chain_property_type id ) { return detail::fetch_property( current, id ); } );
+      detail::encode_records( out, undo_state.assets,
+                              [&]( asset_id_type id ) { return current.get_asset_record( id ); } );
+      detail::encode_records( out, undo_state.accounts,
+                              [&]( account_id_type id ) { return current.get_account_record( id ); } );
+      detail::encode_records( out, undo_state.proposals,
+                              [&]( proposal_id_type id ) { return current.get_proposal_record( id ); } );
+      detail::encode_records( out, undo_state.proposal_votes,
+                              [&]( const proposal_vote_id_type& id ) { return current.get_proposal_vote( id ); } );
+      detail::encode_records( out, undo_state.balances,
+                              [&]( const balance_id_type& id ) { return current.get_balance_record( id ); } );
+      detail::encode_records( out, undo_state.bids,
+                              [&]( const market_index_key& key ) { return current.get_bid_record( key ); } );
+      detail::encode_records( out, undo_state.asks,
+                              [&]( const market_index_key& key ) { return current.get_ask_record( key ); } );
+      detail::encode_records( out, undo_state.shorts,
+                              [&]( const market_index_key& key ) { return current.get_short_record( key ); } );
+      detail::encode_records( out, undo_state.collateral,
+                              [&]( const market_index_key& key ) { return current.get_collateral_record( key ); } );
+      return result;
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
+
+   pending_chain_state_ptr undo_data::decode( const chain_interface& current )const
+   { try {
+      auto undo_state = std::make_shared<pending_chain_state>();
+      fc::datastream<const char*> ds( deltas.data(), deltas.size() );
+
+      detail::decode_records<chain_property_type, fc::variant>( ds,
+            [&]( chain_property_type id ) { return detail::fetch_property( current, id ); },
+            [&]( chain_property_type id, const fc::variant& v ) { undo_state->set_property( chain_property_enum( id ), v ); } );
+      detail::decode_records<asset_id_type, asset_record>( ds,
+            [&]( asset_id_type id ) { return current.get_asset_record( id ); },
+            [&]( asset_id_type, const asset_record& r ) { undo_state->store_asset_record( r ); } );
+      detail::decode_records<account_id_type, account_record>( ds,
+            [&]( account_id_type id ) { return current.get_account_record( id ); },
+            [&]( account_id_type, const account_record& r ) { undo_state->store_account_record( r ); } );
+      detail::decode_records<proposal_id_type, proposal_record>( ds,
+            [&]( proposal_id_type id ) { return current.get_proposal_record( id ); },
+            [&]( proposal_id_type, const proposal_record& r ) { undo_state->store_proposal_record( r ); } );
+      detail::decode_records<proposal_vote_id_type, proposal_vote>( ds,
+            [&]( const proposal_vote_id_type& id ) { return current.get_proposal_vote( id ); },
+            [&]( const proposal_vote_id_type&, const proposal_vote& r ) { undo_state->store_proposal_vote( r ); } );
+      detail::decode_records<balance_id_type, balance_record>( ds,
+            [&]( const balance_id_type& id ) { return current.get_balance_record( id ); },
+            [&]( const balance_id_type&, const balance_record& r ) { undo_state->store_balance_record( r ); } );
+      detail::decode_records<market_index_key, order_record>( ds,
+            [&]( const market_index_key& key ) { return current.get_bid_record( key ); },
+            [&]( const market_index_key& key, const order_record& r ) { undo_state->store_bid_record( key, r ); } );
+      detail::decode_records<market_index_key, order_record>( ds,
+            [&]( const market_index_key& key ) { return current.get_ask_record( key ); },
+            [&]( const market_index_key& key, const order_record& r ) { undo_state->store_ask_record( key, r ); } );
+      detail::decode_records<market_index_key, order_record>( ds,
+            [&]( const market_index_key& key ) { return current.get_short_record( key ); },
+            [&]( const market_index_key& key, const order_record& r ) { undo_state->store_short_record( key, r ); } );
+      detail::decode_records<market_index_key, collateral_record>( ds,
+            [&]( const market_index_key& key ) { return current.get_collateral_record( key ); },
+            [&]( const market_index_key& key, const collateral_record& r ) { undo_state->store_collateral_record( key, r ); } );
+      return undo_state;
+   } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block_num) ) }
+
+} } // bts::blockchain
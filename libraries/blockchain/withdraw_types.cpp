@@ -37,22 +37,30 @@ namespace bts { namespace blockchain {
       return address( *this );
    }
    omemo_status withdraw_by_account::decrypt_memo_data( const fc::ecc::private_key& receiver_key )const
+   {
+      return decrypt_memo_data( receiver_key, receiver_key.get_public_key() );
+   }
+
+   omemo_status withdraw_by_account::decrypt_memo_data( const fc::ecc::private_key& receiver_key,
+                                                        const fc::ecc::public_key& receiver_public_key )const
    { try {
 //      ilog( "receiver_key: ${r}", ("r",receiver_key) );
       auto secret = receiver_key.get_shared_secret( one_time_key );
 //      ilog( "secret: ${secret}", ("secret",secret) );
-      extended_private_key ext_receiver_key(receiver_key);
- //     ilog( "ext_receiver_key: ${key}",("key",ext_receiver_key) );
-      
-      fc::ecc::private_key secret_private_key = ext_receiver_key.child( fc::sha256::hash(secret), 
-                                                                        extended_private_key::public_derivation );
-   //   ilog( "secret_private_key: ${k}", ("k",secret_private_key)  );
-      auto secret_public_key = secret_private_key.get_public_key();
+      auto child_index = fc::sha256::hash(secret);
+
+      // derived the way encrypt_memo_data() derives the owner, the private key is only needed on a match
+      auto secret_public_key = extended_public_key( receiver_public_key ).child( child_index ).get_pub_key();
     //  ilog( "secret_public_key: ${k}", ("k",secret_public_key)  );
 
       if( owner != address(secret_public_key) )
          return omemo_status();
 
+      extended_private_key ext_receiver_key(receiver_key);
+      fc::ecc::private_key secret_private_key = ext_receiver_key.child( child_index, 
+                                                                        extended_private_key::public_derivation );
+   //   ilog( "secret_private_key: ${k}", ("k",secret_private_key)  );
+
      // ilog( "owner: ${o} == ${address}", ("o",owner)("address",address(secret_public_key)) );
       auto memo = decrypt_memo_data( secret );
 
@@ -70,6 +78,24 @@ namespace bts { namespace blockchain {
       return memo_status( memo, has_valid_signature, secret_private_key );
    } FC_RETHROW_EXCEPTIONS( warn, "" ) }
 
+   memo_key_set::memo_key_set( const std::vector<fc::ecc::private_key>& receiver_keys )
+   {
+      _keys.reserve( receiver_keys.size() );
+      for( const auto& key : receiver_keys )
+      {
+         receiver_key item;
+         item.key         = key;
+         item.public_key  = key.get_public_key();
+         item.key_address = address( item.public_key );
+         _keys.push_back( item );
+      }
+   }
+
+   omemo_status memo_key_set::decrypt_memo_data( const withdraw_by_account& deposit, uint32_t index )const
+   {
+      FC_ASSERT( index < _keys.size() );
+      return deposit.decrypt_memo_data( _keys[index].key, _keys[index].public_key );
+   }
 
    void  withdraw_by_account::encrypt_memo_data( const fc::ecc::private_key& one_time_private_key, 
                                    const fc::ecc::public_key&  to_public_key,
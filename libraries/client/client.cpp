@@ -106,7 +106,15 @@ namespace bts { namespace client {
                {
                   ilog( "producing block in: ${b}", ("b",(next_block_time-now).count()/1000000.0) );
                   try {
-                     fc::usleep( (next_block_time - now) );
+                     // keep the next block packed while waiting so that only the header
+                     // is left to fill in when the slot arrives
+                     auto remaining = fc::time_point(next_block_time) - fc::time_point::now();
+                     while( remaining.count() > 0 )
+                     {
+                        _chain_db->update_block_template();
+                        fc::usleep( std::min( remaining, fc::milliseconds(250) ) );
+                        remaining = fc::time_point(next_block_time) - fc::time_point::now();
+                     }
                      full_block next_block = _chain_db->generate_block( next_block_time );
                      _wallet->sign_block( next_block );
 
@@ -233,17 +241,17 @@ namespace bts { namespace client {
          for (uint32_t i = 0; i < items_to_get_this_iteration; ++i)
          {
            ++last_seen_block_num;
-           signed_block_header header;
+           block_id_type block_id;
            try
            {
-             header = _chain_db->get_block(last_seen_block_num);
+             block_id = _chain_db->get_block_id(last_seen_block_num);
            }
            catch (fc::key_not_found_exception&)
            {
              ilog( "attempting to fetch last_seen ${i}", ("i",last_seen_block_num) );
              assert( !"I assume this can never happen");
            }
-           hashes_to_return.push_back(header.id());
+           hashes_to_return.push_back(block_id);
          }
          remaining_item_count -= items_to_get_this_iteration;
          return hashes_to_return;
@@ -256,7 +264,7 @@ namespace bts { namespace client {
         uint32_t low_block_num = 1;
         do
         {
-          synopsis.push_back(_chain_db->get_block(low_block_num).id());
+          synopsis.push_back(_chain_db->get_block_id(low_block_num));
           low_block_num += ((high_block_num - low_block_num + 2) / 2);
         }
         while (low_block_num <= high_block_num);
@@ -358,7 +366,7 @@ namespace bts { namespace client {
     //JSON-RPC Method Implementations START
     bts::blockchain::block_id_type detail::client_impl::blockchain_get_blockhash(uint32_t block_number) const
     {
-      return _chain_db->get_block(block_number).id();
+      return _chain_db->get_block_id(block_number);
     }
 
     uint32_t detail::client_impl::blockchain_get_blockcount() const
@@ -1029,6 +1037,16 @@ namespace bts { namespace client {
    {
       return _chain_db->get_proposal_votes( proposal_id );
    }
+
+   fc::variant_object client_impl::blockchain_get_record_cache_stats() const
+   {
+      return _chain_db->get_record_cache_stats();
+   }
+
+   fc::variant_object client_impl::blockchain_audit_state() const
+   {
+      return _chain_db->audit_state();
+   }
    } // namespace detail
 
    bts::api::common_api* client::get_impl() const
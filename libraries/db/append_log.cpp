@@ -0,0 +1,128 @@
+#include <bts/db/append_log.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <string.h>
+
+namespace bts { namespace db {
+
+    /** size followed by checksum */
+    static const uint32_t record_header_size = sizeof(uint32_t) + sizeof(uint64_t);
+
+    append_log::append_log()
+    :_size(0),_mapped_size(0){}
+
+    append_log::~append_log()
+    {
+       close();
+    }
+
+    void append_log::open( const fc::path& file )
+    { try {
+       FC_ASSERT( !is_open() );
+       if( file.parent_path() != fc::path() )
+          fc::create_directories( file.parent_path() );
+
+       _file = file;
+       _out.open( file.to_native_ansi_path().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+       FC_ASSERT( _out.is_open(), "unable to open ${file}", ("file",file) );
+       _size = fc::file_size( file );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("file",file) ) }
+
+    void append_log::close()
+    {
+       _region.reset();
+       _mapping.reset();
+       _mapped_size = 0;
+       if( _out.is_open() ) _out.close();
+       _size = 0;
+    }
+
+    uint64_t append_log::append( const char* data, uint32_t size )
+    { try {
+       FC_ASSERT( is_open() );
+       uint64_t offset = _size;
+       uint64_t sum    = checksum( data, size );
+
+       _out.write( (const char*)&size, sizeof(size) );
+       _out.write( (const char*)&sum, sizeof(sum) );
+       _out.write( data, size );
+       FC_ASSERT( _out.good(), "error writing to ${file}", ("file",_file) );
+
+       _size += record_header_size + size;
+       return offset;
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("size",size) ) }
+
+    void append_log::flush()
+    {
+       _out.flush();
+    }
+
+    append_log::record append_log::read( uint64_t offset )
+    { try {
+       record r;
+       uint64_t next = 0;
+       FC_ASSERT( read_record( offset, false, r, next ), "no record at ${offset}", ("offset",offset) );
+       return r;
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("offset",offset)("file",_file) ) }
+
+    bool append_log::read_next( uint64_t offset, record& r, uint64_t& next )
+    {
+       return read_record( offset, true, r, next );
+    }
+
+    bool append_log::read_record( uint64_t offset, bool verify, record& r, uint64_t& next )
+    {
+       FC_ASSERT( is_open() );
+       if( offset + record_header_size > _size ) return false;
+       if( offset + record_header_size > _mapped_size ) map();
+
+       const char* pos = (const char*)_region->get_address() + offset;
+       uint32_t size = 0;
+       uint64_t sum  = 0;
+       memcpy( &size, pos, sizeof(size) );
+       memcpy( &sum, pos + sizeof(size), sizeof(sum) );
+
+       if( offset + record_header_size + size > _size ) return false;
+       if( offset + record_header_size + size > _mapped_size ) map();
+
+       pos = (const char*)_region->get_address() + offset + record_header_size;
+       if( verify && checksum( pos, size ) != sum ) return false;
+
+       r.data = pos;
+       r.size = size;
+       next   = offset + record_header_size + size;
+       return true;
+    }
+
+    void append_log::truncate( uint64_t offset )
+    { try {
+       FC_ASSERT( offset <= _size );
+       if( offset == _size ) return;
+
+       wlog( "truncating ${file} from ${size} to ${offset} bytes", ("file",_file)("size",_size)("offset",offset) );
+       auto file = _file;
+       close();
+       boost::filesystem::resize_file( file.to_native_ansi_path(), offset );
+       open( file );
+    } FC_RETHROW_EXCEPTIONS( warn, "", ("offset",offset) ) }
+
+    uint64_t append_log::checksum( const char* data, uint32_t size )
+    {
+       return fc::sha256::hash( data, size )._hash[0];
+    }
+
+    /** maps everything that has been written, called when a read reaches past the current mapping */
+    void append_log::map()
+    {
+       flush();
+       _region.reset();
+       if( !_mapping ) _mapping.reset( new fc::file_mapping( _file.to_native_ansi_path().c_str(), fc::read_only ) );
+       _region.reset( new fc::mapped_region( *_mapping, fc::read_only, 0, _size ) );
+       _mapped_size = _size;
+    }
+
+} } // bts::db
@@ -0,0 +1,81 @@
+#pragma once
+#include <fc/filesystem.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief an append only file of checksummed records for data that never changes once written
+   *
+   *  Each record is stored as its size, a checksum of its data and the data itself.  Records
+   *  are addressed by the offset that append() returns, reads are served from a memory mapping
+   *  of the file so no copy is made until the caller unpacks the record.
+   *
+   *  A crash can leave a partial record at the end of the file, the owner is expected to
+   *  remember the end of the last record it indexed, scan the records after it with
+   *  read_next() on startup and truncate() the file where the scan stops.
+   */
+  class append_log
+  {
+     public:
+        /**
+         *  A record inside of the mapped file.  A read past the end of the mapping maps the
+         *  file again, so data is only valid until the next read() or read_next() of a record
+         *  appended after it was mapped, or close().
+         */
+        struct record
+        {
+           record():data(nullptr),size(0){}
+           const char* data;
+           uint32_t    size;
+        };
+
+        append_log();
+        ~append_log();
+
+        void     open( const fc::path& file );
+        void     close();
+        bool     is_open()const { return _out.is_open(); }
+
+        /** @return the offset of the new record */
+        uint64_t append( const char* data, uint32_t size );
+        void     flush();
+
+        /**
+         *  Reads a record at an offset returned by append(), the checksum is not verified
+         *  because the record was checked when it was indexed.
+         *  @throw if the record at offset is not fully written
+         */
+        record   read( uint64_t offset );
+
+        /**
+         *  Reads the record at offset if one is fully written and passes its checksum, used
+         *  to scan the records at the end of the file that the owner has not indexed yet.
+         *  @param next set to the offset of the following record
+         */
+        bool     read_next( uint64_t offset, record& r, uint64_t& next );
+
+        /** truncates the file at offset, discarding a partially written record */
+        void     truncate( uint64_t offset );
+
+        /** the offset the next record will be written at */
+        uint64_t size()const { return _size; }
+
+     private:
+        static uint64_t checksum( const char* data, uint32_t size );
+        bool            read_record( uint64_t offset, bool verify, record& r, uint64_t& next );
+        void            map();
+
+        fc::path                             _file;
+        std::ofstream                        _out;
+        uint64_t                             _size;
+        std::unique_ptr<fc::file_mapping>    _mapping;
+        std::unique_ptr<fc::mapped_region>   _region;
+        uint64_t                             _mapped_size;
+  };
+
+} } // bts::db
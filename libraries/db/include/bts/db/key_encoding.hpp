@@ -0,0 +1,209 @@
+#pragma once
+#include <fc/io/raw.hpp>
+#include <fc/io/varint.hpp>
+#include <fc/crypto/ripemd160.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/uint128.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <boost/preprocessor/seq/for_each.hpp>
+
+#include <string>
+
+namespace bts { namespace db {
+
+  /**
+   *  @brief order preserving serialization of database keys
+   *
+   *  A key type with a key_encoding specialization is stored such that comparing the
+   *  encoded bytes with memcmp gives the same order as comparing the keys, which lets
+   *  Level DB use its default bytewise comparator (and bloom filters) instead of
+   *  unpacking both keys on every comparison.
+   *
+   *  - unsigned integers are stored big endian
+   *  - signed integers are stored big endian with the sign bit flipped
+   *  - hashes are stored as their raw bytes
+   *  - strings escape 0x00 as 0x00 0xff and are terminated by 0x00 0x01
+   *  - structs are the concatenation of their members, see BTS_DB_KEY_ENCODING
+   *
+   *  Types without a specialization fall back to fc::raw and can only be stored with
+   *  a custom comparator.
+   */
+  template<typename T>
+  struct key_encoding
+  {
+     static const bool is_defined = false;
+
+     static void encode( std::string& out, const T& v )
+     {
+        auto packed = fc::raw::pack( v );
+        out.append( packed.data(), packed.size() );
+     }
+     static void decode( fc::datastream<const char*>& ds, T& v )
+     {
+        fc::raw::unpack( ds, v );
+     }
+  };
+
+  namespace detail
+  {
+     template<typename UInt>
+     void encode_big_endian( std::string& out, UInt v )
+     {
+        char buf[sizeof(UInt)];
+        for( int i = sizeof(UInt) - 1; i >= 0; --i )
+        {
+           buf[i] = char(v & 0xff);
+           v >>= 8;
+        }
+        out.append( buf, sizeof(buf) );
+     }
+
+     template<typename UInt>
+     void decode_big_endian( fc::datastream<const char*>& ds, UInt& v )
+     {
+        unsigned char buf[sizeof(UInt)];
+        ds.read( (char*)buf, sizeof(buf) );
+        v = 0;
+        for( size_t i = 0; i < sizeof(UInt); ++i )
+           v = (v << 8) | buf[i];
+     }
+
+     template<typename UInt>
+     struct unsigned_key_encoding
+     {
+        static const bool is_defined = true;
+        static void encode( std::string& out, UInt v )                      { encode_big_endian( out, v ); }
+        static void decode( fc::datastream<const char*>& ds, UInt& v )      { decode_big_endian( ds, v ); }
+     };
+
+     template<typename Int, typename UInt>
+     struct signed_key_encoding
+     {
+        static const bool is_defined = true;
+        static const UInt sign_bit = UInt(1) << (sizeof(UInt)*8 - 1);
+
+        static void encode( std::string& out, Int v )
+        {
+           encode_big_endian( out, UInt(v) ^ sign_bit );
+        }
+        static void decode( fc::datastream<const char*>& ds, Int& v )
+        {
+           UInt tmp;
+           decode_big_endian( ds, tmp );
+           v = Int( tmp ^ sign_bit );
+        }
+     };
+
+     template<typename Hash>
+     struct hash_key_encoding
+     {
+        static const bool is_defined = true;
+        static void encode( std::string& out, const Hash& v )                { out.append( v.data(), v.data_size() ); }
+        static void decode( fc::datastream<const char*>& ds, Hash& v )       { ds.read( v.data(), v.data_size() ); }
+     };
+  } // namespace detail
+
+  template<> struct key_encoding<uint8_t>  : detail::unsigned_key_encoding<uint8_t>  {};
+  template<> struct key_encoding<uint16_t> : detail::unsigned_key_encoding<uint16_t> {};
+  template<> struct key_encoding<uint32_t> : detail::unsigned_key_encoding<uint32_t> {};
+  template<> struct key_encoding<uint64_t> : detail::unsigned_key_encoding<uint64_t> {};
+
+  template<> struct key_encoding<int16_t>  : detail::signed_key_encoding<int16_t,uint16_t> {};
+  template<> struct key_encoding<int32_t>  : detail::signed_key_encoding<int32_t,uint32_t> {};
+  template<> struct key_encoding<int64_t>  : detail::signed_key_encoding<int64_t,uint64_t> {};
+
+  template<> struct key_encoding<fc::ripemd160> : detail::hash_key_encoding<fc::ripemd160> {};
+  template<> struct key_encoding<fc::sha256>    : detail::hash_key_encoding<fc::sha256>    {};
+
+  template<> struct key_encoding<fc::signed_int>
+  {
+     static const bool is_defined = true;
+     static void encode( std::string& out, const fc::signed_int& v )
+     {
+        key_encoding<int32_t>::encode( out, v.value );
+     }
+     static void decode( fc::datastream<const char*>& ds, fc::signed_int& v )
+     {
+        key_encoding<int32_t>::decode( ds, v.value );
+     }
+  };
+
+  template<> struct key_encoding<fc::uint128>
+  {
+     static const bool is_defined = true;
+     static void encode( std::string& out, const fc::uint128& v )
+     {
+        detail::encode_big_endian( out, v.high_bits() );
+        detail::encode_big_endian( out, v.low_bits() );
+     }
+     static void decode( fc::datastream<const char*>& ds, fc::uint128& v )
+     {
+        uint64_t high, low;
+        detail::decode_big_endian( ds, high );
+        detail::decode_big_endian( ds, low );
+        v = fc::uint128( high, low );
+     }
+  };
+
+  template<> struct key_encoding<std::string>
+  {
+     static const bool is_defined = true;
+     static void encode( std::string& out, const std::string& v )
+     {
+        for( auto c : v )
+        {
+           out.push_back( c );
+           if( c == '\0' ) out.push_back( char(0xff) );
+        }
+        out.push_back( '\0' );
+        out.push_back( char(0x01) );
+     }
+     static void decode( fc::datastream<const char*>& ds, std::string& v )
+     {
+        v.clear();
+        while( true )
+        {
+           char c;
+           ds.get( c );
+           if( c != '\0' )
+           {
+              v.push_back( c );
+              continue;
+           }
+           ds.get( c );
+           if( c == char(0x01) ) return;
+           FC_ASSERT( c == char(0xff), "invalid string key encoding" );
+           v.push_back( '\0' );
+        }
+     }
+  };
+
+} } // bts::db
+
+#define BTS_DB_KEY_ENCODE_MEMBER( r, OBJ, MEMBER ) \
+   bts::db::key_encoding<decltype(OBJ.MEMBER)>::encode( out, OBJ.MEMBER );
+
+#define BTS_DB_KEY_DECODE_MEMBER( r, OBJ, MEMBER ) \
+   bts::db::key_encoding<decltype(OBJ.MEMBER)>::decode( ds, OBJ.MEMBER );
+
+/**
+ *  Defines the key_encoding of TYPE as the concatenation of the encodings of MEMBERS, in
+ *  the given order, so the encoded keys sort lexicographically by those members.
+ *  Must be used in the global namespace.
+ */
+#define BTS_DB_KEY_ENCODING( TYPE, MEMBERS ) \
+namespace bts { namespace db { \
+   template<> struct key_encoding<TYPE> \
+   { \
+      static const bool is_defined = true; \
+      static void encode( std::string& out, const TYPE& v ) \
+      { \
+         BOOST_PP_SEQ_FOR_EACH( BTS_DB_KEY_ENCODE_MEMBER, v, MEMBERS ) \
+      } \
+      static void decode( fc::datastream<const char*>& ds, TYPE& v ) \
+      { \
+         BOOST_PP_SEQ_FOR_EACH( BTS_DB_KEY_DECODE_MEMBER, v, MEMBERS ) \
+      } \
+   }; \
+} }
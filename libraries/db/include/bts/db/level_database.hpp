@@ -0,0 +1,85 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/comparator.h>
+#include <leveldb/filter_policy.h>
+
+#include <fc/filesystem.hpp>
+
+#include <bts/db/write_batch.hpp>
+
+#include <memory>
+#include <string>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  @brief a single Level DB instance that hosts many level_map / level_pod_map tables
+   *
+   *  Every table is assigned a one byte id which is used as a prefix on all of its keys.
+   *  Keys are ordered first by table id and then by the comparator registered for that
+   *  table, so each table iterates exactly like it would in a database of its own.  Tables
+   *  registered without a comparator are ordered bytewise (see key_encoding), when every
+   *  table is bytewise the database also maintains bloom filters for point lookups.
+   *
+   *  All tables must be attached (level_map::open( level_database&, table_id )) before
+   *  the database itself is opened because Level DB needs the comparators to recover
+   *  its log.
+   *
+   *  Writes to any table made between start_batch() and commit_batch() are collected into
+   *  a single write_batch and applied atomically.  Point lookups (fetch / fetch_optional)
+   *  see the pending writes, iterators only see committed data.
+   */
+  class level_database
+  {
+     public:
+        level_database();
+        ~level_database();
+
+        /** @param compare the key order of the table, nullptr for bytewise order */
+        void register_table( uint8_t table_id, const ldb::Comparator* compare );
+
+        void open( const fc::path& dir, bool create = true );
+        void close();
+        bool is_open()const { return !!_db; }
+
+        ldb::DB* get_db()const { return _db.get(); }
+
+        /** batches may be nested, only the outermost commit_batch() writes to disk */
+        void start_batch()                     { _batch.start(); }
+        void commit_batch( bool sync = false ) { _batch.commit( _db.get(), sync ); }
+        /** discards all pending writes regardless of nesting depth */
+        void abort_batch()                     { _batch.abort(); }
+        bool in_batch()const                   { return _batch.active(); }
+
+        void put( const ldb::Slice& key, const ldb::Slice& value );
+        void remove( const ldb::Slice& key );
+
+        /** @return false if the key is not found, pending batch writes take precedence */
+        bool get( const ldb::Slice& key, std::string& value )const;
+
+     private:
+        class table_compare : public ldb::Comparator
+        {
+           public:
+             table_compare();
+             int Compare( const ldb::Slice& a, const ldb::Slice& b )const;
+
+             /** Level DB refuses to open a database written with a comparator of another name,
+              *  bump the version whenever the order of existing keys changes */
+             const char* Name()const { return "table_compare_v2"; }
+             void FindShortestSeparator( std::string*, const ldb::Slice& )const{}
+             void FindShortSuccessor( std::string* )const{};
+
+             const ldb::Comparator* _tables[256];
+        };
+
+        table_compare                                                  _comparer;
+        bool                                                           _has_custom_compare;
+        std::unique_ptr<const ldb::FilterPolicy>                       _filter;
+        std::unique_ptr<ldb::DB>                                       _db;
+        write_batch                                                    _batch;
+  };
+
+} } // bts::db
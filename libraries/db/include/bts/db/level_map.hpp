@@ -10,6 +10,9 @@
 
 #include <fc/log/logger.hpp>
 
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/level_database.hpp>
+#include <bts/db/write_batch.hpp>
 #include <bts/db/upgrade_leveldb.hpp>
 
 namespace bts { namespace db {
@@ -19,11 +22,17 @@ namespace bts { namespace db {
   /**
    *  @brief implements a high-level API on top of Level DB that stores items using fc::raw / reflection
    *
+   *  The map either owns a Level DB instance of its own or is a table inside of a
+   *  level_database that is shared with other maps.  Tables inside of a level_database
+   *  store their keys with key_encoding<Key> when it is defined so that they can be
+   *  compared bytewise.
    */
   template<typename Key, typename Value>
   class level_map
   {
      public:
+        level_map():_shared(nullptr),_bytewise(false){}
+
         void open( const fc::path& dir, bool create = true )
         {
            ldb::Options opts;
@@ -47,35 +56,77 @@ namespace bts { namespace db {
            _db.reset(ndb);
            try_upgrade_db( dir,ndb, fc::get_typename<Value>::name(),sizeof(Value) );
         }
-        bool is_open()const { return !!_db; }
+
+        /**
+         *  Attaches this map as table_id of db, this must be called before db is opened.
+         */
+        void open( level_database& db, uint8_t table_id )
+        {
+           _bytewise = key_encoding<Key>::is_defined;
+           db.register_table( table_id, _bytewise ? nullptr : &_comparer );
+           _shared = &db;
+           _prefix = std::string( 1, char(table_id) );
+        }
+
+        bool is_open()const { return !!_db || (_shared != nullptr && _shared->is_open()); }
 
         void close()
         {
+          if( _batch.active() )
+             wlog( "closing database with ${n} uncommitted writes", ("n",_batch.size()) );
+          _batch.abort();
           _db.reset();
+          _shared = nullptr;
+          _prefix.clear();
+          _bytewise = false;
+        }
+
+        /**
+         *  Defers all stores and removes until the outermost commit_batch(), fetch and
+         *  fetch_optional see the deferred writes while iterators only see committed data.
+         *  Tables in a level_database share the batch of the database.
+         */
+        void start_batch()
+        {
+           if( _shared ) _shared->start_batch();
+           else _batch.start();
+        }
+
+        void commit_batch( bool sync = false )
+        {
+           if( _shared ) _shared->commit_batch( sync );
+           else _batch.commit( _db.get(), sync );
+        }
+
+        /** discards all deferred writes */
+        void abort_batch()
+        {
+           if( _shared ) _shared->abort_batch();
+           else _batch.abort();
         }
 
         fc::optional<Value> fetch_optional( const Key& k )
         {
-           auto itr = find( k );
-           if( itr.valid() ) return itr.value();
-           return fc::optional<Value>();
+          try {
+             std::string value;
+             if( !get_value( k, value ) )
+                return fc::optional<Value>();
+
+             fc::datastream<const char*> ds(value.c_str(), value.size());
+             Value tmp;
+             fc::raw::unpack(ds, tmp);
+             return tmp;
+          } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",k) );
         }
 
         Value fetch( const Key& k )
         {
           try {
-             std::vector<char> kslice = fc::raw::pack( k );
-             ldb::Slice ks( kslice.data(), kslice.size() );
              std::string value;
-             auto status = _db->Get( ldb::ReadOptions(), ks, &value );
-             if( status.IsNotFound() )
+             if( !get_value( k, value ) )
              {
                FC_THROW_EXCEPTION( key_not_found_exception, "unable to find key ${key}", ("key",k) );
              }
-             if( !status.ok() )
-             {
-                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
-             }
              fc::datastream<const char*> ds(value.c_str(), value.size());
              Value tmp;
              fc::raw::unpack(ds, tmp);
@@ -86,17 +137,19 @@ namespace bts { namespace db {
         class iterator
         {
            public:
-             iterator(){}
+             iterator():_bytewise(false){}
              bool valid()const
              {
-                return _it && _it->Valid();
+                return _it && _it->Valid() && _it->key().starts_with( _prefix );
              }
 
              Key key()const
              {
                  Key tmp_key;
-                 fc::datastream<const char*> ds2( _it->key().data(), _it->key().size() );
-                 fc::raw::unpack( ds2, tmp_key );
+                 fc::datastream<const char*> ds2( _it->key().data() + _prefix.size(),
+                                                  _it->key().size() - _prefix.size() );
+                 if( _bytewise ) key_encoding<Key>::decode( ds2, tmp_key );
+                 else fc::raw::unpack( ds2, tmp_key );
                  return tmp_key;
              }
 
@@ -116,16 +169,19 @@ namespace bts { namespace db {
 
            protected:
              friend class level_map;
-             iterator( ldb::Iterator* it )
-             :_it(it){}
+             iterator( ldb::Iterator* it, const std::string& prefix, bool bytewise )
+             :_it(it),_prefix(prefix),_bytewise(bytewise){}
 
              std::shared_ptr<ldb::Iterator> _it;
+             std::string                    _prefix;
+             bool                           _bytewise;
         };
 
         iterator begin()
         { try {
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->SeekToFirst();
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
+           if( _prefix.size() ) itr._it->Seek( _prefix );
+           else itr._it->SeekToFirst();
 
            if( itr._it->status().IsNotFound() )
            {
@@ -145,10 +201,9 @@ namespace bts { namespace db {
 
         iterator find( const Key& key )
         { try {
-           std::vector<char> kslice = fc::raw::pack( key );
-           ldb::Slice key_slice( kslice.data(), kslice.size() );
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->Seek( key_slice );
+           std::string kslice = pack_key( key );
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
+           itr._it->Seek( kslice );
            if( itr.valid() && itr.key() == key )
            {
               return itr;
@@ -158,11 +213,10 @@ namespace bts { namespace db {
 
         iterator lower_bound( const Key& key )
         { try {
-           std::vector<char> kslice = fc::raw::pack( key );
-           ldb::Slice key_slice( kslice.data(), kslice.size() );
+           std::string kslice = pack_key( key );
 
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->Seek( key_slice );
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
+           itr._it->Seek( kslice );
            if( itr.valid()  )
            {
               return itr;
@@ -173,15 +227,13 @@ namespace bts { namespace db {
         bool last( Key& k )
         {
           try {
-             std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+             std::unique_ptr<ldb::Iterator> it( get_db()->NewIterator( ldb::ReadOptions() ) );
              FC_ASSERT( it != nullptr );
-             it->SeekToLast();
-             if( !it->Valid() )
+             if( !seek_to_last( *it ) )
              {
                return false;
              }
-             fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-             fc::raw::unpack( ds2, k );
+             unpack_key( *it, k );
              return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -189,18 +241,16 @@ namespace bts { namespace db {
         bool last( Key& k, Value& v )
         {
           try {
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+           std::unique_ptr<ldb::Iterator> it( get_db()->NewIterator( ldb::ReadOptions() ) );
            FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           if( !seek_to_last( *it ) )
            {
              return false;
            }
            fc::datastream<const char*> ds( it->value().data(), it->value().size() );
            fc::raw::unpack( ds, v );
 
-           fc::datastream<const char*> ds2( it->key().data(), it->key().size() );
-           fc::raw::unpack( ds2, k );
+           unpack_key( *it, k );
            return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -209,14 +259,25 @@ namespace bts { namespace db {
         {
           try
           {
-             FC_ASSERT( _db != nullptr );
+             FC_ASSERT( is_open() );
 
-             std::vector<char> kslice = fc::raw::pack( k );
+             std::string kslice = pack_key( k );
              ldb::Slice ks( kslice.data(), kslice.size() );
 
              auto vec = fc::raw::pack(v);
              ldb::Slice vs( vec.data(), vec.size() );
 
+             if( _shared )
+             {
+                _shared->put( ks, vs );
+                return;
+             }
+             if( _batch.active() )
+             {
+                _batch.put( ks, vs );
+                return;
+             }
+
              auto status = _db->Put( ldb::WriteOptions(), ks, vs );
              if( !status.ok() )
              {
@@ -229,10 +290,22 @@ namespace bts { namespace db {
         {
           try
           {
-             FC_ASSERT( _db != nullptr );
+             FC_ASSERT( is_open() );
 
-             std::vector<char> kslice = fc::raw::pack( k );
+             std::string kslice = pack_key( k );
              ldb::Slice ks( kslice.data(), kslice.size() );
+
+             if( _shared )
+             {
+                _shared->remove( ks );
+                return;
+             }
+             if( _batch.active() )
+             {
+                _batch.remove( ks );
+                return;
+             }
+
              auto status = _db->Delete( ldb::WriteOptions(), ks );
              if( status.IsNotFound() )
              {
@@ -246,6 +319,57 @@ namespace bts { namespace db {
         }
 
      private:
+        ldb::DB* get_db()const
+        {
+           if( _shared ) return _shared->get_db();
+           return _db.get();
+        }
+
+        std::string pack_key( const Key& k )const
+        {
+           std::string kslice = _prefix;
+           if( _bytewise )
+           {
+              key_encoding<Key>::encode( kslice, k );
+              return kslice;
+           }
+           auto packed = fc::raw::pack( k );
+           kslice.append( packed.data(), packed.size() );
+           return kslice;
+        }
+
+        void unpack_key( const ldb::Iterator& it, Key& k )const
+        {
+           fc::datastream<const char*> ds( it.key().data() + _prefix.size(), it.key().size() - _prefix.size() );
+           if( _bytewise ) key_encoding<Key>::decode( ds, k );
+           else fc::raw::unpack( ds, k );
+        }
+
+        bool get_value( const Key& k, std::string& value )
+        {
+           std::string kslice = pack_key( k );
+           ldb::Slice ks( kslice.data(), kslice.size() );
+           if( _shared )
+              return _shared->get( ks, value );
+           return _batch.get( _db.get(), ks, value );
+        }
+
+        /** positions it on the last key of this table, returns false if the table is empty */
+        bool seek_to_last( ldb::Iterator& it )const
+        {
+           if( _prefix.empty() || uint8_t(_prefix[0]) == 0xff )
+           {
+              it.SeekToLast();
+           }
+           else
+           {
+              it.Seek( std::string( 1, char(uint8_t(_prefix[0]) + 1) ) );
+              if( it.Valid() ) it.Prev();
+              else it.SeekToLast();
+           }
+           return it.Valid() && it.key().starts_with( _prefix );
+        }
+
         class key_compare : public leveldb::Comparator
         {
           public:
@@ -268,6 +392,10 @@ namespace bts { namespace db {
         };
 
         key_compare                  _comparer;
+        level_database*              _shared;
+        std::string                  _prefix;
+        bool                         _bytewise;
+        write_batch                  _batch;
 
 public: //DLNFIX temporary, remove this
         std::unique_ptr<leveldb::DB> _db;
@@ -5,7 +5,11 @@
 #include <fc/reflect/reflect.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
 
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/level_database.hpp>
+#include <bts/db/write_batch.hpp>
 #include <bts/db/upgrade_leveldb.hpp>
 
 namespace bts { namespace db {
@@ -17,11 +21,16 @@ namespace bts { namespace db {
    *
    *
    *  @note Key must be a POD type
+   *
+   *  Tables inside of a level_database store their keys with key_encoding<Key> when it is
+   *  defined so that they can be compared bytewise.
    */
   template<typename Key, typename Value>
   class level_pod_map
   {
      public:
+        level_pod_map():_shared(nullptr),_bytewise(false){}
+
         void open( const fc::path& dir, bool create = true )
         {
            ldb::Options opts;
@@ -47,32 +56,76 @@ namespace bts { namespace db {
            try_upgrade_db(dir,ndb, fc::get_typename<Value>::name(),sizeof(Value));
         }
 
+        /**
+         *  Attaches this map as table_id of db, this must be called before db is opened.
+         */
+        void open( level_database& db, uint8_t table_id )
+        {
+           _bytewise = key_encoding<Key>::is_defined;
+           db.register_table( table_id, _bytewise ? nullptr : &_comparer );
+           _shared = &db;
+           _prefix = std::string( 1, char(table_id) );
+        }
+
+        bool is_open()const { return !!_db || (_shared != nullptr && _shared->is_open()); }
+
         void close()
         {
+          if( _batch.active() )
+             wlog( "closing database with ${n} uncommitted writes", ("n",_batch.size()) );
+          _batch.abort();
           _db.reset();
+          _shared = nullptr;
+          _prefix.clear();
+          _bytewise = false;
+        }
+
+        /**
+         *  Defers all stores and removes until the outermost commit_batch(), fetch and
+         *  fetch_optional see the deferred writes while iterators only see committed data.
+         *  Tables in a level_database share the batch of the database.
+         */
+        void start_batch()
+        {
+           if( _shared ) _shared->start_batch();
+           else _batch.start();
+        }
+
+        void commit_batch( bool sync = false )
+        {
+           if( _shared ) _shared->commit_batch( sync );
+           else _batch.commit( _db.get(), sync );
+        }
+
+        /** discards all deferred writes */
+        void abort_batch()
+        {
+           if( _shared ) _shared->abort_batch();
+           else _batch.abort();
         }
 
-        fc::optional<Value> fetch_optional( const Key& k )
+        fc::optional<Value> fetch_optional( const Key& key )
         {
-           auto itr = find( k );
-           if( itr.valid() ) return itr.value();
-           return fc::optional<Value>();
+          try {
+             std::string value;
+             if( !get_value( key, value ) )
+                return fc::optional<Value>();
+
+             fc::datastream<const char*> datastream(value.c_str(), value.size());
+             Value tmp;
+             fc::raw::unpack(datastream, tmp);
+             return tmp;
+          } FC_RETHROW_EXCEPTIONS( warn, "error fetching key ${key}", ("key",key) );
         }
 
         Value fetch( const Key& key )
         {
           try {
-             ldb::Slice key_slice( (char*)&key, sizeof(key) );
              std::string value;
-             auto status = _db->Get( ldb::ReadOptions(), key_slice, &value );
-             if( status.IsNotFound() )
+             if( !get_value( key, value ) )
              {
                FC_THROW_EXCEPTION( key_not_found_exception, "unable to find key ${key}", ("key",key) );
              }
-             if( !status.ok() )
-             {
-                 FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
-             }
              fc::datastream<const char*> datastream(value.c_str(), value.size());
              Value tmp;
              fc::raw::unpack(datastream, tmp);
@@ -83,16 +136,15 @@ namespace bts { namespace db {
         class iterator
         {
            public:
-             iterator(){}
+             iterator():_bytewise(false){}
              bool valid()const 
              {
-                return _it && _it->Valid(); 
+                return _it && _it->Valid() && _it->key().starts_with( _prefix ); 
              }
 
              Key key()const
              {
-                 FC_ASSERT( sizeof(Key) == _it->key().size() );
-                 return *((Key*)_it->key().data());
+                 return unpack_key( *_it, _prefix, _bytewise );
              }
 
              Value value()const
@@ -108,15 +160,18 @@ namespace bts { namespace db {
            
            protected:
              friend class level_pod_map;
-             iterator( ldb::Iterator* it )
-             :_it(it){}
+             iterator( ldb::Iterator* it, const std::string& prefix, bool bytewise )
+             :_it(it),_prefix(prefix),_bytewise(bytewise){}
 
              std::shared_ptr<ldb::Iterator> _it;
+             std::string                    _prefix;
+             bool                           _bytewise;
         };
         iterator begin() 
         { try {
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
-           itr._it->SeekToFirst();
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
+           if( _prefix.size() ) itr._it->Seek( _prefix );
+           else itr._it->SeekToFirst();
 
            if( itr._it->status().IsNotFound() )
            {
@@ -137,8 +192,8 @@ namespace bts { namespace db {
 
         iterator find( const Key& key )
         { try {
-           ldb::Slice key_slice( (char*)&key, sizeof(key) );
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           std::string key_slice = pack_key( key );
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
            itr._it->Seek( key_slice );
            if( itr.valid() && itr.key() == key ) 
            {
@@ -149,8 +204,8 @@ namespace bts { namespace db {
 
         iterator lower_bound( const Key& key )
         { try {
-           ldb::Slice key_slice( (char*)&key, sizeof(key) );
-           iterator itr( _db->NewIterator( ldb::ReadOptions() ) );
+           std::string key_slice = pack_key( key );
+           iterator itr( get_db()->NewIterator( ldb::ReadOptions() ), _prefix, _bytewise );
            itr._it->Seek( key_slice );
            if( itr.valid()  ) 
            {
@@ -163,15 +218,13 @@ namespace bts { namespace db {
         bool last( Key& k )
         {
           try {
-             std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+             std::unique_ptr<ldb::Iterator> it( get_db()->NewIterator( ldb::ReadOptions() ) );
              FC_ASSERT( it != nullptr );
-             it->SeekToLast();
-             if( !it->Valid() )
+             if( !seek_to_last( *it ) )
              {
                return false;
              }
-             FC_ASSERT( sizeof( Key) == it->key().size() );
-             k = *((Key*)it->key().data());
+             k = unpack_key( *it, _prefix, _bytewise );
              return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -179,18 +232,16 @@ namespace bts { namespace db {
         bool last( Key& k, Value& v )
         {
           try {
-           std::unique_ptr<ldb::Iterator> it( _db->NewIterator( ldb::ReadOptions() ) );
+           std::unique_ptr<ldb::Iterator> it( get_db()->NewIterator( ldb::ReadOptions() ) );
            FC_ASSERT( it != nullptr );
-           it->SeekToLast();
-           if( !it->Valid() )
+           if( !seek_to_last( *it ) )
            {
              return false;
            }
            fc::datastream<const char*> ds( it->value().data(), it->value().size() );
            fc::raw::unpack( ds, v );
 
-           FC_ASSERT( sizeof( Key) == it->key().size() );
-           k = *((Key*)it->key().data());
+           k = unpack_key( *it, _prefix, _bytewise );
            return true;
           } FC_RETHROW_EXCEPTIONS( warn, "error reading last item from database" );
         }
@@ -199,9 +250,22 @@ namespace bts { namespace db {
         {
           try
           {
-             ldb::Slice ks( (char*)&k, sizeof(k) );
+             FC_ASSERT( is_open() );
+             std::string kslice = pack_key( k );
+             ldb::Slice ks( kslice.data(), kslice.size() );
              auto vec = fc::raw::pack(v);
              ldb::Slice vs( vec.data(), vec.size() );
+
+             if( _shared )
+             {
+                _shared->put( ks, vs );
+                return;
+             }
+             if( _batch.active() )
+             {
+                _batch.put( ks, vs );
+                return;
+             }
              
              auto status = _db->Put( ldb::WriteOptions(), ks, vs );
              if( !status.ok() )
@@ -215,7 +279,21 @@ namespace bts { namespace db {
         {
           try
           {
-            ldb::Slice ks( (char*)&k, sizeof(k) );
+            FC_ASSERT( is_open() );
+            std::string kslice = pack_key( k );
+            ldb::Slice ks( kslice.data(), kslice.size() );
+
+            if( _shared )
+            {
+               _shared->remove( ks );
+               return;
+            }
+            if( _batch.active() )
+            {
+               _batch.remove( ks );
+               return;
+            }
+
             auto status = _db->Delete( ldb::WriteOptions(), ks );
 
             if( status.IsNotFound() )
@@ -231,6 +309,58 @@ namespace bts { namespace db {
         
 
      private:
+        ldb::DB* get_db()const
+        {
+           if( _shared ) return _shared->get_db();
+           return _db.get();
+        }
+
+        std::string pack_key( const Key& k )const
+        {
+           std::string kslice = _prefix;
+           if( _bytewise ) key_encoding<Key>::encode( kslice, k );
+           else kslice.append( (const char*)&k, sizeof(k) );
+           return kslice;
+        }
+
+        static Key unpack_key( const ldb::Iterator& it, const std::string& prefix, bool bytewise )
+        {
+           if( bytewise )
+           {
+              Key tmp_key;
+              fc::datastream<const char*> ds( it.key().data() + prefix.size(), it.key().size() - prefix.size() );
+              key_encoding<Key>::decode( ds, tmp_key );
+              return tmp_key;
+           }
+           FC_ASSERT( sizeof(Key) + prefix.size() == it.key().size() );
+           return *((Key*)(it.key().data() + prefix.size()));
+        }
+
+        bool get_value( const Key& k, std::string& value )
+        {
+           std::string kslice = pack_key( k );
+           ldb::Slice ks( kslice.data(), kslice.size() );
+           if( _shared )
+              return _shared->get( ks, value );
+           return _batch.get( _db.get(), ks, value );
+        }
+
+        /** positions it on the last key of this table, returns false if the table is empty */
+        bool seek_to_last( ldb::Iterator& it )const
+        {
+           if( _prefix.empty() || uint8_t(_prefix[0]) == 0xff )
+           {
+              it.SeekToLast();
+           }
+           else
+           {
+              it.Seek( std::string( 1, char(uint8_t(_prefix[0]) + 1) ) );
+              if( it.Valid() ) it.Prev();
+              else it.SeekToLast();
+           }
+           return it.Valid() && it.key().starts_with( _prefix );
+        }
+
         class key_compare : public leveldb::Comparator
         {
           public:
@@ -250,6 +380,10 @@ namespace bts { namespace db {
         };
 
         key_compare                  _comparer;
+        level_database*              _shared;
+        std::string                  _prefix;
+        bool                         _bytewise;
+        write_batch                  _batch;
         std::unique_ptr<leveldb::DB> _db;
         
   };
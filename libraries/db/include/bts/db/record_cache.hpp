@@ -0,0 +1,116 @@
+#pragma once
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+#include <list>
+#include <unordered_map>
+
+namespace bts { namespace db {
+
+  struct record_cache_stats
+  {
+     record_cache_stats():hits(0),misses(0),size(0),max_size(0){}
+
+     uint64_t hits;
+     uint64_t misses;
+     uint64_t size;
+     uint64_t max_size;
+  };
+
+  /**
+   *  @brief a size bounded, least recently used cache of decoded database records
+   *
+   *  The cache does not read or write the database, it is kept coherent by its owner
+   *  storing every write through it.  A key may be cached as absent (an empty optional)
+   *  so that repeated lookups of records that do not exist are also served from memory.
+   *  A max_size of 0 disables the cache.
+   */
+  template<typename Key, typename Value, typename Hash = std::hash<Key> >
+  class record_cache
+  {
+     public:
+        record_cache( size_t max_size = 0 ):_max_size(max_size),_hits(0),_misses(0){}
+
+        void set_max_size( size_t max_size )
+        {
+           _max_size = max_size;
+           trim();
+        }
+
+        /** @return nullptr if the key is not cached, otherwise the cached record or an empty optional if it does not exist */
+        const fc::optional<Value>* find( const Key& k )
+        {
+           auto itr = _index.find( k );
+           if( itr == _index.end() )
+           {
+              if( _max_size > 0 ) ++_misses;
+              return nullptr;
+           }
+           ++_hits;
+           _lru.splice( _lru.begin(), _lru, itr->second );
+           return &itr->second->second;
+        }
+
+        void store( const Key& k, const fc::optional<Value>& v )
+        {
+           if( _max_size == 0 ) return;
+
+           auto itr = _index.find( k );
+           if( itr != _index.end() )
+           {
+              itr->second->second = v;
+              _lru.splice( _lru.begin(), _lru, itr->second );
+              return;
+           }
+           _lru.push_front( std::make_pair( k, v ) );
+           _index[k] = _lru.begin();
+           trim();
+        }
+
+        void remove( const Key& k )
+        {
+           auto itr = _index.find( k );
+           if( itr == _index.end() ) return;
+           _lru.erase( itr->second );
+           _index.erase( itr );
+        }
+
+        /** drops every record, used when writes that were stored in the cache are rolled back */
+        void clear()
+        {
+           _lru.clear();
+           _index.clear();
+        }
+
+        record_cache_stats get_stats()const
+        {
+           record_cache_stats stats;
+           stats.hits     = _hits;
+           stats.misses   = _misses;
+           stats.size     = _index.size();
+           stats.max_size = _max_size;
+           return stats;
+        }
+
+     private:
+        typedef std::list< std::pair<Key, fc::optional<Value> > > lru_list;
+
+        void trim()
+        {
+           while( _index.size() > _max_size )
+           {
+              _index.erase( _lru.back().first );
+              _lru.pop_back();
+           }
+        }
+
+        size_t                                                        _max_size;
+        uint64_t                                                      _hits;
+        uint64_t                                                      _misses;
+        lru_list                                                      _lru;
+        std::unordered_map<Key, typename lru_list::iterator, Hash>    _index;
+  };
+
+} } // bts::db
+
+FC_REFLECT( bts::db::record_cache_stats, (hits)(misses)(size)(max_size) )
@@ -0,0 +1,47 @@
+#pragma once
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <fc/optional.hpp>
+
+#include <string>
+#include <unordered_map>
+
+namespace bts { namespace db {
+
+  namespace ldb = leveldb;
+
+  /**
+   *  @brief collects puts and removes for a Level DB instance and writes them with a single
+   *  call to DB::Write()
+   *
+   *  Batches may be nested, only the outermost commit() writes to disk.  Lookups made
+   *  through get() see the pending writes of the batch before those in the database.
+   */
+  class write_batch
+  {
+     public:
+        write_batch():_depth(0){}
+
+        void start();
+        /** writes the batch to db once the outermost batch is committed */
+        void commit( ldb::DB* db, bool sync = false );
+        /** discards all pending writes regardless of nesting depth */
+        void abort();
+        bool active()const { return _depth > 0; }
+        size_t size()const { return _pending.size(); }
+
+        void put( const ldb::Slice& key, const ldb::Slice& value );
+        void remove( const ldb::Slice& key );
+
+        /** @return false if the key is not found in the pending writes or in db */
+        bool get( ldb::DB* db, const ldb::Slice& key, std::string& value )const;
+
+     private:
+        uint32_t                                                       _depth;
+        ldb::WriteBatch                                                _batch;
+        /** the values written in the current batch, an invalid optional is a pending remove */
+        std::unordered_map< std::string, fc::optional<std::string> >   _pending;
+  };
+
+} } // bts::db
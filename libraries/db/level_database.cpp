@@ -0,0 +1,128 @@
+#include <bts/db/level_database.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <string.h>
+
+namespace bts { namespace db {
+
+    level_database::table_compare::table_compare()
+    {
+       memset( _tables, 0, sizeof(_tables) );
+    }
+
+    int level_database::table_compare::Compare( const ldb::Slice& a, const ldb::Slice& b )const
+    {
+       if( a.size() == 0 || b.size() == 0 )
+          return a.compare( b );
+
+       uint8_t table_a = uint8_t(a[0]);
+       uint8_t table_b = uint8_t(b[0]);
+       if( table_a != table_b )
+          return table_a < table_b ? -1 : 1;
+
+       ldb::Slice key_a( a.data() + 1, a.size() - 1 );
+       ldb::Slice key_b( b.data() + 1, b.size() - 1 );
+       // a bare table prefix is used to seek to the start of a table and sorts before all of its keys
+       if( _tables[table_a] == nullptr || key_a.size() == 0 || key_b.size() == 0 )
+          return key_a.compare( key_b );
+       return _tables[table_a]->Compare( key_a, key_b );
+    }
+
+    level_database::level_database()
+    :_has_custom_compare(false){}
+
+    level_database::~level_database()
+    {
+       close();
+    }
+
+    void level_database::register_table( uint8_t table_id, const ldb::Comparator* compare )
+    {
+       FC_ASSERT( !is_open(), "tables must be registered before the database is opened" );
+       FC_ASSERT( _comparer._tables[table_id] == nullptr || _comparer._tables[table_id] == compare,
+                  "table ${id} is already registered", ("id",table_id) );
+       _comparer._tables[table_id] = compare;
+       if( compare != nullptr ) _has_custom_compare = true;
+    }
+
+    void level_database::open( const fc::path& dir, bool create )
+    {
+       ldb::Options opts;
+       opts.create_if_missing = create;
+       opts.comparator = & _comparer;
+
+       // bloom filters hash the raw key bytes so they are only valid when equal keys have equal bytes
+       if( !_has_custom_compare )
+       {
+          _filter.reset( ldb::NewBloomFilterPolicy( 10 ) );
+          opts.filter_policy = _filter.get();
+       }
+
+       /// \waring Given path must exist to succeed toNativeAnsiPath
+       fc::create_directories(dir);
+
+       std::string ldb_path = dir.to_native_ansi_path();
+
+       ldb::DB* ndb = nullptr;
+       auto ntrxstat = ldb::DB::Open( opts, ldb_path.c_str(), &ndb );
+       if( !ntrxstat.ok() )
+       {
+           FC_THROW_EXCEPTION( db_in_use_exception, "Unable to open database ${db}\n\t${msg}",
+                ("db",dir)
+                ("msg",ntrxstat.ToString())
+                );
+       }
+       _db.reset(ndb);
+    }
+
+    void level_database::close()
+    {
+       if( _batch.active() )
+          wlog( "closing database with ${n} uncommitted writes", ("n",_batch.size()) );
+       _batch.abort();
+       _db.reset();
+       _filter.reset();
+       memset( _comparer._tables, 0, sizeof(_comparer._tables) );
+       _has_custom_compare = false;
+    }
+
+    void level_database::put( const ldb::Slice& key, const ldb::Slice& value )
+    {
+       FC_ASSERT( _db != nullptr );
+       if( _batch.active() )
+       {
+          _batch.put( key, value );
+          return;
+       }
+
+       auto status = _db->Put( ldb::WriteOptions(), key, value );
+       if( !status.ok() )
+       {
+           FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+       }
+    }
+
+    void level_database::remove( const ldb::Slice& key )
+    {
+       FC_ASSERT( _db != nullptr );
+       if( _batch.active() )
+       {
+          _batch.remove( key );
+          return;
+       }
+
+       auto status = _db->Delete( ldb::WriteOptions(), key );
+       if( !status.ok() )
+       {
+           FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+       }
+    }
+
+    bool level_database::get( const ldb::Slice& key, std::string& value )const
+    {
+       FC_ASSERT( _db != nullptr );
+       return _batch.get( _db.get(), key, value );
+    }
+
+} } // bts::db
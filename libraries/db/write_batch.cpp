@@ -0,0 +1,77 @@
+#include <bts/db/write_batch.hpp>
+#include <fc/exception/exception.hpp>
+
+namespace bts { namespace db {
+
+    void write_batch::start()
+    {
+       ++_depth;
+    }
+
+    void write_batch::commit( ldb::DB* db, bool sync )
+    {
+       FC_ASSERT( _depth > 0, "no batch in progress" );
+       if( --_depth > 0 )
+          return;
+
+       if( db != nullptr && !_pending.empty() )
+       {
+          ldb::WriteOptions opts;
+          opts.sync = sync;
+          auto status = db->Write( opts, &_batch );
+          if( !status.ok() )
+          {
+              abort();
+              FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+          }
+       }
+       _batch.Clear();
+       _pending.clear();
+    }
+
+    void write_batch::abort()
+    {
+       _depth = 0;
+       _batch.Clear();
+       _pending.clear();
+    }
+
+    void write_batch::put( const ldb::Slice& key, const ldb::Slice& value )
+    {
+       FC_ASSERT( active() );
+       _batch.Put( key, value );
+       _pending[ key.ToString() ] = value.ToString();
+    }
+
+    void write_batch::remove( const ldb::Slice& key )
+    {
+       FC_ASSERT( active() );
+       _batch.Delete( key );
+       _pending[ key.ToString() ] = fc::optional<std::string>();
+    }
+
+    bool write_batch::get( ldb::DB* db, const ldb::Slice& key, std::string& value )const
+    {
+       if( !_pending.empty() )
+       {
+          auto itr = _pending.find( key.ToString() );
+          if( itr != _pending.end() )
+          {
+             if( !itr->second.valid() ) return false;
+             value = *itr->second;
+             return true;
+          }
+       }
+
+       FC_ASSERT( db != nullptr );
+       auto status = db->Get( ldb::ReadOptions(), key, &value );
+       if( status.IsNotFound() )
+          return false;
+       if( !status.ok() )
+       {
+           FC_THROW_EXCEPTION( exception, "database error: ${msg}", ("msg", status.ToString() ) );
+       }
+       return true;
+    }
+
+} } // bts::db
@@ -1,6 +1,6 @@
 #pragma once
 
-#define BTS_NET_PROTOCOL_VERSION 101
+#define BTS_NET_PROTOCOL_VERSION 102
 
 /** 
  * Define this to enable debugging code in the p2p network interface.
@@ -14,3 +14,53 @@
  * 512 kb
  */
 #define MAX_MESSAGE_SIZE (524288)  
+
+/**
+ * During sync, the most block ids requested from a peer in one fetch_items_message
+ */
+#define BTS_NET_MAX_SYNC_ITEMS_PER_REQUEST 50
+
+/**
+ * Bounds on the number of sync blocks requested from a single peer at once.  Between them
+ * the window follows the number of blocks the peer delivers in one round trip.
+ */
+#define BTS_NET_MIN_SYNC_WINDOW 2
+#define BTS_NET_MAX_SYNC_WINDOW 500
+
+/**
+ * Sync blocks not delivered within this many seconds are requested from another peer
+ */
+#define BTS_NET_SYNC_REQUEST_TIMEOUT_SEC 30
+
+/**
+ * The most sync blocks we hold or have requested while waiting for the blocks before them
+ */
+#define BTS_NET_MAX_SYNC_BACKLOG_SIZE 2000
+
+/**
+ * The most blocks received during normal operation that wait to be passed to the client,
+ * no more blocks are requested from peers while the queue is full
+ */
+#define BTS_NET_MAX_BLOCK_APPLY_QUEUE_SIZE 16
+
+/**
+ * The most bytes of data encrypted and authenticated as one stcp_socket record
+ */
+#define BTS_NET_MAX_RECORD_SIZE 16384
+
+/**
+ * Size of the buffer each connection reads from its socket into, several small messages
+ * are parsed from one read.  It holds a whole record so records are decrypted straight into it.
+ */
+#define BTS_NET_RECEIVE_BUFFER_SIZE BTS_NET_MAX_RECORD_SIZE
+
+/**
+ * How long closing a connection waits for the messages already queued to be sent
+ */
+#define BTS_NET_CLOSE_SEND_QUEUE_TIMEOUT_SEC 5
+
+/**
+ * The most bytes of messages a connection queues for a peer that isn't reading them,
+ * the peer is disconnected when a message would exceed it
+ */
+#define BTS_NET_MAX_SEND_QUEUE_SIZE (64 * MAX_MESSAGE_SIZE)
@@ -27,6 +27,7 @@ namespace bts { namespace net {
     void bind(const fc::ip::endpoint& local_endpoint);
     void connect_to(const fc::ip::endpoint& remote_endpoint);
 
+    /** queues the message and returns without waiting for it to be written to the socket */
     void send_message(const message& message_to_send);
     void close_connection();
 
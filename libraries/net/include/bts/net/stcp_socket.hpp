@@ -3,8 +3,13 @@
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/elliptic.hpp>
 
+#include <memory>
+#include <vector>
+
 namespace bts { namespace net {
 
+namespace detail { class record_cipher; }
+
 /**
  *  Uses ECDH to negotiate a aes key for communicating
  *  with other nodes on the network.
@@ -12,7 +17,16 @@ namespace bts { namespace net {
 class stcp_socket : public virtual fc::iostream
 {
   public:
-    stcp_socket();
+    /** how the stream is encrypted after the key exchange, both ends must use the same */
+    enum transport_type
+    {
+      /** AES-256-CBC over the whole stream, reads and writes must be a multiple of 16 bytes */
+      aes_stream,
+      /** length prefixed AES-256-GCM records that are authenticated as they are received */
+      aes_gcm_records
+    };
+
+    stcp_socket( transport_type transport = aes_gcm_records );
     ~stcp_socket();
     fc::tcp_socket&  get_socket() { return _sock; }
     void             accept();
@@ -31,13 +45,26 @@ class stcp_socket : public virtual fc::iostream
 
   private:
     void do_key_exchange();
+    size_t read_record( char* buffer, size_t max );
+    size_t write_record( const char* buffer, size_t len );
 
+    transport_type       _transport;
     fc::ecc::private_key _priv_key;
-    fc::array<char,8>    _buf;
-    uint32_t             _buf_len;
     fc::tcp_socket       _sock;
     fc::aes_encoder      _send_aes;
     fc::aes_decoder      _recv_aes;
+
+    std::unique_ptr<detail::record_cipher> _send_cipher;
+    std::unique_ptr<detail::record_cipher> _recv_cipher;
+    /// encrypted bytes received from the socket, holds at least one whole record
+    std::vector<char>    _recv_buffer;
+    size_t               _recv_buffer_start;
+    size_t               _recv_buffer_end;
+    /// the part of the last decrypted record that didn't fit in the caller's buffer
+    std::vector<char>    _recv_plaintext;
+    size_t               _recv_plaintext_pos;
+    /// the record being written, reused for every record
+    std::vector<char>    _send_buffer;
 };
 
 typedef std::shared_ptr<stcp_socket> stcp_socket_ptr;
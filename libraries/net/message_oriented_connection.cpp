@@ -1,6 +1,4 @@
 #include <fc/thread/thread.hpp>
-#include <fc/thread/mutex.hpp>
-#include <fc/thread/scoped_lock.hpp>
 #include <fc/thread/future.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/io/enum_type.hpp>
@@ -9,6 +7,8 @@
 #include <bts/net/stcp_socket.hpp>
 #include <bts/net/config.hpp>
 
+#include <algorithm>
+
 namespace bts { namespace net {
   namespace detail
   {
@@ -23,12 +23,19 @@ namespace bts { namespace net {
       uint64_t _bytes_sent;
       fc::time_point _last_message_received_time;
       fc::time_point _last_message_sent_time;
-      fc::mutex _send_mutex;
 
+      /// data read from the socket but not yet parsed into messages, reused for every read
+      std::vector<char> _receive_buffer;
 
+      /// framed messages waiting to be written by the send loop
+      std::vector<char> _send_queue;
+      /// the messages the send loop is writing, swapped with _send_queue so both keep their capacity
+      std::vector<char> _send_buffer;
+      fc::future<void> _send_queued_messages_done;
 
       void read_loop();
       void start_read_loop();
+      void send_queued_messages();
     public:
       fc::tcp_socket& get_socket();
       void accept();
@@ -36,6 +43,7 @@ namespace bts { namespace net {
       void bind(const fc::ip::endpoint& local_endpoint);
 
       message_oriented_connection_impl(message_oriented_connection* self, message_oriented_connection_delegate* delegate = nullptr);
+      ~message_oriented_connection_impl();
       void send_message(const message& message_to_send);
       void close_connection();
       uint64_t get_total_bytes_sent() const;
@@ -48,10 +56,26 @@ namespace bts { namespace net {
       _self(self),
       _delegate(delegate),
       _bytes_received(0),
-      _bytes_sent(0)
+      _bytes_sent(0),
+      _receive_buffer(BTS_NET_RECEIVE_BUFFER_SIZE)
     {
     }
 
+    message_oriented_connection_impl::~message_oriented_connection_impl()
+    {
+      if (_send_queued_messages_done.valid() && !_send_queued_messages_done.ready())
+      {
+        try
+        {
+          _send_queued_messages_done.cancel();
+          _send_queued_messages_done.wait();
+        }
+        catch (const fc::exception&)
+        {
+        }
+      }
+    }
+
     fc::tcp_socket& message_oriented_connection_impl::get_socket()
     {
       return _sock.get_socket();
@@ -75,33 +99,52 @@ namespace bts { namespace net {
     }
 
 
+    /**
+     *  Reads as much as the socket has available into _receive_buffer and parses every
+     *  message in it, so small messages arriving together cost one read.  Only the part of a
+     *  large message that didn't fit in the buffer is read separately, straight into the
+     *  message.  Every message is padded to a multiple of 16 bytes by the sender and is read
+     *  in whole 16 byte blocks, so a parsed message always ends on a 16 byte boundary of the
+     *  buffer and a message header never straddles two reads.
+     */
     void message_oriented_connection_impl::read_loop()
     {
-      const int BUFFER_SIZE = 16;
-      const int LEFTOVER = BUFFER_SIZE - sizeof(message_header);
-      assert(BUFFER_SIZE >= sizeof(message_header));
+      static_assert(BTS_NET_RECEIVE_BUFFER_SIZE % 16 == 0, "receive buffer must hold whole cipher blocks");
 
       try 
       {
         message m;
+        size_t buffer_start = 0;
+        size_t buffer_end = 0;
         while( true )
         {
-          char buffer[BUFFER_SIZE];
-          _sock.read(buffer, BUFFER_SIZE);
-          _bytes_received += BUFFER_SIZE;
-          memcpy((char*)&m, buffer, sizeof(message_header));
+          if (buffer_start == buffer_end)
+          {
+            buffer_start = 0;
+            buffer_end = _sock.readsome(_receive_buffer.data(), _receive_buffer.size());
+            _bytes_received += buffer_end;
+          }
+          FC_ASSERT( (buffer_end - buffer_start) % 16 == 0, 
+                     "received ${bytes} bytes that are not whole 16 byte blocks", ("bytes", buffer_end - buffer_start) );
+
+          const char* frame = _receive_buffer.data() + buffer_start;
+          memcpy((char*)static_cast<message_header*>(&m), frame, sizeof(message_header));
+          FC_ASSERT( m.size <= MAX_MESSAGE_SIZE, "message size ${size} is too large", ("size", m.size) );
 
-          assert( m.size <= MAX_MESSAGE_SIZE );
+          size_t size_with_padding = 16 * ((sizeof(message_header) + m.size + 15) / 16);
+          size_t bytes_buffered = std::min(size_with_padding, buffer_end - buffer_start);
+          size_t body_bytes_buffered = std::min<size_t>(m.size, bytes_buffered - sizeof(message_header));
+          m.data.assign(frame + sizeof(message_header), frame + sizeof(message_header) + body_bytes_buffered);
+          buffer_start += bytes_buffered;
 
-          size_t remaining_bytes_with_padding = 16 * ((m.size - LEFTOVER + 15) / 16);
-          m.data.resize(LEFTOVER + remaining_bytes_with_padding); //give extra 16 bytes to allow for padding added in send call
-          std::copy(buffer + sizeof(message_header), buffer + sizeof(buffer), m.data.begin());
-          if (remaining_bytes_with_padding)
+          if (bytes_buffered < size_with_padding)
           {
-            _sock.read(&m.data[LEFTOVER], remaining_bytes_with_padding);
+            size_t remaining_bytes_with_padding = size_with_padding - bytes_buffered;
+            m.data.resize(body_bytes_buffered + remaining_bytes_with_padding);
+            _sock.read(&m.data[body_bytes_buffered], remaining_bytes_with_padding);
             _bytes_received += remaining_bytes_with_padding;
+            m.data.resize(m.size); // truncate off the padding bytes
           }
-          m.data.resize(m.size); // truncate off the padding bytes
 
           _last_message_received_time = fc::time_point::now();
 
@@ -144,6 +187,12 @@ namespace bts { namespace net {
       }
     }
 
+    /**
+     *  Appends the message, padded to a multiple of 16 bytes, to the send queue and returns
+     *  without waiting for the socket.  Messages queued while the send loop is writing are
+     *  written together with one flush.  A peer that lets BTS_NET_MAX_SEND_QUEUE_SIZE bytes
+     *  queue up is disconnected.
+     */
     void message_oriented_connection_impl::send_message(const message& message_to_send)
     {
       try 
@@ -151,19 +200,79 @@ namespace bts { namespace net {
         size_t size_of_message_and_header = sizeof(message_header) + message_to_send.size;
         //pad the message we send to a multiple of 16 bytes
         size_t size_with_padding = 16 * ((size_of_message_and_header + 15) / 16);
-        std::unique_ptr<char[]> padded_message(new char[size_with_padding]);
-        memcpy(padded_message.get(), (char*)&message_to_send, sizeof(message_header));
-        memcpy(padded_message.get() + sizeof(message_header), message_to_send.data.data(), message_to_send.size );
-        fc::scoped_lock<fc::mutex> lock(_send_mutex);
-        _sock.write(padded_message.get(), size_with_padding);
-        _sock.flush();
-        _bytes_sent += size_with_padding;
-        _last_message_sent_time = fc::time_point::now();
+        if (_send_queue.size() + size_with_padding > BTS_NET_MAX_SEND_QUEUE_SIZE)
+        {
+          // closing the socket ends the read loop, which reports the closed connection
+          wlog("disconnecting a peer that has ${bytes} bytes of messages queued", ("bytes", _send_queue.size()));
+          _send_queue.clear();
+          try
+          {
+            _sock.close();
+          }
+          catch (const fc::exception&)
+          {
+          }
+          return;
+        }
+        size_t frame_offset = _send_queue.size();
+        _send_queue.resize(frame_offset + size_with_padding);
+        char* frame = _send_queue.data() + frame_offset;
+        memcpy(frame, (const char*)static_cast<const message_header*>(&message_to_send), sizeof(message_header));
+        memcpy(frame + sizeof(message_header), message_to_send.data.data(), message_to_send.size);
+
+        if (!_send_queued_messages_done.valid() || _send_queued_messages_done.ready())
+          _send_queued_messages_done = fc::async([=](){ send_queued_messages(); });
       } FC_RETHROW_EXCEPTIONS( warn, "unable to send message" );    
     }
 
+    void message_oriented_connection_impl::send_queued_messages()
+    {
+      try
+      {
+        while (!_send_queue.empty())
+        {
+          _send_buffer.clear();
+          std::swap(_send_queue, _send_buffer);
+          _sock.write(_send_buffer.data(), _send_buffer.size());
+          _sock.flush();
+          _bytes_sent += _send_buffer.size();
+          _last_message_sent_time = fc::time_point::now();
+        }
+      }
+      catch (const fc::canceled_exception&)
+      {
+        throw;
+      }
+      catch (const fc::exception& e)
+      {
+        // closing the socket ends the read loop, which reports the closed connection
+        wlog("unable to send message ${e}", ("e", e.to_detail_string()));
+        _send_queue.clear();
+        try
+        {
+          _sock.close();
+        }
+        catch (const fc::exception&)
+        {
+        }
+      }
+    }
+
+    /** gives the messages already queued, like a rejection, a chance to reach the peer */
     void message_oriented_connection_impl::close_connection()
     {
+      if (_send_queued_messages_done.valid() && !_send_queued_messages_done.ready())
+      {
+        try
+        {
+          _send_queued_messages_done.wait(fc::seconds(BTS_NET_CLOSE_SEND_QUEUE_TIMEOUT_SEC));
+        }
+        catch (const fc::timeout_exception&)
+        {
+          wlog("closing connection with ${bytes} bytes unsent", ("bytes", _send_queue.size() + _send_buffer.size()));
+          _send_queued_messages_done.cancel();
+        }
+      }
       _sock.close();
     }
 
@@ -94,6 +94,11 @@ namespace bts { namespace net {
       bool we_need_sync_items_from_peer;
       fc::optional<boost::tuple<item_id, fc::time_point> > item_ids_requested_from_peer; /// we check this to detect a timed-out request and in busy()
       item_to_time_map_type sync_items_requested_from_peer; /// ids of blocks we've requested from this peer during sync.  fetch from another peer if this peer disconnects
+      item_to_time_map_type sync_items_reassigned_from_peer; /// sync requests that timed out and were sent to another peer, still accepted if this peer delivers them late
+      uint32_t sync_window; /// how many sync blocks we keep requested from this peer
+      fc::microseconds sync_round_trip_time; /// smoothed time between requesting sync blocks and the first one arriving
+      fc::microseconds sync_block_interval; /// smoothed time between sync blocks arriving back to back
+      fc::time_point last_sync_block_time;
       /// @}
 
       /// non-synchronization state data
@@ -112,6 +117,7 @@ namespace bts { namespace net {
         number_of_unfetched_item_ids(0),
         peer_needs_sync_items_from_us(true),
         we_need_sync_items_from_peer(true),
+        sync_window(BTS_NET_MIN_SYNC_WINDOW),
         is_firewalled(boost::indeterminate)
       {}
       ~peer_connection() {}
@@ -284,7 +290,9 @@ namespace bts { namespace net {
       fc::future<void>       _fetch_sync_items_loop_done;
       typedef std::unordered_map<bts::blockchain::block_id_type, fc::time_point> active_sync_requests_map;
       active_sync_requests_map              _active_sync_requests; /// list of sync blocks we've asked for from peers but have not yet received
-      std::list<bts::client::block_message> _received_sync_items; /// list of sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+      typedef std::unordered_map<bts::blockchain::block_id_type, bts::client::block_message> received_sync_items_map;
+      received_sync_items_map _received_sync_items; /// sync blocks we've received, but can't yet process because we are still missing blocks that come earlier in the chain
+      size_t                  _max_sync_backlog_depth; /// the most blocks _received_sync_items has held
       // @}
 
       /// used by the task that fetches items during normal operation
@@ -300,6 +308,22 @@ namespace bts { namespace net {
       items_to_fetch_set_type _items_to_fetch; /// list of items we know another peer has and we want
       // @}
 
+      /// used by the task that passes received blocks to the client, so that the peers' read
+      /// loops only queue blocks and keep running between blocks while the client validates them
+      // @{
+      struct block_to_apply
+      {
+        peer_connection_ptr originating_peer;
+        message             block_message;
+        message_hash_type   message_hash;
+        fc::time_point      receive_time;
+      };
+      fc::promise<void>::ptr    _retrigger_apply_blocks_loop_promise;
+      bool                      _blocks_to_apply_updated;
+      fc::future<void>          _apply_blocks_loop_done;
+      std::deque<block_to_apply> _blocks_to_apply; /// blocks received during normal operation, in the order they arrived
+      // @}
+
       /// used by the task that advertises inventory during normal operation
       // @{
       fc::promise<void>::ptr _retrigger_advertise_inventory_loop_promise;
@@ -333,6 +357,7 @@ namespace bts { namespace net {
       std::unordered_set<peer_connection_ptr>                     _closing_connections;
       
       boost::circular_buffer<item_hash_t> _most_recent_blocks_accepted; // the /n/ most recent blocks we've accepted (currently tuned to the max number of connections)
+      std::unordered_multiset<item_hash_t> _most_recent_blocks_accepted_set; // the contents of _most_recent_blocks_accepted, for lookups
       uint32_t _total_number_of_unfetched_items; /// the number of items we still need to fetch while syncing
 
       blockchain_tied_message_cache _message_cache; /// cache message we have received and might be required to provide to other peers via inventory requests
@@ -350,7 +375,13 @@ namespace bts { namespace net {
       void trigger_p2p_network_connect_loop();
 
       bool have_already_received_sync_item(const item_hash_t& item_hash);
-      void request_sync_item_from_peer(const peer_connection_ptr& peer, const item_hash_t& item_to_request);
+      bool have_recently_accepted_block(const item_hash_t& block_id) const;
+      void record_accepted_block(const item_hash_t& block_id);
+      void prune_sync_backlog();
+      void request_sync_items_from_peer(const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request);
+      void reassign_timed_out_sync_requests();
+      void release_sync_requests(peer_connection* peer);
+      void update_sync_window(peer_connection* peer, fc::time_point request_time);
       void fetch_sync_items_loop();
       void trigger_fetch_sync_items_loop();
 
@@ -388,7 +419,10 @@ namespace bts { namespace net {
       void on_item_ids_inventory_message(peer_connection* originating_peer, const item_ids_inventory_message& item_ids_inventory_message_received);
       void on_connection_closed(peer_connection* originating_peer);
 
-      void process_backlog_of_sync_blocks();
+      void apply_blocks_loop();
+      void trigger_apply_blocks_loop();
+      bool apply_next_sync_block();
+      void apply_block_during_normal_operation(const block_to_apply& block);
       void process_block_during_sync(peer_connection* originating_peer, const message& block_message, const message_hash_type& message_hash);
       void process_block_during_normal_operation(peer_connection* originating_peer, const message& block_message, const message_hash_type& message_hash);
   
@@ -569,6 +603,8 @@ namespace bts { namespace net {
       _peer_connection_retry_timeout(60 * 5),
       _peer_inactivity_timeout(45),
       _most_recent_blocks_accepted(_maximum_number_of_connections),
+      _max_sync_backlog_depth(0),
+      _blocks_to_apply_updated(false),
       _total_number_of_unfetched_items(0),
       _user_agent_string("bts::net::node")
     {
@@ -703,18 +739,114 @@ namespace bts { namespace net {
 
     bool node_impl::have_already_received_sync_item(const item_hash_t& item_hash)
     {
-      return std::find_if(_received_sync_items.begin(), _received_sync_items.end(), 
-                          [&item_hash](const bts::client::block_message& message) { return message.block_id == item_hash; }) != _received_sync_items.end();
+      return _received_sync_items.find(item_hash) != _received_sync_items.end();
+    }
+
+    bool node_impl::have_recently_accepted_block(const item_hash_t& block_id) const
+    {
+      return _most_recent_blocks_accepted_set.find(block_id) != _most_recent_blocks_accepted_set.end();
+    }
+
+    void node_impl::record_accepted_block(const item_hash_t& block_id)
+    {
+      if (_most_recent_blocks_accepted.full())
+        _most_recent_blocks_accepted_set.erase(_most_recent_blocks_accepted_set.find(_most_recent_blocks_accepted.front()));
+      _most_recent_blocks_accepted.push_back(block_id);
+      _most_recent_blocks_accepted_set.insert(block_id);
+    }
+
+    /** drops backlog blocks that no peer offers anymore, they can never become the next block */
+    void node_impl::prune_sync_backlog()
+    {
+      std::unordered_set<item_hash_t> offered_items;
+      for (const peer_connection_ptr& peer : _active_connections)
+        offered_items.insert(peer->ids_of_items_to_get.begin(), peer->ids_of_items_to_get.end());
+      for (auto iter = _received_sync_items.begin(); iter != _received_sync_items.end(); )
+      {
+        if (offered_items.find(iter->first) == offered_items.end())
+          iter = _received_sync_items.erase(iter);
+        else
+          ++iter;
+      }
     }
 
-    void node_impl::request_sync_item_from_peer(const peer_connection_ptr& peer, const item_hash_t& item_to_request)
+    void node_impl::request_sync_items_from_peer(const peer_connection_ptr& peer, const std::vector<item_hash_t>& items_to_request)
     {
-      ilog("requesting item ${item_hash} from peer ${endpoint}", ("item_hash", item_to_request)("endpoint", peer->get_remote_endpoint()));
-      item_id item_id_to_request(bts::client::block_message_type, item_to_request);
-      _active_sync_requests.insert(active_sync_requests_map::value_type(item_to_request, fc::time_point::now()));
-      peer->sync_items_requested_from_peer.insert(peer_connection::item_to_time_map_type::value_type(item_id_to_request, fc::time_point::now()));
-      std::vector<item_hash_t> items_to_fetch;
-      peer->send_message(fetch_items_message(item_id_to_request.item_type, std::vector<item_hash_t>{item_id_to_request.item_hash}));
+      ilog("requesting ${count} items starting with ${item_hash} from peer ${endpoint}", 
+           ("count", items_to_request.size())("item_hash", items_to_request.front())("endpoint", peer->get_remote_endpoint()));
+      fc::time_point now = fc::time_point::now();
+      for (const item_hash_t& item_to_request : items_to_request)
+      {
+        _active_sync_requests[item_to_request] = now;
+        peer->sync_items_requested_from_peer[item_id(bts::client::block_message_type, item_to_request)] = now;
+      }
+      peer->send_message(fetch_items_message(bts::client::block_message_type, items_to_request));
+    }
+
+    void node_impl::reassign_timed_out_sync_requests()
+    {
+      fc::time_point timeout_threshold = fc::time_point::now() - fc::seconds(BTS_NET_SYNC_REQUEST_TIMEOUT_SEC);
+      for (const peer_connection_ptr& peer : _active_connections)
+      {
+        bool timed_out = false;
+        for (auto iter = peer->sync_items_requested_from_peer.begin(); iter != peer->sync_items_requested_from_peer.end(); )
+        {
+          if (iter->second < timeout_threshold)
+          {
+            _active_sync_requests.erase(iter->first.item_hash);
+            peer->sync_items_reassigned_from_peer.insert(*iter);
+            iter = peer->sync_items_requested_from_peer.erase(iter);
+            timed_out = true;
+          }
+          else
+            ++iter;
+        }
+        if (timed_out)
+        {
+          wlog("sync requests to peer ${endpoint} timed out, requesting them from other peers", ("endpoint", peer->get_remote_endpoint()));
+          peer->sync_window = BTS_NET_MIN_SYNC_WINDOW;
+          peer->sync_block_interval = fc::microseconds();
+        }
+      }
+    }
+
+    /** makes the blocks requested from peer available to request from other peers */
+    void node_impl::release_sync_requests(peer_connection* peer)
+    {
+      for (const auto& item : peer->sync_items_requested_from_peer)
+        _active_sync_requests.erase(item.first.item_hash);
+      peer->sync_items_requested_from_peer.clear();
+      peer->sync_items_reassigned_from_peer.clear();
+      trigger_fetch_sync_items_loop();
+    }
+
+    /** 
+     * sizes the window to the number of blocks the peer delivers in one round trip, plus one 
+     * so that the next request is already queued when a round trip completes
+     */
+    void node_impl::update_sync_window(peer_connection* peer, fc::time_point request_time)
+    {
+      fc::time_point now = fc::time_point::now();
+      // a block requested after the previous one arrived starts a reply, otherwise it followed the previous block
+      if (peer->last_sync_block_time < request_time)
+      {
+        int64_t sample = (now - request_time).count();
+        int64_t average = peer->sync_round_trip_time.count();
+        peer->sync_round_trip_time = fc::microseconds(average ? (7 * average + sample) / 8 : sample);
+      }
+      else
+      {
+        int64_t sample = (now - peer->last_sync_block_time).count();
+        int64_t average = peer->sync_block_interval.count();
+        peer->sync_block_interval = fc::microseconds(average ? (7 * average + sample) / 8 : sample);
+      }
+      peer->last_sync_block_time = now;
+
+      if (peer->sync_block_interval.count() > 0)
+      {
+        int64_t window = peer->sync_round_trip_time.count() / peer->sync_block_interval.count() + 1;
+        peer->sync_window = (uint32_t)std::min<int64_t>(std::max<int64_t>(window, BTS_NET_MIN_SYNC_WINDOW), BTS_NET_MAX_SYNC_WINDOW);
+      }
     }
 
     void node_impl::fetch_sync_items_loop()
@@ -724,43 +856,66 @@ namespace bts { namespace net {
         _sync_items_to_fetch_updated = false;
         ilog("beginning another iteration of the sync items loop");
 
-        std::map<peer_connection_ptr, item_hash_t> sync_item_requests_to_send;
+        reassign_timed_out_sync_requests();
+
+        std::map<peer_connection_ptr, std::vector<item_hash_t> > sync_item_requests_to_send;
         std::set<item_hash_t> sync_items_to_request;
 
-        // for each idle peer that we're syncing with
+        // blocks we request may have to wait in the backlog, leave room for them.  The first block
+        // of a peer's list is always requested, nothing can leave the backlog without it.
+        size_t backlog_room = BTS_NET_MAX_SYNC_BACKLOG_SIZE - std::min<size_t>(BTS_NET_MAX_SYNC_BACKLOG_SIZE, 
+                                                                               _received_sync_items.size() + _active_sync_requests.size());
+
+        // for each peer that we're syncing with and that has room in its window
         for (const peer_connection_ptr& peer : _active_connections)
         {
-          if (peer->we_need_sync_items_from_peer && 
-              sync_item_requests_to_send.find(peer) == sync_item_requests_to_send.end() && // if we've already scheduled a request for this peer, don't consider scheduling another
-              peer->idle())
+          if (!peer->we_need_sync_items_from_peer || 
+              peer->sync_items_requested_from_peer.size() >= peer->sync_window)
+            continue;
+          uint32_t items_to_request = std::min<uint32_t>(peer->sync_window - peer->sync_items_requested_from_peer.size(),
+                                                         BTS_NET_MAX_SYNC_ITEMS_PER_REQUEST);
+          std::vector<item_hash_t>& items_for_peer = sync_item_requests_to_send[peer];
+
+          // loop through the items it has that we don't yet have on our blockchain, the ones we 
+          // pick are consecutive unless another peer is already fetching some of them
+          for (unsigned i = 0; i < peer->ids_of_items_to_get.size() && items_for_peer.size() < items_to_request && 
+                               (i == 0 || sync_items_to_request.size() < backlog_room); ++i)
           {
-            // loop through the items it has that we don't yet have on our blockchain
-            for (unsigned i = 0; i < peer->ids_of_items_to_get.size(); ++i)
+            item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
+            // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
+            if (!have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
+                sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
+                _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end()) // we've requested it in a previous iteration and we're still waiting for it to arrive
             {
-              item_hash_t item_to_potentially_request = peer->ids_of_items_to_get[i];
-              // if we don't already have this item in our temporary storage and we haven't requested from another syncing peer
-              if (!have_already_received_sync_item(item_to_potentially_request) && // already got it, but for some reson it's still in our list of items to fetch
-                  sync_items_to_request.find(item_to_potentially_request) == sync_items_to_request.end() &&  // we have already decided to request it from another peer during this iteration
-                  _active_sync_requests.find(item_to_potentially_request) == _active_sync_requests.end()) // we've requested it in a previous iteration and we're still waiting for it to arrive
-              {
-                // then schedule a request from this peer
-                sync_item_requests_to_send[peer] = item_to_potentially_request;
-                sync_items_to_request.insert(item_to_potentially_request);
-                break;
-              }
+              // then schedule a request from this peer
+              items_for_peer.push_back(item_to_potentially_request);
+              sync_items_to_request.insert(item_to_potentially_request);
             }
           }
         }
 
         // make all the requests we scheduled in the loop above
         for (auto sync_item_request : sync_item_requests_to_send)
-          request_sync_item_from_peer(sync_item_request.first, sync_item_request.second);
+          if (!sync_item_request.second.empty())
+            request_sync_items_from_peer(sync_item_request.first, sync_item_request.second);
 
         if (!_sync_items_to_fetch_updated)
         {
-          ilog("no sync items to fetch right now, going to sleep");
-          _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr(new fc::promise<void>());
-          _retrigger_fetch_sync_items_loop_promise->wait();
+          // wake up in time to reassign requests that time out
+          try
+          {
+            _retrigger_fetch_sync_items_loop_promise = fc::promise<void>::ptr(new fc::promise<void>());
+            if (_active_sync_requests.empty())
+            {
+              ilog("no sync items to fetch right now, going to sleep");
+              _retrigger_fetch_sync_items_loop_promise->wait();
+            }
+            else
+              _retrigger_fetch_sync_items_loop_promise->wait_until(fc::time_point::now() + fc::seconds(BTS_NET_SYNC_REQUEST_TIMEOUT_SEC / 2));
+          }
+          catch (fc::timeout_exception&)
+          {
+          }
           _retrigger_fetch_sync_items_loop_promise.reset();
         }
       }
@@ -783,6 +938,14 @@ namespace bts { namespace net {
 
         for (auto iter = _items_to_fetch.begin(); iter != _items_to_fetch.end(); )
         {
+          // blocks we already have wait to be applied, don't fetch more until there is room for them
+          if (iter->item_type == bts::client::block_message_type &&
+              _blocks_to_apply.size() >= BTS_NET_MAX_BLOCK_APPLY_QUEUE_SIZE)
+          {
+            ++iter;
+            continue;
+          }
+
           bool item_fetched = false;
           for (const peer_connection_ptr& peer : _active_connections)
           {
@@ -825,6 +988,46 @@ namespace bts { namespace net {
         _retrigger_fetch_item_loop_promise->set_value();
     }
 
+    void node_impl::apply_blocks_loop()
+    {
+      for (;;)
+      {
+        _blocks_to_apply_updated = false;
+
+        // blocks from peers in normal operation go first, they are the newest blocks of the chain
+        bool block_applied = false;
+        if (!_blocks_to_apply.empty())
+        {
+          block_to_apply next_block = _blocks_to_apply.front();
+          _blocks_to_apply.pop_front();
+          apply_block_during_normal_operation(next_block);
+          trigger_fetch_items_loop();
+          block_applied = true;
+        }
+        else
+          block_applied = apply_next_sync_block();
+
+        if (block_applied)
+        {
+          // let the peers' read loops run before validating the next block
+          fc::yield();
+        }
+        else if (!_blocks_to_apply_updated)
+        {
+          _retrigger_apply_blocks_loop_promise = fc::promise<void>::ptr(new fc::promise<void>());
+          _retrigger_apply_blocks_loop_promise->wait();
+          _retrigger_apply_blocks_loop_promise.reset();
+        }
+      }
+    }
+
+    void node_impl::trigger_apply_blocks_loop()
+    {
+      _blocks_to_apply_updated = true;
+      if (_retrigger_apply_blocks_loop_promise)
+        _retrigger_apply_blocks_loop_promise->set_value();
+    }
+
     void node_impl::advertise_inventory_loop()
     {
       for (;;)
@@ -1575,6 +1778,7 @@ namespace bts { namespace net {
       auto sync_item_iter = originating_peer->sync_items_requested_from_peer.find(item_not_available_message_received.requested_item);
       if (sync_item_iter != originating_peer->sync_items_requested_from_peer.end())
       {
+        _active_sync_requests.erase(sync_item_iter->first.item_hash);
         originating_peer->sync_items_requested_from_peer.erase(sync_item_iter);
         ilog("Peer doesn't have the requested sync item.  This reqlly shouldn't happen");
         trigger_fetch_sync_items_loop();
@@ -1626,6 +1830,7 @@ namespace bts { namespace net {
     void node_impl::on_connection_closed(peer_connection* originating_peer)
     {
       peer_connection_ptr originating_peer_ptr = originating_peer->shared_from_this();
+      release_sync_requests(originating_peer);
       if (_closing_connections.find(originating_peer_ptr) != _closing_connections.end())
         _closing_connections.erase(originating_peer_ptr);
       else if (_active_connections.find(originating_peer_ptr) != _active_connections.end())
@@ -1637,144 +1842,132 @@ namespace bts { namespace net {
       trigger_p2p_network_connect_loop();
     }
 
-    void node_impl::process_backlog_of_sync_blocks()
+    /** passes the next sync block to the client if we have it, @return true if there was one */
+    bool node_impl::apply_next_sync_block()
     {
-      bool block_processed_this_iteration;
-      do
+      // the next blocks we can hand directly to the client are the first items of the sync peers' lists
+      auto received_block_iter = _received_sync_items.end();
+      for (const peer_connection_ptr& peer : _active_connections)
+        if (!peer->ids_of_items_to_get.empty())
+        {
+          received_block_iter = _received_sync_items.find(peer->ids_of_items_to_get.front());
+          if (received_block_iter != _received_sync_items.end())
+            break;
+        }
+
+      // if we have one, process it, remove it from all sync peers lists
+      if (received_block_iter != _received_sync_items.end())
       {
-        block_processed_this_iteration = false;
-        for (auto received_block_iter = _received_sync_items.begin(); 
-             received_block_iter != _received_sync_items.end(); 
-             ++received_block_iter)
+        bts::client::block_message block_message_to_process = received_block_iter->second;
+        _received_sync_items.erase(received_block_iter);
+
+        bool client_accepted_block = false;
+        try
         {
-          // find out if this block is the next block that we can hand directly to the client
-          bool potential_first_block = false;
-          for (const peer_connection_ptr& peer : _active_connections)
-            if (!peer->ids_of_items_to_get.empty() &&
-                peer->ids_of_items_to_get.front() == received_block_iter->block_id)
-            {
-              potential_first_block = true;
-              break;
-            }
+          ilog("sync: this block is a potential first block, passing it to the client");
 
-          // if it is, process it, remove it from all sync peers lists
-          if (potential_first_block)
+          // we can get into an intersting situation near the end of synchronization.  We can be in
+          // sync with one peer who is sending us the last block on the chain via a regular inventory
+          // message, while at the same time still be synchronizing with a peer who is sending us the
+          // block through the sync mechanism.  Further, we must request both blocks because 
+          // we don't know they're the same (for the peer in normal operation, it has only told us the
+          // message id, for the peer in the sync case we only known the block_id).
+          if (!have_recently_accepted_block(block_message_to_process.block_id))
           {
-            bts::client::block_message block_message_to_process = *received_block_iter;
-            _received_sync_items.erase(received_block_iter);
-
-            bool client_accepted_block = false;
-            try
-            {
-              ilog("sync: this block is a potential first block, passing it to the client");
-
-              // we can get into an intersting situation near the end of synchronization.  We can be in
-              // sync with one peer who is sending us the last block on the chain via a regular inventory
-              // message, while at the same time still be synchronizing with a peer who is sending us the
-              // block through the sync mechanism.  Further, we must request both blocks because 
-              // we don't know they're the same (for the peer in normal operation, it has only told us the
-              // message id, for the peer in the sync case we only known the block_id).
-              if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(),
-                            block_message_to_process.block_id) == _most_recent_blocks_accepted.end())
-              {
-                _delegate->handle_message(block_message_to_process);
-                // TODO: only record as accepted if it has a valid signature.
-                _most_recent_blocks_accepted.push_back(block_message_to_process.block_id);
-              }
-              else
-                ilog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
+            _delegate->handle_message(block_message_to_process);
+            // TODO: only record as accepted if it has a valid signature.
+            record_accepted_block(block_message_to_process.block_id);
+          }
+          else
+            ilog("Already received and accepted this block (presumably through normal inventory mechanism), treating it as accepted");
 
-              client_accepted_block = true;
-            }
-            catch (fc::exception&)
-            {
-              wlog("sync: client rejected sync block sent by peer");
-            }
+          client_accepted_block = true;
+        }
+        catch (fc::exception&)
+        {
+          wlog("sync: client rejected sync block sent by peer");
+        }
 
-            if (client_accepted_block)
+        if (client_accepted_block)
+        {
+          --_total_number_of_unfetched_items;
+          ilog("sync: client accpted the block, we now have only ${count} items left to fetch before we're in sync", ("count", _total_number_of_unfetched_items));
+          std::set<peer_connection_ptr> peers_with_newly_empty_item_lists;
+          std::set<peer_connection_ptr> peers_we_need_to_sync_to;
+          for (const peer_connection_ptr& peer : _active_connections)
+          {
+            if (peer->ids_of_items_to_get.empty())
             {
-              --_total_number_of_unfetched_items;
-              block_processed_this_iteration = true;
-              ilog("sync: client accpted the block, we now have only ${count} items left to fetch before we're in sync", ("count", _total_number_of_unfetched_items));
-              std::set<peer_connection_ptr> peers_with_newly_empty_item_lists;
-              std::set<peer_connection_ptr> peers_we_need_to_sync_to;
-              for (const peer_connection_ptr& peer : _active_connections)
+              ilog("Cannot pop first element off peer ${peer}'s list, its list is empty", ("peer", peer->get_remote_endpoint()));
+              // we don't know for sure that this peer has the item we just received.
+              // If peer is still syncing to us, we know they will ask us for
+              // sync item ids at least one more time and we'll notify them about
+              // the item then, so there's no need to do anything.  If we still need items
+              // from them, we'll be asking them for more items at some point, and
+              // that will clue them in that they are out of sync.  If we're fully in sync 
+              // we need to kick off another round of synchronization with them so they can 
+              // find out about the new item.
+              if (!peer->peer_needs_sync_items_from_us && !peer->we_need_sync_items_from_peer)
               {
-                if (peer->ids_of_items_to_get.empty())
-                {
-                  ilog("Cannot pop first element off peer ${peer}'s list, its list is empty", ("peer", peer->get_remote_endpoint()));
-                  // we don't know for sure that this peer has the item we just received.
-                  // If peer is still syncing to us, we know they will ask us for
-                  // sync item ids at least one more time and we'll notify them about
-                  // the item then, so there's no need to do anything.  If we still need items
-                  // from them, we'll be asking them for more items at some point, and
-                  // that will clue them in that they are out of sync.  If we're fully in sync 
-                  // we need to kick off another round of synchronization with them so they can 
-                  // find out about the new item.
-                  if (!peer->peer_needs_sync_items_from_us && !peer->we_need_sync_items_from_peer)
-                  {
-                    ilog("We will be restarting synchronization with peer ${peer}", ("peer", peer->get_remote_endpoint()));
-                    peers_we_need_to_sync_to.insert(peer);
-                  }
-                }
-                else
-                {
-                  if (peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
-                  {
-                    peer->ids_of_items_to_get.pop_front();
-                    ilog("Popped item from front of ${endpoint}'s sync list, new list length is ${len}", ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_to_get.size()));
-
-                    // if we just received the last item in our list from this peer, we will want to 
-                    // send another request to find out if we are in sync, but we can't do this yet
-                    // (we don't want to allow a fiber swap in the middle of popping items off the list)
-                    if (peer->ids_of_items_to_get.empty() && peer->number_of_unfetched_item_ids == 0)
-                      peers_with_newly_empty_item_lists.insert(peer);
-
-                    // in this case, we know the peer was offering us this exact item, no need to 
-                    // try to inform them of its existence
-                  }
-                  else
-                  {
-                    // the peer's list of sync items is nonempty, and its first item doesn't match
-                    // the one we just accepted.
-                    // 
-                    // This probably means that this peer is offering us garbage (its blockchain
-                    // should match everyone else's blockchain).  We could see this during a fork,
-                    // though.  I'm not certain if we've settled on what a fork looks like at this
-                    // level, so I'm just leaving the peer connected here.  If it turns out
-                    // that forks are impossible or won't effect sync behavior, we should disconnect 
-                    // the offending peer here.
-                    ilog("Cannot pop first element off peer ${peer}'s list, its first is ${hash}", ("peer", peer->get_remote_endpoint())("hash", peer->ids_of_items_to_get.front()));
-                  }
-                }
+                ilog("We will be restarting synchronization with peer ${peer}", ("peer", peer->get_remote_endpoint()));
+                peers_we_need_to_sync_to.insert(peer);
               }
-              for (const peer_connection_ptr& peer : peers_with_newly_empty_item_lists)
-                fetch_next_batch_of_item_ids_from_peer(peer.get(), item_id(bts::client::block_message_type, block_message_to_process.block_id));
-
-              for (const peer_connection_ptr& peer : peers_we_need_to_sync_to)
-                start_synchronizing_with_peer(peer);
             }
             else
             {
-              // invalid message received
-              std::list<peer_connection_ptr> peers_to_disconnect;
-              for (const peer_connection_ptr& peer : _active_connections)
-                if (!peer->ids_of_items_to_get.empty() &&
-                    peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
-                  peers_to_disconnect.push_back(peer);
-              for (const peer_connection_ptr& peer : peers_to_disconnect)
+              if (peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
               {
-                wlog("disconnecting client ${endpoint} because it offered us the rejected block", ("endpoint", peer->get_remote_endpoint()));
-                disconnect_from_peer(peer.get());
+                peer->ids_of_items_to_get.pop_front();
+                ilog("Popped item from front of ${endpoint}'s sync list, new list length is ${len}", ("endpoint", peer->get_remote_endpoint())("len", peer->ids_of_items_to_get.size()));
+
+                // if we just received the last item in our list from this peer, we will want to 
+                // send another request to find out if we are in sync, but we can't do this yet
+                // (we don't want to allow a fiber swap in the middle of popping items off the list)
+                if (peer->ids_of_items_to_get.empty() && peer->number_of_unfetched_item_ids == 0)
+                  peers_with_newly_empty_item_lists.insert(peer);
+
+                // in this case, we know the peer was offering us this exact item, no need to 
+                // try to inform them of its existence
               }
-              break;
-            }              
+              else
+              {
+                // the peer's list of sync items is nonempty, and its first item doesn't match
+                // the one we just accepted.
+                // 
+                // This probably means that this peer is offering us garbage (its blockchain
+                // should match everyone else's blockchain).  We could see this during a fork,
+                // though.  I'm not certain if we've settled on what a fork looks like at this
+                // level, so I'm just leaving the peer connected here.  If it turns out
+                // that forks are impossible or won't effect sync behavior, we should disconnect 
+                // the offending peer here.
+                ilog("Cannot pop first element off peer ${peer}'s list, its first is ${hash}", ("peer", peer->get_remote_endpoint())("hash", peer->ids_of_items_to_get.front()));
+              }
+            }
+          }
+          for (const peer_connection_ptr& peer : peers_with_newly_empty_item_lists)
+            fetch_next_batch_of_item_ids_from_peer(peer.get(), item_id(bts::client::block_message_type, block_message_to_process.block_id));
 
-            break; // start iterating _received_sync_items from the beginning
-          } // end if potential_first_block
-        } // end for each block in _received_sync_items
-      } while (block_processed_this_iteration);
-      ilog("Currently backlog is ${count} blocks", ("count", _received_sync_items.size()));
+          for (const peer_connection_ptr& peer : peers_we_need_to_sync_to)
+            start_synchronizing_with_peer(peer);
+          trigger_fetch_sync_items_loop();
+        }
+        else
+        {
+          // invalid message received
+          std::list<peer_connection_ptr> peers_to_disconnect;
+          for (const peer_connection_ptr& peer : _active_connections)
+            if (!peer->ids_of_items_to_get.empty() &&
+                peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
+              peers_to_disconnect.push_back(peer);
+          for (const peer_connection_ptr& peer : peers_to_disconnect)
+          {
+            wlog("disconnecting client ${endpoint} because it offered us the rejected block", ("endpoint", peer->get_remote_endpoint()));
+            disconnect_from_peer(peer.get());
+          }
+        }              
+        return true;
+      } // end if we have the next block
+      return false;
     }
 
     void node_impl::process_block_during_sync(peer_connection* originating_peer, const message& message_to_process, const message_hash_type& message_hash)
@@ -1784,25 +1977,47 @@ namespace bts { namespace net {
       bts::client::block_message block_message_to_process(message_to_process.as<bts::client::block_message>());
       
       // only process it if we asked for it
-      auto iter = originating_peer->sync_items_requested_from_peer.find(item_id(bts::client::block_message_type, block_message_to_process.block_id));
+      item_id block_item_id(bts::client::block_message_type, block_message_to_process.block_id);
+      auto iter = originating_peer->sync_items_requested_from_peer.find(block_item_id);
       if (iter == originating_peer->sync_items_requested_from_peer.end())
       {
-        wlog("received a sync block ${block_id} I didn't ask for from peer ${endpoint}, disconnecting from peer", 
-             ("endpoint", originating_peer->get_remote_endpoint())
-             ("block_id",block_message_to_process.block_id));
-        disconnect_from_peer(originating_peer);
-        return;
+        auto reassigned_iter = originating_peer->sync_items_reassigned_from_peer.find(block_item_id);
+        if (reassigned_iter == originating_peer->sync_items_reassigned_from_peer.end())
+        {
+          wlog("received a sync block ${block_id} I didn't ask for from peer ${endpoint}, disconnecting from peer", 
+               ("endpoint", originating_peer->get_remote_endpoint())
+               ("block_id",block_message_to_process.block_id));
+          disconnect_from_peer(originating_peer);
+          return;
+        }
+        ilog("received a sync block from peer ${endpoint} after its request timed out", ("endpoint", originating_peer->get_remote_endpoint()));
+        originating_peer->sync_items_reassigned_from_peer.erase(reassigned_iter);
       }
       else
       {
         ilog("received a sync block from peer ${endpoint}", ("endpoint", originating_peer->get_remote_endpoint()));
+        update_sync_window(originating_peer, iter->second);
         originating_peer->sync_items_requested_from_peer.erase(iter);
+        // a late reply from a peer whose request timed out leaves the live request to the other peer in place
+        _active_sync_requests.erase(block_message_to_process.block_id);
+      }
+
+      // a timed out request may be answered by both peers
+      if (have_already_received_sync_item(block_message_to_process.block_id) ||
+          have_recently_accepted_block(block_message_to_process.block_id))
+      {
+        trigger_fetch_sync_items_loop();
+        return;
       }
 
-      // add it to the front of _received_sync_items, then process _received_sync_items to try to 
+      // add it to _received_sync_items, then let the apply loop process _received_sync_items to try to 
       // pass as many messages as possible to the client.
-      _received_sync_items.push_front(block_message_to_process);
-      process_backlog_of_sync_blocks();
+      _received_sync_items[block_message_to_process.block_id] = block_message_to_process;
+      if (_received_sync_items.size() >= BTS_NET_MAX_SYNC_BACKLOG_SIZE)
+        prune_sync_backlog();
+      _max_sync_backlog_depth = std::max(_max_sync_backlog_depth, _received_sync_items.size());
+      ilog("Currently backlog is ${count} blocks (at most ${max})", ("count", _received_sync_items.size())("max", _max_sync_backlog_depth));
+      trigger_apply_blocks_loop();
 
       // we should be ready to request another block now
       trigger_fetch_sync_items_loop();
@@ -1816,7 +2031,6 @@ namespace bts { namespace net {
 
       assert(!originating_peer->we_need_sync_items_from_peer);
       assert(message_to_process.msg_type == bts::client::message_type_enum::block_message_type);
-      bts::client::block_message block_message_to_process(message_to_process.as<bts::client::block_message>());
       
       // only process it if we asked for it
       auto iter = originating_peer->items_requested_from_peer.find(item_id(bts::client::block_message_type, message_hash));
@@ -1828,63 +2042,70 @@ namespace bts { namespace net {
       }
       else
       {
-        ilog("received a block from peer ${endpoint}, passing it to client", ("endpoint", originating_peer->get_remote_endpoint()));
+        ilog("received a block from peer ${endpoint}, queueing it for the client", ("endpoint", originating_peer->get_remote_endpoint()));
         originating_peer->items_requested_from_peer.erase(iter);
-        trigger_fetch_items_loop();
 
-        try
+        block_to_apply block{originating_peer->shared_from_this(), message_to_process, message_hash, message_receive_time};
+        _blocks_to_apply.push_back(block);
+        trigger_apply_blocks_loop();
+      }
+    }
+
+    void node_impl::apply_block_during_normal_operation(const block_to_apply& block)
+    {
+      bts::client::block_message block_message_to_process(block.block_message.as<bts::client::block_message>());
+      const message_hash_type& message_hash = block.message_hash;
+      try
+      {
+        // we can get into an intersting situation near the end of synchronization.  We can be in
+        // sync with one peer who is sending us the last block on the chain via a regular inventory
+        // message, while at the same time still be synchronizing with a peer who is sending us the
+        // block through the sync mechanism.  Further, we must request both blocks because 
+        // we don't know they're the same (for the peer in normal operation, it has only told us the
+        // message id, for the peer in the sync case we only known the block_id).
+        fc::time_point message_validated_time;
+        if (!have_recently_accepted_block(block_message_to_process.block_id))
         {
-          // we can get into an intersting situation near the end of synchronization.  We can be in
-          // sync with one peer who is sending us the last block on the chain via a regular inventory
-          // message, while at the same time still be synchronizing with a peer who is sending us the
-          // block through the sync mechanism.  Further, we must request both blocks because 
-          // we don't know they're the same (for the peer in normal operation, it has only told us the
-          // message id, for the peer in the sync case we only known the block_id).
-          fc::time_point message_validated_time;
-          if (std::find(_most_recent_blocks_accepted.begin(), _most_recent_blocks_accepted.end(), 
-                        block_message_to_process.block_id) == _most_recent_blocks_accepted.end())
-          {
-            _delegate->handle_message(block_message_to_process);
-            message_validated_time = fc::time_point::now();
-            // TODO: only record it as accepted if it has a valid signature.
-            _most_recent_blocks_accepted.push_back(block_message_to_process.block_id);
-          }
-          else
-            ilog("Already received and accepted this block (presumably through sync mechanism), treating it as accepted");
+          _delegate->handle_message(block_message_to_process);
+          message_validated_time = fc::time_point::now();
+          // TODO: only record it as accepted if it has a valid signature.
+          record_accepted_block(block_message_to_process.block_id);
+        }
+        else
+          ilog("Already received and accepted this block (presumably through sync mechanism), treating it as accepted");
 
-          ilog("client validated the block, advertising it to other peers");
+        ilog("client validated the block, advertising it to other peers");
 
-          for (const peer_connection_ptr& peer : _active_connections)
+        for (const peer_connection_ptr& peer : _active_connections)
+        {
+          item_id block_message_item_id(bts::client::message_type_enum::block_message_type, message_hash);
+          auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
+          if (iter != peer->inventory_peer_advertised_to_us.end())
           {
-            item_id block_message_item_id(bts::client::message_type_enum::block_message_type, message_hash);
-            auto iter = peer->inventory_peer_advertised_to_us.find(block_message_item_id);
-            if (iter != peer->inventory_peer_advertised_to_us.end())
-            {
-              // this peer offered us the item; remove it from the list of items they offered us, and 
-              // add it to the list of items we've offered them.  That will prevent us from offering them
-              // the same item back (no reason to do that; we already know they have it)
-              peer->inventory_peer_advertised_to_us.erase(iter);
-              peer->inventory_advertised_to_peer.insert(block_message_item_id);
-            }
+            // this peer offered us the item; remove it from the list of items they offered us, and 
+            // add it to the list of items we've offered them.  That will prevent us from offering them
+            // the same item back (no reason to do that; we already know they have it)
+            peer->inventory_peer_advertised_to_us.erase(iter);
+            peer->inventory_advertised_to_peer.insert(block_message_item_id);
           }
-          message_propagation_data propagation_data{message_receive_time, message_validated_time, originating_peer->node_id};
-          broadcast(message_to_process, propagation_data);
-          _message_cache.block_accepted();
         }
-        catch (fc::exception&)
+        message_propagation_data propagation_data{block.receive_time, message_validated_time, block.originating_peer->node_id};
+        broadcast(block.block_message, propagation_data);
+        _message_cache.block_accepted();
+      }
+      catch (fc::exception&)
+      {
+        // client rejected the block.  Disconnect the client and any other clients that offered us this block
+        wlog("client rejected block sent by peer");
+        std::list<peer_connection_ptr> peers_to_disconnect;
+        for (const peer_connection_ptr& peer : _active_connections)
+          if (!peer->ids_of_items_to_get.empty() &&
+              peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
+            peers_to_disconnect.push_back(peer);
+        for (const peer_connection_ptr& peer : peers_to_disconnect)
         {
-          // client rejected the block.  Disconnect the client and any other clients that offered us this block
-          wlog("client rejected block sent by peer");
-          std::list<peer_connection_ptr> peers_to_disconnect;
-          for (const peer_connection_ptr& peer : _active_connections)
-            if (!peer->ids_of_items_to_get.empty() &&
-                peer->ids_of_items_to_get.front() == block_message_to_process.block_id)
-              peers_to_disconnect.push_back(peer);
-          for (const peer_connection_ptr& peer : peers_to_disconnect)
-          {
-            wlog("disconnecting client ${endpoint} because it offered us the rejected block", ("endpoint", peer->get_remote_endpoint()));
-            disconnect_from_peer(peer.get());
-          }
+          wlog("disconnecting client ${endpoint} because it offered us the rejected block", ("endpoint", peer->get_remote_endpoint()));
+          disconnect_from_peer(peer.get());
         }
       }
     }
@@ -2177,6 +2398,7 @@ namespace bts { namespace net {
       _p2p_network_connect_loop_done = fc::async([=]() { p2p_network_connect_loop(); });
       _fetch_sync_items_loop_done = fc::async([=]() { fetch_sync_items_loop(); });
       _fetch_item_loop_done = fc::async([=]() { fetch_items_loop(); });
+      _apply_blocks_loop_done = fc::async([=]() { apply_blocks_loop(); });
       _advertise_inventory_loop_done = fc::async([=]() { advertise_inventory_loop(); });
       _terminate_inactive_connections_loop_done = fc::async([=]() { terminate_inactive_connections_loop(); });
     }
@@ -2253,8 +2475,9 @@ namespace bts { namespace net {
       }
 
       ilog("--------- MEMORY USAGE ------------");
-      ilog("node._active_sync_requests size: ${size} (this is known to be broken)", ("size", _active_sync_requests.size())); // TODO: un-break this
+      ilog("node._active_sync_requests size: ${size}", ("size", _active_sync_requests.size()));
       ilog("node._received_sync_items size: ${size}", ("size", _received_sync_items.size()));
+      ilog("node._blocks_to_apply size: ${size}", ("size", _blocks_to_apply.size()));
       ilog("node._items_to_fetch size: ${size}", ("size", _items_to_fetch.size()));
       ilog("node._new_inventory size: ${size}", ("size", _new_inventory.size()));
       ilog("node._message_cache size: ${size}", ("size", _message_cache.size()));
@@ -2265,13 +2488,15 @@ namespace bts { namespace net {
         ilog("    peer.inventory_peer_advertised_to_us size: ${size}", ("size", peer->inventory_peer_advertised_to_us.size()));
         ilog("    peer.inventory_advertised_to_peer size: ${size}", ("size", peer->inventory_advertised_to_peer.size()));
         ilog("    peer.items_requested_from_peer size: ${size}", ("size", peer->items_requested_from_peer.size()));
-        ilog("    peer.sync_items_requested_from_peer size: ${size}", ("size", peer->sync_items_requested_from_peer.size()));
+        ilog("    peer.sync_items_requested_from_peer size: ${size} (window ${window})", ("size", peer->sync_items_requested_from_peer.size())("window", peer->sync_window));
+        ilog("    peer.sync_items_reassigned_from_peer size: ${size}", ("size", peer->sync_items_reassigned_from_peer.size()));
       }
       ilog("--------- END MEMORY USAGE ------------");
     }
 
     void node_impl::disconnect_from_peer(peer_connection* peer_to_disconnect)
     {
+      release_sync_requests(peer_to_disconnect);
       _closing_connections.insert(peer_to_disconnect->shared_from_this());
       _handshaking_connections.erase(peer_to_disconnect->shared_from_this());
       _active_connections.erase(peer_to_disconnect->shared_from_this());
@@ -2396,7 +2621,7 @@ namespace bts { namespace net {
       {
         bts::client::block_message block_message_to_broadcast = item_to_broadcast.as<bts::client::block_message>();
         hash_of_message_contents = block_message_to_broadcast.block_id; // for debugging
-        _most_recent_blocks_accepted.push_back(block_message_to_broadcast.block_id);
+        record_accepted_block(block_message_to_broadcast.block_id);
       }
       else if (item_to_broadcast.msg_type == bts::client::trx_message_type)
       {
@@ -2421,7 +2646,8 @@ namespace bts { namespace net {
     void node_impl::sync_from(const item_id& last_item_id_seen)
     {
       _most_recent_blocks_accepted.clear();
-      _most_recent_blocks_accepted.push_back(last_item_id_seen.item_hash);
+      _most_recent_blocks_accepted_set.clear();
+      record_accepted_block(last_item_id_seen.item_hash);
     }
 
     bool node_impl::is_connected() const
@@ -2485,6 +2711,9 @@ namespace bts { namespace net {
     {
       fc::mutable_variant_object info;
       info["listening_on"] = _actual_listening_endpoint;
+      info["sync_backlog_size"] = _received_sync_items.size();
+      info["max_sync_backlog_size"] = _max_sync_backlog_depth;
+      info["active_sync_requests"] = _active_sync_requests.size();
       return info;
     }
 
@@ -1,20 +1,109 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <limits>
 
 #include <fc/crypto/hex.hpp>
 #include <fc/crypto/aes.hpp>
 #include <fc/crypto/city.hpp>
+#include <fc/crypto/sha256.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/network/ip.hpp>
 #include <fc/exception/exception.hpp>
 
 #include <bts/net/stcp_socket.hpp>
+#include <bts/net/config.hpp>
+
+#include <openssl/evp.h>
 
 namespace bts { namespace net {
 
-stcp_socket::stcp_socket()
-:_buf_len(0)
+namespace detail
+{
+  /** the record length and the nonce are part of the wire format, so they are big endian on every host */
+  static void store_big_endian( unsigned char* out, uint64_t value, size_t size )
+  {
+    for( size_t i = size; i > 0; --i, value >>= 8 )
+      out[i - 1] = (unsigned char)(value & 0xff);
+  }
+
+  static uint64_t load_big_endian( const unsigned char* in, size_t size )
+  {
+    uint64_t value = 0;
+    for( size_t i = 0; i < size; ++i )
+      value = (value << 8) | in[i];
+    return value;
+  }
+
+  /**
+   *  AES-256-GCM for the records sent in one direction of a connection.  The key is only
+   *  used for this direction of this connection, so the nonce is the number of records
+   *  processed before.  The length prefix of a record is authenticated along with it.
+   */
+  class record_cipher
+  {
+    public:
+      static const size_t tag_size = 16;
+
+      record_cipher( const fc::sha256& key, bool encrypt )
+      :_ctx( EVP_CIPHER_CTX_new() ),_sequence(0)
+      {
+         FC_ASSERT( _ctx != nullptr );
+         FC_ASSERT( EVP_CipherInit_ex( _ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr, encrypt ? 1 : 0 ) == 1 );
+         FC_ASSERT( EVP_CIPHER_CTX_ctrl( _ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof(_nonce), nullptr ) == 1 );
+         FC_ASSERT( EVP_CipherInit_ex( _ctx, nullptr, nullptr, (const unsigned char*)key.data(), nullptr, -1 ) == 1 );
+      }
+      ~record_cipher()
+      {
+         EVP_CIPHER_CTX_free( _ctx );
+      }
+
+      /** writes len encrypted bytes followed by the tag to out */
+      void encrypt( const char* prefix, size_t prefix_len, const char* in, size_t len, char* out )
+      {
+         int out_len = 0;
+         start_record( prefix, prefix_len );
+         FC_ASSERT( EVP_CipherUpdate( _ctx, (unsigned char*)out, &out_len, (const unsigned char*)in, len ) == 1 );
+         FC_ASSERT( EVP_CipherFinal_ex( _ctx, (unsigned char*)out + out_len, &out_len ) == 1 );
+         FC_ASSERT( EVP_CIPHER_CTX_ctrl( _ctx, EVP_CTRL_GCM_GET_TAG, tag_size, out + len ) == 1 );
+      }
+
+      /** @return false if the record or its prefix was modified, in which case out is garbage */
+      bool decrypt( const char* prefix, size_t prefix_len, const char* in, size_t len, char* out )
+      {
+         int out_len = 0;
+         start_record( prefix, prefix_len );
+         FC_ASSERT( EVP_CipherUpdate( _ctx, (unsigned char*)out, &out_len, (const unsigned char*)in, len ) == 1 );
+         FC_ASSERT( EVP_CIPHER_CTX_ctrl( _ctx, EVP_CTRL_GCM_SET_TAG, tag_size, (void*)(in + len) ) == 1 );
+         return EVP_CipherFinal_ex( _ctx, (unsigned char*)out + out_len, &out_len ) == 1;
+      }
+
+    private:
+      void start_record( const char* prefix, size_t prefix_len )
+      {
+         // a nonce must never be used twice with the same key
+         FC_ASSERT( _sequence != std::numeric_limits<uint64_t>::max(), "record sequence number exhausted" );
+         memset( _nonce, 0, sizeof(_nonce) );
+         store_big_endian( _nonce + sizeof(_nonce) - sizeof(_sequence), _sequence, sizeof(_sequence) );
+         ++_sequence;
+         int out_len = 0;
+         FC_ASSERT( EVP_CipherInit_ex( _ctx, nullptr, nullptr, nullptr, _nonce, -1 ) == 1 );
+         FC_ASSERT( EVP_CipherUpdate( _ctx, nullptr, &out_len, (const unsigned char*)prefix, prefix_len ) == 1 );
+      }
+
+      EVP_CIPHER_CTX* _ctx;
+      uint64_t        _sequence;
+      unsigned char   _nonce[12];
+  };
+
+  static const size_t record_prefix_size = sizeof(uint32_t);
+} // namespace detail
+
+stcp_socket::stcp_socket( transport_type transport )
+:_transport(transport),
+ _recv_buffer_start(0),
+ _recv_buffer_end(0),
+ _recv_plaintext_pos(0)
 {
 }
 stcp_socket::~stcp_socket()
@@ -32,10 +121,26 @@ void stcp_socket::do_key_exchange()
 
   auto shared_secret = _priv_key.get_shared_secret( rpub );
 //    ilog("shared secret ${s}", ("s", shared_secret) );
-  _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
-                  fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
-  _recv_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
-                  fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
+  if( _transport == aes_stream )
+  {
+    _send_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
+                    fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
+    _recv_aes.init( fc::sha256::hash( (char*)&shared_secret, sizeof(shared_secret) ), 
+                    fc::city_hash_crc_128((char*)&shared_secret,sizeof(shared_secret) ) );
+    return;
+  }
+
+  // each direction gets its own key, so both ends can count nonces from zero
+  auto direction_key = [&]( const fc::ecc::public_key_data& sender )
+  {
+    fc::sha256::encoder enc;
+    enc.write( (char*)&shared_secret, sizeof(shared_secret) );
+    enc.write( (char*)&sender, sizeof(sender) );
+    return enc.result();
+  };
+  _send_cipher.reset( new detail::record_cipher( direction_key( s ), true ) );
+  _recv_cipher.reset( new detail::record_cipher( direction_key( rpub ), false ) );
+  _recv_buffer.resize( detail::record_prefix_size + BTS_NET_MAX_RECORD_SIZE + detail::record_cipher::tag_size );
 }
 
 
@@ -57,6 +162,9 @@ void stcp_socket::bind( const fc::ip::endpoint& local_endpoint )
  */
 size_t stcp_socket::readsome( char* buffer, size_t len )
 { try {
+    if( _transport == aes_gcm_records )
+      return read_record( buffer, len );
+
     assert( (len % 16) == 0 );
     assert( len >= 16 );
     char crypt_buf[4096];
@@ -77,8 +185,69 @@ bool stcp_socket::eof()const
   return _sock.eof();
 }
 
+/**
+ *  Returns the rest of the last record if the caller didn't have room for all of it,
+ *  otherwise reads until a whole record is buffered and decrypts it, straight into the
+ *  caller's buffer when it fits.  A single socket read usually brings several records.
+ */
+size_t stcp_socket::read_record( char* buffer, size_t len )
+{
+    if( _recv_plaintext_pos < _recv_plaintext.size() )
+    {
+      len = std::min( len, _recv_plaintext.size() - _recv_plaintext_pos );
+      memcpy( buffer, _recv_plaintext.data() + _recv_plaintext_pos, len );
+      _recv_plaintext_pos += len;
+      return len;
+    }
+
+    uint32_t record_size = 0;
+    while( true )
+    {
+      size_t buffered = _recv_buffer_end - _recv_buffer_start;
+      if( buffered >= detail::record_prefix_size )
+      {
+        record_size = (uint32_t)detail::load_big_endian( (const unsigned char*)_recv_buffer.data() + _recv_buffer_start,
+                                                         detail::record_prefix_size );
+        FC_ASSERT( record_size > 0 && record_size <= BTS_NET_MAX_RECORD_SIZE, 
+                   "invalid record size ${size}", ("size", record_size) );
+        if( buffered >= detail::record_prefix_size + record_size + detail::record_cipher::tag_size )
+          break;
+      }
+      if( _recv_buffer_end == _recv_buffer.size() )
+      {
+        memmove( _recv_buffer.data(), _recv_buffer.data() + _recv_buffer_start, buffered );
+        _recv_buffer_start = 0;
+        _recv_buffer_end = buffered;
+      }
+      _recv_buffer_end += _sock.readsome( _recv_buffer.data() + _recv_buffer_end, _recv_buffer.size() - _recv_buffer_end );
+    }
+
+    const char* record = _recv_buffer.data() + _recv_buffer_start;
+    char* plaintext = buffer;
+    if( len < record_size )
+    {
+      _recv_plaintext.resize( record_size );
+      plaintext = _recv_plaintext.data();
+    }
+    bool authentic = _recv_cipher->decrypt( record, detail::record_prefix_size, 
+                                            record + detail::record_prefix_size, record_size, plaintext );
+    FC_ASSERT( authentic, "received a record that failed authentication" );
+    _recv_buffer_start += detail::record_prefix_size + record_size + detail::record_cipher::tag_size;
+    if( _recv_buffer_start == _recv_buffer_end )
+      _recv_buffer_start = _recv_buffer_end = 0;
+
+    if( plaintext == buffer )
+      return record_size;
+    memcpy( buffer, plaintext, len );
+    _recv_plaintext_pos = len;
+    return len;
+}
+
 size_t stcp_socket::writesome( const char* buffer, size_t len )
 { try {
+    if( _transport == aes_gcm_records )
+      return write_record( buffer, len );
+
     assert( len % 16 == 0 );
     assert( len > 0 );
     char crypt_buf[4096];
@@ -99,6 +268,19 @@ size_t stcp_socket::writesome( const char* buffer, size_t len )
     return len;
 } FC_RETHROW_EXCEPTIONS( warn, "", ("len",len) ) }
 
+/** encrypts up to BTS_NET_MAX_RECORD_SIZE bytes of buffer as one record */
+size_t stcp_socket::write_record( const char* buffer, size_t len )
+{
+    FC_ASSERT( len > 0 );
+    uint32_t record_size = std::min<size_t>( len, BTS_NET_MAX_RECORD_SIZE );
+    _send_buffer.resize( detail::record_prefix_size + record_size + detail::record_cipher::tag_size );
+    detail::store_big_endian( (unsigned char*)_send_buffer.data(), record_size, detail::record_prefix_size );
+    _send_cipher->encrypt( _send_buffer.data(), detail::record_prefix_size, 
+                           buffer, record_size, _send_buffer.data() + detail::record_prefix_size );
+    _sock.write( _send_buffer.data(), _send_buffer.size() );
+    return record_size;
+}
+
 void stcp_socket::flush()
 {
    _sock.flush();
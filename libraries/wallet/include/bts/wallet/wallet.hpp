@@ -15,6 +15,15 @@ namespace bts { namespace wallet {
    /** args: current_block, last_block */
    typedef function<void(uint32_t,uint32_t)> scan_progress_callback;
 
+   /**
+    *  Decides whether the memo of a withdraw_by_account deposit may be addressed to the
+    *  account with the given address before trial decryption with its key is attempted.
+    *  It is called from the scanning threads and must not use the wallet.
+    *
+    *  args: deposit, account_address
+    */
+   typedef function<bool(const withdraw_by_account&,const address&)> deposit_filter;
+
    class wallet
    {
       public:
@@ -93,8 +102,14 @@ namespace bts { namespace wallet {
          void      clear_pending_transactions();
 
          void      scan_state();
+         /**
+          *  Blocks are fetched in order, the memos of their deposits are trial decrypted on
+          *  a pool of threads and the results are applied to the wallet in block order.
+          */
          void      scan_chain( uint32_t start = 0, uint32_t end = -1,
                               scan_progress_callback cb = scan_progress_callback() );
+         /** skips trial decryption of the deposits the filter rejects, in addition to the built in checks */
+         void      set_deposit_filter( deposit_filter filter );
          uint32_t  get_last_scanned_block_number()const;
 
          ///@{ account management
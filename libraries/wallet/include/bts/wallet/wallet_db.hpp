@@ -26,6 +26,13 @@ namespace bts { namespace wallet {
          
          bool is_open()const;
 
+         /**
+          *  Defers writes to the wallet file until the outermost commit_batch(), used to
+          *  store the many records produced by scanning with a single write.
+          */
+         void start_batch();
+         void commit_batch();
+
          template<typename T>
          void store_record( T t )
          {
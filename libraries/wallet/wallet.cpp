@@ -12,11 +12,39 @@
 #include <iostream>
 
 #include <algorithm>
+#include <thread>
 
 namespace bts { namespace wallet {
 
    namespace detail {
 
+      /** the memo of a withdraw_by_account deposit and the account key that decrypted it */
+      struct deposit_match
+      {
+         deposit_match( const memo_status& s, const private_key_type& k, const address& a )
+         :status(s),key(k),account_address(a){}
+
+         memo_status      status;
+         private_key_type key;
+         address          account_address;
+      };
+
+      /** the deposits of a block addressed to the wallet, by transaction and operation index */
+      typedef std::map< std::pair<uint32_t,uint32_t>, deposit_match > block_deposits;
+
+      /**
+       *  What the scanning threads need to find the deposits addressed to the wallet, copied
+       *  from the wallet when a scan starts so that they never touch it.  The wallet keeps one
+       *  until the account keys change, deriving the keys is the expensive part.
+       */
+      struct scan_keys
+      {
+         memo_key_set                       keys;
+         /** the account that owns each deposit already found, only its key has to be tried */
+         unordered_map<address,address>     known_owners;
+         deposit_filter                     filter;
+      };
+
       class wallet_impl : public chain_observer
       {
          public:
@@ -28,6 +56,11 @@ namespace bts { namespace wallet {
              fc::time_point     _scheduled_lock_time;
              fc::future<void>   _wallet_relocker_done;
              fc::sha512         _wallet_password;
+             deposit_filter     _deposit_filter;
+             /** valid until an account key is added or changed, or the wallet is locked */
+             scan_keys          _scan_keys;
+             bool               _scan_keys_valid = false;
+             std::vector< std::unique_ptr<fc::thread> > _scan_threads;
 
             /**
              * This method is called anytime the blockchain state changes including
@@ -42,22 +75,27 @@ namespace bts { namespace wallet {
             void block_applied( const block_summary& summary ) override
             {
                if( self->is_unlocked() )
-               {
-                  auto account_priv_keys = _wallet_db.get_account_private_keys( _wallet_password );
-                  scan_block( summary.block_data.block_num, account_priv_keys );
-               }
+                  scan_block( summary.block_data, find_deposits( summary.block_data, get_scan_keys() ) );
             }
 
              secret_hash_type get_secret( uint32_t block_num,
                                           const private_key_type& delegate_key )const;
 
-             void scan_block( uint32_t block_num, 
-                              const vector<private_key_type>& keys );
+             const scan_keys& get_scan_keys();
+             void             invalidate_scan_keys() { _scan_keys_valid = false; _scan_keys = scan_keys(); }
+
+             /** only reads its arguments, so it may run on any thread */
+             static block_deposits find_deposits( const full_block& block, const scan_keys& keys );
+
+             /** finds the deposits of each block on the scanning threads */
+             vector<block_deposits> find_deposits( const vector<full_block>& blocks, const scan_keys& keys );
+
+             void scan_block( const full_block& block, const block_deposits& deposits );
 
              bool scan_withdraw( const withdraw_operation& op );
 
              bool scan_deposit( wallet_transaction_record& trx_rec, const deposit_operation& op, 
-                                 const private_keys& keys );
+                                const deposit_match* match );
 
              bool scan_register_account( const register_account_operation& op );
              bool scan_update_account( const update_account_operation& op );
@@ -184,13 +222,110 @@ namespace bts { namespace wallet {
          return fc::ripemd160::hash( enc.result() );
       }
 
-      void wallet_impl::scan_block( uint32_t block_num, 
-                                    const private_keys& keys )
+      const scan_keys& wallet_impl::get_scan_keys()
+      {
+         if( !_scan_keys_valid )
+         {
+            _scan_keys.keys = memo_key_set( _wallet_db.get_account_private_keys( _wallet_password ) );
+            _scan_keys.known_owners.clear();
+            for( const auto& item : _wallet_db.keys )
+            {
+               if( item.second.account_address != address() )
+                  _scan_keys.known_owners[item.first] = item.second.account_address;
+            }
+            _scan_keys.filter = _deposit_filter;
+            _scan_keys_valid = true;
+         }
+         return _scan_keys;
+      }
+
+      block_deposits wallet_impl::find_deposits( const full_block& block, const scan_keys& keys )
+      { try {
+         block_deposits deposits;
+         for( uint32_t trx_num = 0; trx_num < block.user_transactions.size(); ++trx_num )
+         {
+            const auto& operations = block.user_transactions[trx_num].operations;
+            for( uint32_t op_num = 0; op_num < operations.size(); ++op_num )
+            {
+               if( operation_type_enum( operations[op_num].type ) != deposit_op_type )
+                  continue;
+               auto op = operations[op_num].as<deposit_operation>();
+               if( withdraw_condition_types( op.condition.type ) != withdraw_by_account_type )
+                  continue;
+
+               auto deposit = op.condition.as<withdraw_by_account>();
+               auto known_owner = keys.known_owners.find( deposit.owner );
+               for( uint32_t i = 0; i < keys.keys.size(); ++i )
+               {
+                  if( known_owner != keys.known_owners.end() && known_owner->second != keys.keys.get_address( i ) )
+                     continue;
+                  if( keys.filter && !keys.filter( deposit, keys.keys.get_address( i ) ) )
+                     continue;
+
+                  omemo_status status = keys.keys.decrypt_memo_data( deposit, i );
+                  if( status.valid() )
+                  {
+                     deposits.insert( std::make_pair( std::make_pair( trx_num, op_num ),
+                                                      deposit_match( *status, keys.keys.get_key( i ),
+                                                                     keys.keys.get_address( i ) ) ) );
+                     break;
+                  }
+               }
+            }
+         }
+         return deposits;
+      } FC_RETHROW_EXCEPTIONS( warn, "", ("block_num",block.block_num) ) }
+
+      vector<block_deposits> wallet_impl::find_deposits( const vector<full_block>& blocks, const scan_keys& keys )
+      {
+         vector<block_deposits> deposits( blocks.size() );
+         auto find = [&]( uint32_t first, uint32_t stride )
+         {
+            for( uint32_t i = first; i < blocks.size(); i += stride )
+               deposits[i] = find_deposits( blocks[i], keys );
+         };
+
+         if( blocks.size() < 2 || keys.keys.size() == 0 )
+         {
+            find( 0, 1 );
+            return deposits;
+         }
+
+         if( _scan_threads.empty() )
+         {
+            auto num_threads = std::max( 1u, std::thread::hardware_concurrency() );
+            for( uint32_t i = 0; i < num_threads; ++i )
+               _scan_threads.emplace_back( new fc::thread( "wallet scan " + fc::to_string( uint64_t(i) ) ) );
+         }
+
+         uint32_t num_tasks = std::min<uint32_t>( _scan_threads.size(), blocks.size() );
+         std::vector< fc::future<void> > found;
+         for( uint32_t i = 0; i < num_tasks; ++i )
+            found.push_back( _scan_threads[i]->async( [&find,i,num_tasks](){ find( i, num_tasks ); } ) );
+
+         // every task refers to blocks and deposits, so all of them have to finish before an error is reported
+         fc::optional<fc::exception> error;
+         for( auto& task : found )
+         {
+            try {
+               task.wait();
+            }
+            catch ( const fc::exception& e )
+            {
+               if( !error ) error = e;
+            }
+         }
+         if( error ) throw *error;
+
+         return deposits;
+      }
+
+      void wallet_impl::scan_block( const full_block& current_block, const block_deposits& deposits )
       {
-         //std::cout << "scanning block number " << block_num << "    keys: " << keys.size() << "    \r";
-         auto current_block = _blockchain->get_block( block_num );
-         for( auto trx : current_block.user_transactions )
+         const uint32_t block_num = current_block.block_num;
+         for( uint32_t trx_num = 0; trx_num < current_block.user_transactions.size(); ++trx_num )
          {
+            const auto& trx = current_block.user_transactions[trx_num];
             bool cache_trx = false;
             //std::cout << "scanning block number " << block_num << "    \n";
             //std::cout << "    scanning trx: " << fc::json::to_string( trx) << "    \n";
@@ -207,16 +342,21 @@ namespace bts { namespace wallet {
             current_trx_record->trx = trx;
             current_trx_record->received_time = current_block.timestamp;
 
-            for( auto op : trx.operations )
+            for( uint32_t op_num = 0; op_num < trx.operations.size(); ++op_num )
             {
+               const auto& op = trx.operations[op_num];
                switch( (operation_type_enum)op.type )
                {
                   case withdraw_op_type:
                      cache_trx |= scan_withdraw( op.as<withdraw_operation>() );
                      break;
                   case deposit_op_type:
-                     cache_trx |= scan_deposit( *current_trx_record, op.as<deposit_operation>(), keys );
+                  {
+                     auto match = deposits.find( std::make_pair( trx_num, op_num ) );
+                     cache_trx |= scan_deposit( *current_trx_record, op.as<deposit_operation>(),
+                                                match != deposits.end() ? &match->second : nullptr );
                      break;
+                  }
                   case register_account_op_type:
                      cache_trx |= scan_register_account( op.as<register_account_operation>() );
                      break;
@@ -335,7 +475,7 @@ namespace bts { namespace wallet {
 
       bool wallet_impl::scan_deposit( wallet_transaction_record& trx_rec, 
                                       const deposit_operation& op, 
-                                      const private_keys& keys )
+                                      const deposit_match* match )
       { try {
           bool cache_deposit = false; 
           switch( (withdraw_condition_types) op.condition.type )
@@ -345,33 +485,32 @@ namespace bts { namespace wallet {
                 break;
              case withdraw_by_account_type:
              {
-                for( auto key : keys )
+                if( match )
                 {
-                   auto deposit = op.condition.as<withdraw_by_account>();
-                   omemo_status status = deposit.decrypt_memo_data( key );
-                   if( status.valid() )
+                   const memo_status& status = match->status;
+                   const private_key_type& key = match->key;
+                   _wallet_db.cache_memo( status, key, _wallet_password );
+                   // the owner key was stored under the account, later deposits to it are tried with that key only
+                   if( _scan_keys_valid )
+                      _scan_keys.known_owners[op.condition.as<withdraw_by_account>().owner] = match->account_address;
+                   if( status.memo_flags == from_memo )
                    {
-                      _wallet_db.cache_memo( *status, key, _wallet_password );
-                      if( status->memo_flags == from_memo )
-                      {
-                         trx_rec.memo_message = status->get_message();
-                         trx_rec.amount       = asset( op.amount, op.condition.asset_id );
-                         trx_rec.from_account = status->from;
-                         trx_rec.to_account   = key.get_public_key();
-                         //ilog( "FROM MEMO... ${msg}", ("msg",trx_rec.memo_message) );
-                      }
-                      else
-                      {
-                         //ilog( "TO MEMO OLD STATE: ${s}",("s",trx_rec) );
-                         //ilog( "op: ${op}", ("op",op) );
-                         trx_rec.memo_message = status->get_message();
-                         trx_rec.from_account = key.get_public_key();
-                         trx_rec.to_account   = status->from;
-                         //ilog( "TO MEMO NEW STATE: ${s}",("s",trx_rec) );
-                      }
-                      cache_deposit = true;
-                      break;
+                      trx_rec.memo_message = status.get_message();
+                      trx_rec.amount       = asset( op.amount, op.condition.asset_id );
+                      trx_rec.from_account = status.from;
+                      trx_rec.to_account   = key.get_public_key();
+                      //ilog( "FROM MEMO... ${msg}", ("msg",trx_rec.memo_message) );
                    }
+                   else
+                   {
+                      //ilog( "TO MEMO OLD STATE: ${s}",("s",trx_rec) );
+                      //ilog( "op: ${op}", ("op",op) );
+                      trx_rec.memo_message = status.get_message();
+                      trx_rec.from_account = key.get_public_key();
+                      trx_rec.to_account   = status.from;
+                      //ilog( "TO MEMO NEW STATE: ${s}",("s",trx_rec) );
+                   }
+                   cache_deposit = true;
                 }
                 break;
              }
@@ -495,6 +634,7 @@ namespace bts { namespace wallet {
    { try {
       close();
       FC_ASSERT( fc::exists( wallet_filename ) );
+      my->invalidate_scan_keys();
       my->_wallet_db.open( wallet_filename );
       my->_current_wallet_path = wallet_filename;
 
@@ -508,6 +648,7 @@ namespace bts { namespace wallet {
    void wallet::close()
    { try {
       my->_wallet_db.close();
+      my->invalidate_scan_keys();
       if( my->_wallet_relocker_done.valid() )
       {
          lock();
@@ -585,6 +726,7 @@ namespace bts { namespace wallet {
    {
       my->_wallet_password     = fc::sha512();
       my->_scheduled_lock_time = fc::time_point();
+      my->invalidate_scan_keys();
       my->_wallet_relocker_done.cancel();
    }
    void wallet::change_passphrase( const string& new_passphrase )
@@ -623,6 +765,7 @@ namespace bts { namespace wallet {
       auto new_pub_key  = new_priv_key.get_public_key();
 
       my->_wallet_db.add_contact_account( account_name, new_pub_key, private_data );
+      my->invalidate_scan_keys();
 
       return new_pub_key;
    } FC_RETHROW_EXCEPTIONS( warn, "", ("account_name",account_name) ) }
@@ -644,6 +787,7 @@ namespace bts { namespace wallet {
 
       auto new_priv_key = my->_wallet_db.new_private_key( my->_wallet_password, 
                                                           current_account->account_address );
+      my->invalidate_scan_keys();
       return new_priv_key.get_public_key();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("account_name",account_name) ) }
 
@@ -665,6 +809,7 @@ namespace bts { namespace wallet {
       FC_ASSERT( is_valid_account_name( account_name ) );
 
       auto current_registered_account = my->_blockchain->get_account_record( account_name );
+      my->invalidate_scan_keys();
 
       if( current_registered_account.valid() && current_registered_account->active_key() != key )
          FC_ASSERT( !"Account name is already registered under a different key" );
@@ -708,6 +853,7 @@ namespace bts { namespace wallet {
       FC_ASSERT( ! my->_wallet_db.has_private_key(address(oaccount->owner_key)),
               "you can only remove contact accounts" );
       my->_wallet_db.remove_contact_account( account_name );
+      my->invalidate_scan_keys();
 
    } FC_RETHROW_EXCEPTIONS( warn, "", ("account_name", account_name) ) }
 
@@ -745,6 +891,7 @@ namespace bts { namespace wallet {
       FC_ASSERT( is_unlocked() );
 
       auto import_public_key = key.get_public_key();
+      my->invalidate_scan_keys();
 
       owallet_key_record current_key_record = my->_wallet_db.lookup_key( import_public_key );
       if( current_key_record.valid() )
@@ -827,17 +974,50 @@ namespace bts { namespace wallet {
 
       auto min_end = std::min<size_t>( my->_blockchain->get_head_block_num(), end );
 
-      auto account_priv_keys = my->_wallet_db.get_account_private_keys( my->_wallet_password );
+      const uint32_t blocks_per_batch = 1000;
+
+      // the in memory wallet state is updated as we go, so whatever was scanned is
+      // committed even if a later block fails
+      my->_wallet_db.start_batch();
+      try {
+         for( uint32_t batch_start = start; batch_start <= min_end; batch_start += blocks_per_batch )
+         {
+            auto batch_end = std::min<size_t>( min_end, batch_start + blocks_per_batch - 1 );
+
+            // a copy, the wallet's own is updated with the deposits found while the threads run
+            scan_keys keys = my->get_scan_keys();
+            vector<full_block> blocks;
+            blocks.reserve( batch_end - batch_start + 1 );
+            for( auto block_num = batch_start; block_num <= batch_end; ++block_num )
+               blocks.push_back( my->_blockchain->get_block( block_num ) );
+
+            auto deposits = my->find_deposits( blocks, keys );
+            for( uint32_t i = 0; i < blocks.size(); ++i )
+            {
+               my->scan_block( blocks[i], deposits[i] );
+               if( progress_callback )
+                  progress_callback( blocks[i].block_num, min_end );
+            }
 
-      for( auto block_num = start; block_num <= min_end; ++block_num )
+            my->_wallet_db.commit_batch();
+            my->_wallet_db.start_batch();
+         }
+      }
+      catch ( ... )
       {
-         my->scan_block( block_num, account_priv_keys );
-         if( progress_callback )
-            progress_callback( block_num, min_end );
+         my->_wallet_db.commit_batch();
+         throw;
       }
+      my->_wallet_db.commit_batch();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("start",start)("end",end) ) }
 
 
+   void  wallet::set_deposit_filter( deposit_filter filter )
+   {
+      my->_deposit_filter = filter;
+      my->_scan_keys.filter = filter;
+   }
+
    void  wallet::sign_transaction( signed_transaction& trx, const std::unordered_set<address>& req_sigs )
    { try {
       for( auto addr : req_sigs )
@@ -1915,8 +2095,18 @@ namespace bts { namespace wallet {
    void  wallet::scan_state()
    { try {
       ilog( "WALLET: scaning blockchain state" );
-      my->scan_balances();
-      my->scan_registered_accounts();
+      my->invalidate_scan_keys();
+      my->_wallet_db.start_batch();
+      try {
+         my->scan_balances();
+         my->scan_registered_accounts();
+      }
+      catch ( ... )
+      {
+         my->_wallet_db.commit_batch();
+         throw;
+      }
+      my->_wallet_db.commit_batch();
    } FC_RETHROW_EXCEPTIONS( warn, "" )  }
 
    /**
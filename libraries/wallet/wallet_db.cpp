@@ -156,6 +156,16 @@ namespace bts{ namespace wallet {
 
    bool wallet_db::is_open()const { return my->_records.is_open(); }
 
+   void wallet_db::start_batch()
+   {
+      my->_records.start_batch();
+   }
+
+   void wallet_db::commit_batch()
+   {
+      my->_records.commit_batch();
+   }
+
    int32_t wallet_db::new_index()
    {
       auto next_rec_num = get_property( next_record_number );
@@ -322,10 +332,12 @@ namespace bts{ namespace wallet {
       FC_ASSERT( !fc::exists( wallet_to_create ) );
       open( wallet_to_create );
       auto input_records = fc::json::from_file<std::vector<generic_wallet_record> >( import_file_name );
+      start_batch();
       for( auto r : input_records )
       {
          store_generic_record( r.get_index(), r );
       }
+      commit_batch();
    } FC_RETHROW_EXCEPTIONS( warn, "", ("import_file_name",import_file_name)
                                       ("wallet_to_create",wallet_to_create) ) }
 
@@ -65,6 +65,9 @@ int main( int argc, char** argv )
                                "generate a genesis state with the given json file (only accepted when the blockchain is empty)")
                               ("clear-peer-database", "erase all information in the peer database")
                               ("resync-blockchain", "delete our copy of the blockchain at startup, and download a fresh copy of the entire blockchain from the network")
+                              ("replay-blockchain", "rebuild the blockchain state at startup from the blocks stored in the data directory without downloading them again")
+                              ("record-cache-size", program_options::value<uint32_t>(), "number of decoded account, asset, balance and property records of each type to keep in memory, 0 disables caching")
+                              ("audit-interval", program_options::value<uint32_t>(), "verify the share supply and vote totals against a full scan of the chain state every N blocks, 0 disables the audit")
                               ("version", "print the version information for bts_xt_client");
 
 
@@ -113,6 +116,10 @@ int main( int argc, char** argv )
 
       bts::client::client_ptr client = std::make_shared<bts::client::client>();
       client->open( datadir, option_variables["genesis-config"].as<std::string>() );
+      if( option_variables.count("record-cache-size") )
+         client->get_chain()->set_record_cache_size( option_variables["record-cache-size"].as<uint32_t>() );
+      if( option_variables.count("audit-interval") )
+         client->get_chain()->set_audit_interval( option_variables["audit-interval"].as<uint32_t>() );
       _global_client = client.get();
 
       client->run_delegate();
@@ -367,6 +374,19 @@ void load_and_configure_chain_database( const fc::path& datadir,
   fc::path genesis_file = option_variables["genesis-config"].as<std::string>();
   std::cout << "Using genesis block from file \"" << fc::absolute( genesis_file ).string() << "\"\n";
 
+  if (option_variables.count("replay-blockchain") && !option_variables.count("resync-blockchain"))
+  {
+    std::cout << "Replaying the blockchain in \"" << ( datadir / "chain" ).generic_string() << "\"\n";
+    auto chain = std::make_shared<bts::blockchain::chain_database>();
+    chain->replay( datadir / "chain", genesis_file, []( uint32_t block_num, uint32_t total )
+    {
+       if( block_num % 1000 == 0 || block_num == total )
+          std::cout << "\rreplayed " << block_num << " of " << total << " blocks" << std::flush;
+    } );
+    std::cout << "\n";
+    chain->close();
+  }
+
 } FC_RETHROW_EXCEPTIONS( warn, "unable to open blockchain from ${data_dir}", ("data_dir",datadir/"chain") ) }
 
 config load_config( const fc::path& datadir )
@@ -0,0 +1,176 @@
+#include <bts/blockchain/balance_operations.hpp>
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/genesis_config.hpp>
+#include <bts/blockchain/pts_address.hpp>
+#include <bts/blockchain/time.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+using namespace bts::blockchain;
+
+/**
+ *  Fills the pending transaction pool of a fresh chain with transfers of random size and
+ *  fee rate, some of which spend the outputs of other pending transfers, and reports how
+ *  full the generated block is and how long generate_block takes, both when it has to pack
+ *  the transactions and when they are already packed in the block template.
+ *
+ *  usage: bts_block_packing_benchmark [pool_size] [rounds]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t pool_size = argc > 1 ? std::stoul( argv[1] ) : 10000;
+      uint32_t rounds    = argc > 2 ? std::max<uint32_t>( std::stoul( argv[2] ), 1 ) : 5;
+
+      fc::temp_directory dir;
+      std::mt19937 rng( 1234 );
+
+      genesis_block_config config;
+      config.timestamp = bts::blockchain::now();
+      std::vector<fc::ecc::private_key> keys;
+      for( uint32_t i = 0; i < BTS_BLOCKCHAIN_NUM_DELEGATES + pool_size; ++i )
+      {
+         keys.push_back( fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string( i ) ) ) );
+         config.balances.push_back( std::make_pair( pts_address( keys[i].get_public_key() ), 1000.0 ) );
+         if( i < BTS_BLOCKCHAIN_NUM_DELEGATES )
+         {
+            name_config delegate;
+            delegate.name = "delegate-" + fc::to_string( i );
+            delegate.is_delegate = true;
+            delegate.owner = keys[i].get_public_key().serialize();
+            config.names.push_back( delegate );
+         }
+      }
+      fc::json::save_to_file( config, dir.path() / "genesis.json", true );
+
+      auto chain = std::make_shared<chain_database>();
+      chain->open( dir.path() / "chain", dir.path() / "genesis.json" );
+      chain->set_pending_queue_size( size_t(-1) );
+      auto delegate_id = chain->get_account_record( "delegate-0" )->id;
+
+      auto random_address = [&]() -> address
+      {
+         address a;
+         uint64_t seed = rng();
+         a.addr = fc::ripemd160::hash( (const char*)&seed, sizeof(seed) );
+         return a;
+      };
+
+      // builds a signed transfer from balance_id paying between 1 and 50 times the minimum fee rate
+      auto make_transfer = [&]( const fc::ecc::private_key& owner, const balance_id_type& balance_id, share_type amount,
+                                uint32_t outputs, const fc::optional<address>& first_output ) -> signed_transaction
+      {
+         signed_transaction trx;
+         trx.withdraw( balance_id, amount );
+         for( uint32_t i = 0; i < outputs; ++i )
+            trx.deposit( i == 0 && first_output ? *first_output : random_address(), asset( 1, 0 ), delegate_id );
+         trx.sign( owner, chain->chain_id() );
+
+         share_type fee = (share_type(trx.data_size()) * chain->get_fee_rate() * (1 + rng() % 50)) / 1000 + 1;
+         share_type per_output = (amount - fee) / outputs;
+         trx.operations.clear();
+         trx.signatures.clear();
+         trx.withdraw( balance_id, amount );
+         for( uint32_t i = 0; i < outputs; ++i )
+            trx.deposit( i == 0 && first_output ? *first_output : random_address(), asset( per_output, 0 ), delegate_id );
+         trx.sign( owner, chain->chain_id() );
+         return trx;
+      };
+
+      std::vector<signed_transaction> trxs;
+      std::vector< std::pair<fc::ecc::private_key,balance_id_type> > spendable_outputs;
+      uint32_t funded = 0;
+      for( uint32_t i = 0; trxs.size() < pool_size; ++i )
+      {
+         // one in ten transfers spends the output of an earlier pending transfer
+         if( i % 10 == 9 && !spendable_outputs.empty() )
+         {
+            auto output = spendable_outputs.back();
+            spendable_outputs.pop_back();
+            share_type amount = 0;
+            for( const auto& op : trxs.back().operations )
+               if( operation_type_enum( op.type ) == deposit_op_type ) { amount = op.as<deposit_operation>().amount; break; }
+            trxs.push_back( make_transfer( output.first, output.second, amount, 1 + rng() % 20, fc::optional<address>() ) );
+            continue;
+         }
+
+         const auto& owner = keys[BTS_BLOCKCHAIN_NUM_DELEGATES + funded++];
+         auto balance_id = balance_record( pts_address( owner.get_public_key() ), asset( 0, 0 ), delegate_id ).id();
+         auto balance = chain->get_balance_record( balance_id );
+         FC_ASSERT( balance.valid() );
+
+         auto output_key = fc::ecc::private_key::regenerate( fc::sha256::hash( "output" + fc::to_string( i ) ) );
+         address output_address( output_key.get_public_key() );
+         trxs.push_back( make_transfer( owner, balance_id, balance->balance, 1 + rng() % 20, output_address ) );
+         spendable_outputs.push_back( std::make_pair( output_key,
+                                                      balance_record( output_address, asset( 0, 0 ), delegate_id ).id() ) );
+      }
+
+      auto start = fc::time_point::now();
+      uint32_t rejected = 0;
+      std::unordered_map<transaction_id_type, share_type> fees;
+      for( const auto& trx : trxs )
+      {
+         try {
+            auto trx_state = chain->store_pending_transaction( trx );
+            if( trx_state ) fees[trx_state->trx_id] = trx_state->get_fees();
+         }
+         catch ( const fc::exception& )
+         {
+            ++rejected;
+         }
+      }
+      auto pool_time = fc::time_point::now() - start;
+
+      size_t pool_bytes = 0;
+      for( const auto& trx_state : chain->get_pending_transactions() )
+         pool_bytes += trx_state->trx_size;
+
+      auto next_block_time = chain->get_head_block().timestamp + BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+      start = fc::time_point::now();
+      full_block next_block = chain->generate_block( next_block_time );
+      auto build_time = (fc::time_point::now() - start).count();
+
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < rounds; ++i )
+         next_block = chain->generate_block( next_block_time );
+      auto template_time = (fc::time_point::now() - start).count() / rounds;
+
+      size_t     block_size = 0;
+      share_type block_fees = 0;
+      for( const auto& trx : next_block.user_transactions )
+      {
+         block_size += trx.data_size();
+         block_fees += fees[trx.id()];
+      }
+
+      std::cout << "pending transactions:  " << fees.size() << " (" << rejected << " rejected, "
+                << pool_bytes << " bytes, added in " << pool_time.count() / 1000 << " ms)\n";
+      std::cout << "block transactions:    " << next_block.user_transactions.size() << "\n";
+      std::cout << "block size:            " << block_size << " of " << BTS_BLOCKCHAIN_MAX_BLOCK_SIZE << " bytes ("
+                << (100.0 * block_size) / BTS_BLOCKCHAIN_MAX_BLOCK_SIZE << "% full)\n";
+      std::cout << "block fees:            " << block_fees << "\n";
+      std::cout << "generate_block:        " << build_time / 1000 << " ms packing, "
+                << template_time / 1000 << " ms from the block template\n";
+
+      chain->close();
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
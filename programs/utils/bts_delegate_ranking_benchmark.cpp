@@ -0,0 +1,99 @@
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/genesis_config.hpp>
+#include <bts/blockchain/pts_address.hpp>
+#include <bts/blockchain/time.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace bts::blockchain;
+
+/**
+ *  Registers a large number of delegates in the genesis block and measures how long it takes
+ *  to change their votes with store_account_record, the way every block does for the
+ *  delegates it pays and the ones its transactions vote for, and to query the next round of
+ *  active delegates.  The ranking is checked against a full sort of the delegate records.
+ *
+ *  usage: bts_delegate_ranking_benchmark [delegates] [updates]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t delegate_count = argc > 1 ? std::max<uint32_t>( std::stoul( argv[1] ), BTS_BLOCKCHAIN_NUM_DELEGATES ) : 10000;
+      uint32_t update_count   = argc > 2 ? std::stoul( argv[2] ) : 100000;
+
+      fc::temp_directory dir;
+      std::mt19937 rng( 1234 );
+
+      genesis_block_config config;
+      config.timestamp = bts::blockchain::now();
+      for( uint32_t i = 0; i < delegate_count; ++i )
+      {
+         auto key = fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string( i ) ) );
+         if( i == 0 ) config.balances.push_back( std::make_pair( pts_address( key.get_public_key() ), 1000000.0 ) );
+
+         name_config delegate;
+         delegate.name = "delegate-" + fc::to_string( i );
+         delegate.is_delegate = true;
+         delegate.owner = key.get_public_key().serialize();
+         config.names.push_back( delegate );
+      }
+      fc::json::save_to_file( config, dir.path() / "genesis.json", true );
+
+      auto start = fc::time_point::now();
+      chain_database chain;
+      chain.open( dir.path() / "chain", dir.path() / "genesis.json" );
+      auto genesis_time = (fc::time_point::now() - start).count();
+
+      std::vector<account_record> delegates = chain.get_delegate_records_by_vote();
+      FC_ASSERT( delegates.size() == delegate_count );
+
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < update_count; ++i )
+      {
+         auto& record = delegates[ rng() % delegates.size() ];
+         record.adjust_votes_for( share_type( rng() % 2001 ) - 1000 );
+         chain.store_account_record( record );
+      }
+      auto update_time = (fc::time_point::now() - start).count();
+
+      uint32_t rounds = 1000;
+      std::vector<account_id_type> active;
+      start = fc::time_point::now();
+      for( uint32_t i = 0; i < rounds; ++i )
+         active = chain.next_round_active_delegates();
+      auto query_time = (fc::time_point::now() - start).count();
+
+      std::sort( delegates.begin(), delegates.end(), []( const account_record& a, const account_record& b )
+      {
+         if( a.net_votes() != b.net_votes() ) return a.net_votes() > b.net_votes();
+         return a.id < b.id;
+      });
+      auto ranking = chain.get_delegates_by_vote();
+      FC_ASSERT( ranking.size() == delegates.size() );
+      for( uint32_t i = 0; i < ranking.size(); ++i )
+         FC_ASSERT( ranking[i] == delegates[i].id, "ranking differs at position ${i}", ("i",i) );
+
+      std::cout << "delegates:                    " << delegate_count << "\n";
+      std::cout << "genesis:                      " << genesis_time / 1000 << " ms\n";
+      std::cout << "store_account_record:         " << double(update_time) / update_count << " us per vote change\n";
+      std::cout << "next_round_active_delegates:  " << double(query_time) / rounds << " us\n";
+
+      chain.close();
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,98 @@
+#include <bts/blockchain/withdraw_types.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace bts::blockchain;
+
+/**
+ *  Measures trial decryption of withdraw_by_account memos the way a wallet scans blocks,
+ *  every deposit against every receiver key, once with withdraw_by_account::decrypt_memo_data
+ *  and once with a memo_key_set.  One in ten deposits is addressed to one of the keys and
+ *  both approaches have to find the same ones.
+ *
+ *  usage: bts_memo_scan_benchmark [keys] [deposits]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t key_count     = argc > 1 ? std::max<uint32_t>( std::stoul( argv[1] ), 1 ) : 100;
+      uint32_t deposit_count = argc > 2 ? std::stoul( argv[2] ) : 100;
+
+      std::mt19937 rng( 1234 );
+      std::vector<fc::ecc::private_key> keys;
+      for( uint32_t i = 0; i < key_count; ++i )
+         keys.push_back( fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string( i ) ) ) );
+
+      auto sender = fc::ecc::private_key::regenerate( fc::sha256::hash( std::string( "sender" ) ) );
+      std::vector<withdraw_by_account> deposits;
+      std::vector<uint32_t> expected;
+      for( uint32_t i = 0; i < deposit_count; ++i )
+      {
+         uint32_t receiver_index = i % 10 == 0 ? rng() % keys.size() : key_count;
+         auto receiver = receiver_index < key_count ? keys[receiver_index]
+                                                     : fc::ecc::private_key::regenerate( fc::sha256::hash( "other" + fc::to_string( i ) ) );
+         auto one_time_key = fc::ecc::private_key::regenerate( fc::sha256::hash( "one time" + fc::to_string( i ) ) );
+
+         withdraw_by_account deposit;
+         deposit.encrypt_memo_data( one_time_key, receiver.get_public_key(), sender,
+                                    "memo " + fc::to_string( i ), sender.get_public_key() );
+         deposits.push_back( deposit );
+         expected.push_back( receiver_index );
+      }
+
+      auto start = fc::time_point::now();
+      for( uint32_t d = 0; d < deposits.size(); ++d )
+      {
+         uint32_t found = key_count;
+         for( uint32_t k = 0; k < keys.size() && found == key_count; ++k )
+            if( deposits[d].decrypt_memo_data( keys[k] ).valid() ) found = k;
+         FC_ASSERT( found == expected[d], "deposit ${d}", ("d",d) );
+      }
+      auto single_time = (fc::time_point::now() - start).count();
+
+      start = fc::time_point::now();
+      memo_key_set key_set( keys );
+      auto setup_time = (fc::time_point::now() - start).count();
+
+      start = fc::time_point::now();
+      std::vector<omemo_status> statuses( deposits.size() );
+      std::vector<uint32_t> found( deposits.size(), key_count );
+      for( uint32_t d = 0; d < deposits.size(); ++d )
+      {
+         for( uint32_t k = 0; k < key_set.size() && found[d] == key_count; ++k )
+         {
+            statuses[d] = key_set.decrypt_memo_data( deposits[d], k );
+            if( statuses[d].valid() ) found[d] = k;
+         }
+      }
+      auto set_time = (fc::time_point::now() - start).count();
+
+      for( uint32_t d = 0; d < deposits.size(); ++d )
+      {
+         FC_ASSERT( found[d] == expected[d], "deposit ${d}", ("d",d) );
+         if( statuses[d].valid() )
+            FC_ASSERT( statuses[d]->get_message() == "memo " + fc::to_string( d ) && statuses[d]->has_valid_signature );
+      }
+
+      uint64_t trials = 0;
+      for( uint32_t d = 0; d < deposits.size(); ++d )
+         trials += expected[d] == key_count ? key_count : expected[d] + 1;
+
+      std::cout << "keys: " << key_count << "    deposits: " << deposit_count << "    trials: " << trials << "\n";
+      std::cout << "decrypt_memo_data:  " << double(single_time) / trials << " us per trial\n";
+      std::cout << "memo_key_set:       " << double(set_time) / trials << " us per trial ("
+                << setup_time / 1000 << " ms to build the set)\n";
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
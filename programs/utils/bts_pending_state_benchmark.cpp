@@ -0,0 +1,101 @@
+#include <bts/blockchain/pending_chain_state.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/time.hpp>
+
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace bts::blockchain;
+
+/**
+ *  Measures the cost of evaluating changes in nested pending_chain_state layers, the way
+ *  transactions are evaluated on top of a block being produced, as the nesting depth grows.
+ *
+ *  Each simulated transaction reads balances through every layer, changes some of them in
+ *  the top layer and then folds each layer into the one below it.  The layers are either
+ *  allocated per transaction and folded with apply_changes() or allocated once and folded
+ *  with squash().
+ *
+ *  usage: bts_pending_state_benchmark [transactions] [balances]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint32_t trx_count     = argc > 1 ? std::stoul( argv[1] ) : 2000;
+      uint32_t balance_count = argc > 2 ? std::stoul( argv[2] ) : 10000;
+
+      std::vector<balance_id_type> balance_ids;
+      auto root = std::make_shared<pending_chain_state>();
+      for( uint32_t i = 0; i < balance_count; ++i )
+      {
+         address owner;
+         owner.addr = fc::ripemd160::hash( (const char*)&i, sizeof(i) );
+         balance_record record( owner, asset( 1000000, 0 ), 1 );
+         balance_ids.push_back( record.id() );
+         root->store_balance_record( record );
+      }
+
+      // evaluates one transaction in layers[depth-1] and folds every layer down into root
+      auto evaluate = [&]( const std::vector<pending_chain_state_ptr>& layers, std::mt19937& rng, bool squash )
+      {
+         const auto& top = layers.back();
+         for( uint32_t i = 0; i < 4; ++i )
+         {
+            auto record = top->get_balance_record( balance_ids[ rng() % balance_ids.size() ] );
+            FC_ASSERT( record.valid() );
+            if( i < 2 )
+            {
+               record->balance -= 1;
+               top->store_balance_record( *record );
+            }
+         }
+         for( auto itr = layers.rbegin(); itr != layers.rend(); ++itr )
+         {
+            if( squash ) (*itr)->squash();
+            else (*itr)->apply_changes();
+         }
+      };
+
+      std::cout << "depth    apply_changes (us/trx)    squash (us/trx)\n";
+      for( uint32_t depth = 1; depth <= 64; depth *= 2 )
+      {
+         std::mt19937 rng( depth );
+         auto start = fc::time_point::now();
+         for( uint32_t t = 0; t < trx_count; ++t )
+         {
+            std::vector<pending_chain_state_ptr> layers;
+            chain_interface_ptr prev = root;
+            for( uint32_t d = 0; d < depth; ++d )
+            {
+               layers.push_back( std::make_shared<pending_chain_state>( prev ) );
+               prev = layers.back();
+            }
+            evaluate( layers, rng, false );
+         }
+         auto apply_time = (fc::time_point::now() - start).count();
+
+         rng.seed( depth );
+         std::vector<pending_chain_state_ptr> layers;
+         chain_interface_ptr prev = root;
+         for( uint32_t d = 0; d < depth; ++d )
+         {
+            layers.push_back( std::make_shared<pending_chain_state>( prev ) );
+            prev = layers.back();
+         }
+         start = fc::time_point::now();
+         for( uint32_t t = 0; t < trx_count; ++t )
+            evaluate( layers, rng, true );
+         auto squash_time = (fc::time_point::now() - start).count();
+
+         std::cout << depth << "        " << double(apply_time) / trx_count
+                   << "                    " << double(squash_time) / trx_count << "\n";
+      }
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,89 @@
+#include <bts/net/config.hpp>
+#include <bts/net/stcp_socket.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/network/ip.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
+#include <fc/time.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace bts::net;
+
+/**
+ *  Sends data over a loopback stcp_socket connection with each transport and reports the
+ *  throughput and how many reads the receiver needed, the receiver reading into a buffer
+ *  the size of the one message_oriented_connection uses.  Every received byte is compared
+ *  with what was sent and the ones that differ are reported.
+ *
+ *  usage: bts_stcp_benchmark [megabytes] [write_size]
+ */
+int main( int argc, char** argv )
+{
+   try {
+      uint64_t megabytes  = argc > 1 ? std::stoul( argv[1] ) : 256;
+      size_t   write_size = argc > 2 ? std::stoul( argv[2] ) : 65536;
+      write_size = 16 * ((std::max<size_t>( write_size, 1 ) + 15) / 16); // the aes stream needs whole blocks
+      uint64_t writes = (megabytes * 1024 * 1024 + write_size - 1) / write_size;
+      uint64_t total  = writes * write_size;
+
+      std::mt19937 rng( 1234 );
+      std::vector<char> data( write_size );
+      for( auto& c : data ) c = char( rng() );
+
+      std::cout << "transport          MB/s       reads      corrupted bytes\n";
+      for( auto transport : { stcp_socket::aes_stream, stcp_socket::aes_gcm_records } )
+      {
+         fc::tcp_server server;
+         server.listen( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), 0 ) );
+
+         stcp_socket receiver( transport );
+         stcp_socket sender( transport );
+         auto accepted = fc::async( [&]() { server.accept( receiver.get_socket() ); receiver.accept(); } );
+         sender.connect_to( fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), server.get_local_endpoint().port() ) );
+         accepted.wait();
+
+         auto start = fc::time_point::now();
+         uint64_t corrupted = 0;
+         auto received = fc::async( [&]() -> uint64_t
+         {
+            std::vector<char> buffer( BTS_NET_RECEIVE_BUFFER_SIZE );
+            uint64_t bytes = 0;
+            uint64_t reads = 0;
+            while( bytes < total )
+            {
+               size_t count = receiver.readsome( buffer.data(), buffer.size() );
+               for( size_t i = 0; i < count; ++i )
+                  if( buffer[i] != data[(bytes + i) % write_size] ) ++corrupted;
+               bytes += count;
+               ++reads;
+            }
+            return reads;
+         });
+         for( uint64_t i = 0; i < writes; ++i )
+         {
+            sender.write( data.data(), write_size );
+            sender.flush();
+         }
+         uint64_t reads = received.wait();
+         auto elapsed = (fc::time_point::now() - start).count();
+
+         std::cout << (transport == stcp_socket::aes_stream ? "aes_stream         " : "aes_gcm_records    ")
+                   << (double(total) / (1024 * 1024)) / (double(elapsed) / 1000000) << "     " << reads
+                   << "     " << corrupted << "\n";
+
+         sender.close();
+         receiver.close();
+         server.close();
+      }
+   }
+   catch ( const fc::exception& e )
+   {
+      std::cerr << e.to_detail_string() << "\n";
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,708 @@
+#define BOOST_TEST_MODULE BlockchainTests
+#include <boost/test/unit_test.hpp>
+#include <bts/blockchain/chain_database.hpp>
+#include <bts/blockchain/config.hpp>
+#include <bts/blockchain/genesis_config.hpp>
+#include <bts/blockchain/pts_address.hpp>
+#include <bts/blockchain/time.hpp>
+#include <bts/blockchain/transaction_pool.hpp>
+#include <bts/blockchain/undo_data.hpp>
+#include <bts/db/key_encoding.hpp>
+#include <bts/db/level_map.hpp>
+#include <bts/wallet/wallet.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+using namespace bts::blockchain;
+
+/**
+ *  A genesis state whose delegates and initial balances belong to keys the test holds, starting
+ *  far enough in the past that blocks can be produced for the slots up to now.
+ */
+struct test_genesis
+{
+   test_genesis()
+   {
+      auto interval = BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC;
+      start = fc::time_point_sec( uint32_t( (bts::blockchain::now().sec_since_epoch() / interval - 1000) * interval ) );
+
+      genesis_block_config config;
+      config.timestamp = start;
+      for( uint32_t i = 0; i < BTS_BLOCKCHAIN_NUM_DELEGATES + 10; ++i )
+      {
+         keys.push_back( fc::ecc::private_key::regenerate( fc::sha256::hash( fc::to_string( i ) ) ) );
+         config.balances.push_back( std::make_pair( pts_address( keys[i].get_public_key() ), 1000.0 ) );
+         if( i < BTS_BLOCKCHAIN_NUM_DELEGATES )
+         {
+            name_config delegate;
+            delegate.name = "delegate-" + fc::to_string( i );
+            delegate.is_delegate = true;
+            delegate.owner = keys[i].get_public_key().serialize();
+            config.names.push_back( delegate );
+         }
+      }
+      genesis_file = dir.path() / "genesis.json";
+      fc::json::save_to_file( config, genesis_file, true );
+   }
+
+   chain_database_ptr open( const std::string& name )const
+   {
+      auto chain = std::make_shared<chain_database>();
+      chain->open( dir.path() / name, genesis_file );
+      return chain;
+   }
+
+   /** the next block of chain with its pending transactions, signed by the delegate of slot */
+   full_block produce( chain_database& chain, uint32_t slot )const
+   {
+      auto timestamp = start + uint32_t( slot * BTS_BLOCKCHAIN_BLOCK_INTERVAL_SEC );
+      full_block block = chain.generate_block( timestamp );
+      block.previous_secret  = secret_hash_type();
+      block.next_secret_hash = fc::ripemd160::hash( secret_hash_type() );
+      sign( chain, block );
+      return block;
+   }
+
+   void sign( chain_database& chain, full_block& block )const
+   {
+      address signer( chain.get_signing_delegate_key( block.timestamp ) );
+      for( const auto& key : keys )
+      {
+         if( address( key.get_public_key() ) != signer ) continue;
+         block.sign( key );
+         return;
+      }
+      FC_THROW( "no key for the delegate of ${time}", ("time",block.timestamp) );
+   }
+
+   /** the genesis balance of the owner-th balance holder, voting for the first delegate */
+   balance_id_type balance_id( uint32_t owner )const
+   {
+      return balance_record( pts_address( keys[BTS_BLOCKCHAIN_NUM_DELEGATES + owner].get_public_key() ), asset( 0, 0 ), 1 ).id();
+   }
+
+   /** sends half of the genesis balance of owner to to, the other half pays the fee */
+   signed_transaction transfer( chain_database& chain, uint32_t owner, const address& to )const
+   {
+      auto balance = chain.get_balance_record( balance_id( owner ) );
+      FC_ASSERT( balance.valid() );
+      signed_transaction trx;
+      trx.withdraw( balance_id( owner ), balance->balance );
+      trx.deposit( to, asset( balance->balance / 2, 0 ), 1 );
+      trx.sign( keys[BTS_BLOCKCHAIN_NUM_DELEGATES + owner], chain.chain_id() );
+      return trx;
+   }
+
+   /** the chain state a test compares, read through the record caches */
+   std::string state( const chain_database& chain, const std::vector<balance_id_type>& balances )const
+   {
+      std::vector<obalance_record> balance_records;
+      for( const auto& id : balances )
+         balance_records.push_back( chain.get_balance_record( id ) );
+      return fc::json::to_string( fc::mutable_variant_object()
+                                  ( "head", chain.get_head_block_id() )
+                                  ( "delegates", chain.get_delegate_records_by_vote() )
+                                  ( "balances", balance_records )
+                                  ( "base_asset", chain.get_asset_record( asset_id_type( 0 ) ) ) );
+   }
+
+   fc::temp_directory                dir;
+   fc::path                          genesis_file;
+   fc::time_point_sec                start;
+   std::vector<fc::ecc::private_key> keys;
+};
+
+BOOST_AUTO_TEST_CASE( key_encoding_order )
+{
+   try {
+      auto encode_int = []( int32_t v ) { std::string s; bts::db::key_encoding<int32_t>::encode( s, v ); return s; };
+      FC_ASSERT( encode_int( -5 ) < encode_int( -1 ) );
+      FC_ASSERT( encode_int( -1 ) < encode_int( 0 ) );
+      FC_ASSERT( encode_int( 255 ) < encode_int( 256 ) );
+
+      auto encode_str = []( const std::string& v ) { std::string s; bts::db::key_encoding<std::string>::encode( s, v ); return s; };
+      FC_ASSERT( encode_str( "a" ) < encode_str( std::string( "a\0", 2 ) ) );
+      FC_ASSERT( encode_str( std::string( "a\0", 2 ) ) < encode_str( "ab" ) );
+      FC_ASSERT( encode_str( "" ) < encode_str( "a" ) );
+
+      std::string name( "na\0me", 6 );
+      std::string encoded = encode_str( name );
+      fc::datastream<const char*> ds( encoded.data(), encoded.size() );
+      std::string decoded;
+      bts::db::key_encoding<std::string>::decode( ds, decoded );
+      FC_ASSERT( decoded == name );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( shared_database_tables )
+{
+   try {
+      fc::temp_directory dir;
+      bts::db::level_database db;
+      bts::db::level_map<int32_t,int32_t> first;
+      bts::db::level_map<int32_t,int32_t> second;
+      first.open( db, 1 );
+      second.open( db, 2 );
+      db.open( dir.path() / "db" );
+
+      for( int32_t key : { 300, -2, 7, -300, 0 } )
+         first.store( key, key );
+      second.store( -1, -1 );
+      second.store( 1, 1 );
+
+      // each table only sees its own keys, in the order of the key type
+      std::vector<int32_t> keys;
+      for( auto itr = first.begin(); itr.valid(); ++itr )
+         keys.push_back( itr.key() );
+      FC_ASSERT( (keys == std::vector<int32_t>{ -300, -2, 0, 7, 300 }) );
+      FC_ASSERT( first.lower_bound( -1 ).key() == 0 );
+      FC_ASSERT( !first.fetch_optional( 1 ).valid() );
+
+      keys.clear();
+      for( auto itr = second.begin(); itr.valid(); ++itr )
+         keys.push_back( itr.key() );
+      FC_ASSERT( (keys == std::vector<int32_t>{ -1, 1 }) );
+
+      first.remove( 0 );
+      FC_ASSERT( first.lower_bound( -1 ).key() == 7 );
+      FC_ASSERT( second.fetch_optional( -1 ).valid() );
+      db.close();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( transaction_pool_test )
+{
+   try {
+      auto make_trx = []( uint32_t seed, size_t size, share_type fees ) -> transaction_evaluation_state_ptr
+      {
+         auto trx_state = std::make_shared<transaction_evaluation_state>();
+         trx_state->trx_id   = fc::ripemd160::hash( (const char*)&seed, sizeof(seed) );
+         trx_state->trx_size = size;
+         trx_state->balance[0] = fees;
+         return trx_state;
+      };
+
+      transaction_pool pool( 1000 );
+      address balance_a( fc::ecc::private_key::generate().get_public_key() );
+      pending_chain_state spends_a;
+      spends_a.balances[ balance_a ] = balance_record();
+      pending_chain_state no_changes;
+      signed_transaction spends_a_again;
+      spends_a_again.withdraw( balance_a, 1 );
+
+      auto cheap  = make_trx( 1, 400, 400 );
+      auto medium = make_trx( 2, 400, 4000 );
+      auto rich   = make_trx( 3, 400, 40000 );
+      // withdraws from the balance cheap changed
+      auto dependent = make_trx( 5, 200, 2000 );
+      dependent->trx = spends_a_again;
+
+      FC_ASSERT( pool.insert( cheap, spends_a ).empty() );
+      FC_ASSERT( pool.insert( dependent, spends_a ).empty() );
+      FC_ASSERT( pool.get_dependents( cheap->trx_id ).size() == 1 );
+      FC_ASSERT( pool.insert( medium, no_changes ).empty() );
+      FC_ASSERT( pool.get_dependencies( spends_a_again ).size() == 2 );
+
+      // the pool is full, the lowest fee rate makes room and takes its dependent with it
+      auto evicted = pool.insert( rich, no_changes );
+      FC_ASSERT( evicted.size() == 2 && evicted[0] == cheap->trx_id && evicted[1] == dependent->trx_id );
+      FC_ASSERT( !pool.contains( cheap->trx_id ) && !pool.contains( dependent->trx_id ) );
+      FC_ASSERT( pool.get_dependencies( spends_a_again ).empty() );
+      FC_ASSERT( pool.data_size() == 800 );
+
+      auto ordered = pool.get_transactions();
+      FC_ASSERT( ordered.size() == 2 && ordered[0] == rich && ordered[1] == medium );
+      FC_ASSERT( pool.get_below_fee_rate( 20000 ).size() == 1 );
+
+      bool rejected = false;
+      try { pool.insert( make_trx( 4, 400, 40 ), no_changes ); }
+      catch ( const fc::exception& ) { rejected = true; }
+      FC_ASSERT( rejected && pool.size() == 2 );
+
+      // shrinking the pool evicts dependents as well
+      transaction_pool small_pool( 1000 );
+      FC_ASSERT( small_pool.insert( cheap, spends_a ).empty() );
+      FC_ASSERT( small_pool.insert( dependent, spends_a ).empty() );
+      FC_ASSERT( small_pool.set_max_size( 300 ).size() == 2 );
+      FC_ASSERT( small_pool.size() == 0 && small_pool.data_size() == 0 );
+
+      // a fee paid in another asset counts once the owner ranks by it, the base fee rate stays the same
+      transaction_pool ranked_pool( 800 );
+      auto other_asset = make_trx( 6, 400, 0 );
+      other_asset->balance[1] = 100000;
+      FC_ASSERT( ranked_pool.insert( medium, no_changes ).empty() );
+      FC_ASSERT( ranked_pool.insert( other_asset, no_changes ).empty() );
+      FC_ASSERT( ranked_pool.get_transactions()[0] == medium );
+      ranked_pool.set_priority_function( []( const transaction_evaluation_state& trx_state )
+      {
+         auto itr = trx_state.balance.find( 1 );
+         share_type value = trx_state.get_fees() + (itr != trx_state.balance.end() ? itr->second / 10 : 0);
+         return (value * 1000) / int64_t(trx_state.trx_size);
+      });
+      FC_ASSERT( ranked_pool.get_priority( other_asset->trx_id ) == 25000 );
+      FC_ASSERT( ranked_pool.get_transactions()[0] == other_asset );
+      FC_ASSERT( ranked_pool.get_below_fee_rate( 1 ).size() == 1 );
+      evicted = ranked_pool.insert( make_trx( 7, 400, 8000 ), no_changes );
+      FC_ASSERT( evicted.size() == 1 && evicted[0] == medium->trx_id );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_data_test )
+{
+   try {
+      address owner_a( fc::ecc::private_key::generate().get_public_key() );
+      address owner_b( fc::ecc::private_key::generate().get_public_key() );
+      balance_record changed( owner_a, asset( 90, 0 ), 1 );
+      balance_record created( owner_b, asset( 50, 0 ), 1 );
+
+      // the state after a block that changed one balance and created another
+      pending_chain_state current;
+      current.store_balance_record( changed );
+      current.store_balance_record( created );
+      current.set_property( chain_property_enum::last_random_seed_id, fc::variant( 2 ) );
+
+      pending_chain_state undo_state;
+      balance_record before( owner_a, asset( 100, 0 ), 1 );
+      undo_state.store_balance_record( before );
+      undo_state.store_balance_record( created.make_null() );
+      undo_state.set_property( chain_property_enum::last_random_seed_id, fc::variant( 1 ) );
+
+      auto data = undo_data::encode( 7, undo_state, current );
+      FC_ASSERT( data.deltas.size() < fc::raw::pack( undo_state ).size() );
+
+      auto decoded = fc::raw::unpack<undo_data>( fc::raw::pack( data ) ).decode( current );
+      FC_ASSERT( decoded->get_balance_record( before.id() )->balance == 100 );
+      FC_ASSERT( decoded->get_balance_record( created.id() )->balance == 0 );
+      FC_ASSERT( decoded->get_property( chain_property_enum::last_random_seed_id ).as_int64() == 1 );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_history_bounds_fork_switches )
+{
+   try {
+      test_genesis genesis;
+      auto a = genesis.open( "a" );
+      auto b = genesis.open( "b" );
+      a->set_undo_history( 2 );
+
+      address to_a( fc::ecc::private_key::regenerate( fc::sha256::hash( "to_a" ) ).get_public_key() );
+      std::vector<balance_id_type> balances{ genesis.balance_id( 0 ), balance_record( to_a, asset( 0, 0 ), 1 ).id() };
+
+      auto common = genesis.produce( *a, 1 );
+      a->push_block( common );
+      b->push_block( common );
+
+      a->store_pending_transaction( genesis.transfer( *a, 0, to_a ) );
+      for( uint32_t slot = 2; slot <= 5; ++slot )
+         a->push_block( genesis.produce( *a, slot ) );
+      FC_ASSERT( a->get_head_block_num() == 5 );
+
+      // only the last two blocks can be undone, a longer fork that starts below them is not switched to
+      auto before = genesis.state( *a, balances );
+      for( uint32_t slot = 6; slot <= 11; ++slot )
+      {
+         auto block = genesis.produce( *b, slot );
+         b->push_block( block );
+         a->push_block( block );
+      }
+      FC_ASSERT( a->get_head_block_num() == 5 );
+      FC_ASSERT( genesis.state( *a, balances ) == before );
+      a->audit_state();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_switch_and_rollback )
+{
+   try {
+      test_genesis genesis;
+      auto a = genesis.open( "a" );
+      auto b = genesis.open( "b" );
+
+      address to_a( fc::ecc::private_key::regenerate( fc::sha256::hash( "to_a" ) ).get_public_key() );
+      address to_b( fc::ecc::private_key::regenerate( fc::sha256::hash( "to_b" ) ).get_public_key() );
+      std::vector<balance_id_type> balances{ genesis.balance_id( 0 ), genesis.balance_id( 1 ),
+                                             balance_record( to_a, asset( 0, 0 ), 1 ).id(),
+                                             balance_record( to_b, asset( 0, 0 ), 1 ).id() };
+
+      auto common = genesis.produce( *a, 1 );
+      a->push_block( common );
+      b->push_block( common );
+
+      // the current chain spends the first balance
+      a->store_pending_transaction( genesis.transfer( *a, 0, to_a ) );
+      for( uint32_t slot = 2; slot <= 3; ++slot )
+         a->push_block( genesis.produce( *a, slot ) );
+      FC_ASSERT( a->get_head_block_num() == 3 );
+      FC_ASSERT( a->get_balance_record( balances[2] ).valid() );
+
+      // a longer fork spends the second one
+      std::vector<full_block> fork;
+      b->store_pending_transaction( genesis.transfer( *b, 1, to_b ) );
+      for( uint32_t slot = 4; slot <= 6; ++slot )
+      {
+         fork.push_back( genesis.produce( *b, slot ) );
+         b->push_block( fork.back() );
+      }
+
+      // a fork that ends in an invalid block is applied and aborted, leaving the chain and caches as they were
+      auto before = genesis.state( *a, balances );
+      full_block invalid = fork.back();
+      invalid.fee_rate += 1;
+      genesis.sign( *b, invalid );
+      a->push_block( fork[0] );
+      a->push_block( fork[1] );
+      a->push_block( invalid );
+      FC_ASSERT( genesis.state( *a, balances ) == before );
+      FC_ASSERT( a->get_block_id( 2 ) != fork[0].id() );
+      FC_ASSERT( !a->get_balance_record( balances[3] ).valid() );
+      a->audit_state();
+
+      // the valid end of the fork switches to it
+      a->push_block( fork.back() );
+      FC_ASSERT( a->get_head_block_id() == fork.back().id() );
+      FC_ASSERT( a->get_block_id( 2 ) == fork[0].id() );
+      FC_ASSERT( genesis.state( *a, balances ) == genesis.state( *b, balances ) );
+      FC_ASSERT( !a->get_balance_record( balances[2] ).valid() );
+      a->audit_state();
+
+      // the database holds what the caches returned
+      auto after = genesis.state( *a, balances );
+      a->close();
+      a = genesis.open( "a" );
+      FC_ASSERT( genesis.state( *a, balances ) == after );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( record_cache_after_aborted_fork_switch )
+{
+   try {
+      test_genesis genesis;
+      auto cached   = genesis.open( "cached" );
+      auto uncached = genesis.open( "uncached" );
+      uncached->set_record_cache_size( 0 );
+      auto other = genesis.open( "other" );
+
+      address to( fc::ecc::private_key::regenerate( fc::sha256::hash( "to" ) ).get_public_key() );
+      std::vector<balance_id_type> balances{ genesis.balance_id( 0 ), genesis.balance_id( 1 ),
+                                             balance_record( to, asset( 0, 0 ), 1 ).id() };
+
+      auto common = genesis.produce( *cached, 1 );
+      for( const auto& chain : { cached, uncached, other } )
+         chain->push_block( common );
+
+      cached->store_pending_transaction( genesis.transfer( *cached, 0, to ) );
+      for( uint32_t slot = 2; slot <= 3; ++slot )
+      {
+         auto block = genesis.produce( *cached, slot );
+         cached->push_block( block );
+         uncached->push_block( block );
+      }
+
+      // popping the current blocks and applying the fork caches records that the abort has to drop
+      std::vector<full_block> fork;
+      other->store_pending_transaction( genesis.transfer( *other, 1, to ) );
+      for( uint32_t slot = 4; slot <= 6; ++slot )
+      {
+         fork.push_back( genesis.produce( *other, slot ) );
+         other->push_block( fork.back() );
+      }
+      fork.back().fee_rate += 1;
+      genesis.sign( *other, fork.back() );
+      for( const auto& block : fork )
+      {
+         cached->push_block( block );
+         uncached->push_block( block );
+      }
+
+      FC_ASSERT( cached->get_head_block_num() == 3 );
+      FC_ASSERT( genesis.state( *cached, balances ) == genesis.state( *uncached, balances ) );
+      FC_ASSERT( cached->get_record_cache_stats()["balances"]["hits"].as_uint64() > 0 );
+      FC_ASSERT( uncached->get_record_cache_stats()["balances"]["size"].as_uint64() == 0 );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_tree_links_blocks_out_of_order )
+{
+   try {
+      test_genesis genesis;
+      auto a = genesis.open( "a" );
+      auto other = genesis.open( "other" );
+
+      auto common = genesis.produce( *a, 1 );
+      a->push_block( common );
+      other->push_block( common );
+      for( uint32_t slot = 2; slot <= 3; ++slot )
+         a->push_block( genesis.produce( *a, slot ) );
+
+      std::vector<full_block> fork;
+      for( uint32_t slot = 4; slot <= 7; ++slot )
+      {
+         fork.push_back( genesis.produce( *other, slot ) );
+         other->push_block( fork.back() );
+      }
+
+      // a block whose previous block is unknown waits in the fork tree until it arrives
+      a->push_block( fork[1] );
+      a->push_block( fork[0] );
+      FC_ASSERT( a->get_head_block_num() == 3 );
+      a->push_block( fork[2] );
+      FC_ASSERT( a->get_head_block_id() == fork[2].id() );
+
+      // an invalid block is remembered as such
+      full_block invalid = fork[3];
+      invalid.fee_rate += 1;
+      genesis.sign( *other, invalid );
+      bool rejected = false;
+      try { a->push_block( invalid ); }
+      catch ( const fc::exception& ) { rejected = true; }
+      FC_ASSERT( rejected && a->get_head_block_id() == fork[2].id() );
+      FC_ASSERT( a->is_known_block( invalid.id() ) );
+
+      a->close();
+      a = genesis.open( "a" );
+      FC_ASSERT( a->get_head_block_id() == fork[2].id() );
+      a->push_block( fork[3] );
+      FC_ASSERT( a->get_head_block_id() == other->get_head_block_id() );
+      a->audit_state();
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( replay_rebuilds_state )
+{
+   try {
+      test_genesis genesis;
+      auto chain = genesis.open( "chain" );
+
+      std::vector<balance_id_type> balances;
+      for( uint32_t owner = 0; owner < 5; ++owner )
+      {
+         address to( fc::ecc::private_key::regenerate( fc::sha256::hash( "to" + fc::to_string( owner ) ) ).get_public_key() );
+         balances.push_back( genesis.balance_id( owner ) );
+         balances.push_back( balance_record( to, asset( 0, 0 ), 1 ).id() );
+         chain->store_pending_transaction( genesis.transfer( *chain, owner, to ) );
+         chain->push_block( genesis.produce( *chain, 2 * owner + 1 ) );
+      }
+      auto expected = genesis.state( *chain, balances );
+      auto head_num = chain->get_head_block_num();
+      chain->close();
+
+      // a directory without a block log is rejected before anything in it is removed
+      chain = std::make_shared<chain_database>();
+      bool rejected = false;
+      try { chain->replay( genesis.dir.path(), genesis.genesis_file ); }
+      catch ( const fc::exception& ) { rejected = true; }
+      FC_ASSERT( rejected && fc::exists( genesis.genesis_file ) && fc::exists( genesis.dir.path() / "chain" ) );
+
+      // files that are not part of the chain database are left alone
+      auto other_file = genesis.dir.path() / "chain" / "notes.json";
+      fc::json::save_to_file( expected, other_file, true );
+
+      chain = std::make_shared<chain_database>();
+      chain->replay( genesis.dir.path() / "chain", genesis.genesis_file );
+      FC_ASSERT( chain->get_head_block_num() == head_num );
+      FC_ASSERT( genesis.state( *chain, balances ) == expected );
+      FC_ASSERT( fc::exists( other_file ) );
+      chain->audit_state();
+
+      // the replayed database opens normally
+      chain->close();
+      chain = genesis.open( "chain" );
+      FC_ASSERT( genesis.state( *chain, balances ) == expected );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_template_follows_pending_transactions )
+{
+   try {
+      test_genesis genesis;
+      auto chain = genesis.open( "chain" );
+      address to( fc::ecc::private_key::regenerate( fc::sha256::hash( "to" ) ).get_public_key() );
+
+      auto first = genesis.transfer( *chain, 0, to );
+      chain->store_pending_transaction( first );
+      chain->update_block_template();
+
+      // a transaction arriving after the template was packed is added to it
+      auto second = genesis.transfer( *chain, 1, to );
+      chain->store_pending_transaction( second );
+      auto block = genesis.produce( *chain, 1 );
+      FC_ASSERT( block.user_transactions.size() == 2 );
+
+      // once included they leave the pool and the next template
+      chain->push_block( block );
+      FC_ASSERT( chain->get_pending_transactions().empty() );
+      FC_ASSERT( genesis.produce( *chain, 2 ).user_transactions.empty() );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( pack_spends_of_pending_outputs )
+{
+   try {
+      test_genesis genesis;
+      auto chain = genesis.open( "chain" );
+      auto to_key = fc::ecc::private_key::regenerate( fc::sha256::hash( "to" ) );
+      address to( to_key.get_public_key() );
+      address change( fc::ecc::private_key::regenerate( fc::sha256::hash( "change" ) ).get_public_key() );
+
+      auto parent = genesis.transfer( *chain, 0, to );
+      auto received = chain->get_balance_record( genesis.balance_id( 0 ) )->balance / 2;
+      chain->store_pending_transaction( parent );
+
+      // spends the output of the pending parent, the pool accepts it on top of the parent's changes
+      signed_transaction child;
+      child.withdraw( balance_record( to, asset( 0, 0 ), 1 ).id(), received );
+      child.deposit( change, asset( received / 10, 0 ), 1 );
+      child.sign( to_key, chain->chain_id() );
+      chain->store_pending_transaction( child );
+      FC_ASSERT( chain->get_pending_transactions().size() == 2 );
+
+      // both are packed into one block, the parent first
+      auto block = genesis.produce( *chain, 1 );
+      FC_ASSERT( block.user_transactions.size() == 2 );
+      FC_ASSERT( block.user_transactions[0].id() == parent.id() );
+      FC_ASSERT( block.user_transactions[1].id() == child.id() );
+      chain->push_block( block );
+      FC_ASSERT( chain->get_balance_record( balance_record( change, asset( 0, 0 ), 1 ).id() )->balance == received / 10 );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( wallet_rescan_matches_live_scan )
+{
+   try {
+      test_genesis genesis;
+      auto chain = genesis.open( "chain" );
+      std::string password = "rescan password";
+      std::string brainkey = "rescan brainkey";
+
+      // scans each block as it is applied
+      auto live = std::make_shared<bts::wallet::wallet>( chain );
+      live->set_data_directory( genesis.dir.path() );
+      live->create( "live", password, brainkey );
+      live->unlock( password );
+      auto receiver = live->create_account( "receiver" );
+
+      // deposits to the account over many blocks, with one to a key the wallet doesn't hold
+      address stranger( fc::ecc::private_key::regenerate( fc::sha256::hash( "stranger" ) ).get_public_key() );
+      for( uint32_t owner = 0; owner < 8; ++owner )
+      {
+         auto sender = genesis.keys[BTS_BLOCKCHAIN_NUM_DELEGATES + owner];
+         auto balance = chain->get_balance_record( genesis.balance_id( owner ) );
+         FC_ASSERT( balance.valid() );
+         signed_transaction trx;
+         trx.withdraw( genesis.balance_id( owner ), balance->balance );
+         if( owner == 3 )
+            trx.deposit( stranger, asset( balance->balance / 2, 0 ), 1 );
+         else
+            trx.deposit_to_account( receiver, asset( balance->balance / 2, 0 ), sender,
+                                    "memo-" + fc::to_string( owner ), 1, sender.get_public_key() );
+         trx.sign( sender, chain->chain_id() );
+         chain->store_pending_transaction( trx );
+         chain->push_block( genesis.produce( *chain, owner + 1 ) );
+      }
+      auto found = [&]( bts::wallet::wallet& w )
+      {
+         std::vector<std::string> memos;
+         for( const auto& trx : w.get_transaction_history() )
+            if( !trx.memo_message.empty() ) memos.push_back( trx.memo_message );
+         std::sort( memos.begin(), memos.end() );
+         return fc::json::to_string( fc::mutable_variant_object()
+                                     ( "memos", memos )
+                                     ( "balance", w.get_balance( "*", "receiver" ) ) );
+      };
+      auto expected = found( *live );
+      FC_ASSERT( live->get_transaction_history().size() >= 7 );
+
+      // a wallet with the same keys finds the same deposits rescanning the chain on the scanning threads
+      auto rescanned = std::make_shared<bts::wallet::wallet>( chain );
+      rescanned->set_data_directory( genesis.dir.path() );
+      rescanned->create( "rescanned", password, brainkey );
+      rescanned->unlock( password );
+      FC_ASSERT( rescanned->create_account( "receiver" ) == receiver );
+
+      // deposits the filter rejects are never decrypted, the filter runs on the scanning threads
+      std::atomic<uint32_t> filtered( 0 );
+      rescanned->set_deposit_filter( [&]( const withdraw_by_account&, const address& ) { ++filtered; return false; } );
+      rescanned->scan_chain( 0 );
+      FC_ASSERT( filtered >= 7 );
+      FC_ASSERT( rescanned->get_balance( "*", "receiver" )[0].amount == 0 );
+
+      // progress is reported for every block in order
+      std::vector<uint32_t> progress;
+      rescanned->set_deposit_filter( bts::wallet::deposit_filter() );
+      rescanned->scan_chain( 0, -1, [&]( uint32_t current, uint32_t last ) { progress.push_back( current ); } );
+      FC_ASSERT( progress.size() == chain->get_head_block_num() );
+      for( uint32_t i = 0; i < progress.size(); ++i )
+         FC_ASSERT( progress[i] == i + 1 );
+      FC_ASSERT( found( *rescanned ) == expected, "${a} != ${b}", ("a",found( *rescanned ))("b",expected) );
+
+      chain->set_observer( nullptr );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
@@ -0,0 +1,356 @@
+#define BOOST_TEST_MODULE NetTests
+#include <boost/test/unit_test.hpp>
+#include <bts/client/messages.hpp>
+#include <bts/net/config.hpp>
+#include <bts/net/node.hpp>
+#include <bts/net/stcp_socket.hpp>
+#include <fc/crypto/elliptic.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/filesystem.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/network/ip.hpp>
+#include <fc/network/tcp_socket.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace bts::net;
+
+/**
+ *  Connects sender to receiver through a relay that forwards what the sender writes in
+ *  chunks of at most chunk_size bytes, one write per chunk, so that the receiver sees records
+ *  split across its socket reads.  The byte at tamper_offset of that stream is modified.
+ */
+struct relayed_connection
+{
+   relayed_connection( stcp_socket::transport_type transport, size_t chunk_size,
+                       uint64_t tamper_offset = uint64_t(-1) )
+   :sender(transport),receiver(transport)
+   {
+      fc::ip::address localhost( "127.0.0.1" );
+      receiver_server.listen( fc::ip::endpoint( localhost, 0 ) );
+      relay_server.listen( fc::ip::endpoint( localhost, 0 ) );
+      auto receiver_port = receiver_server.get_local_endpoint().port();
+
+      auto accepted = fc::async( [&]() { receiver_server.accept( receiver.get_socket() ); receiver.accept(); } );
+      auto relayed  = fc::async( [&]()
+      {
+         relay_server.accept( relay_in );
+         relay_out.connect_to( fc::ip::endpoint( localhost, receiver_port ) );
+         forward_done  = fc::async( [=]() { forward( relay_in, relay_out, chunk_size, tamper_offset ); } );
+         backward_done = fc::async( [=]() { forward( relay_out, relay_in, 4096, uint64_t(-1) ); } );
+      });
+      sender.connect_to( fc::ip::endpoint( localhost, relay_server.get_local_endpoint().port() ) );
+      relayed.wait();
+      accepted.wait();
+   }
+
+   ~relayed_connection()
+   {
+      for( fc::tcp_socket* sock : { &sender.get_socket(), &receiver.get_socket(), &relay_in, &relay_out } )
+      {
+         try { sock->close(); } catch ( const fc::exception& ) {}
+      }
+      for( fc::future<void>* done : { &forward_done, &backward_done } )
+      {
+         try { if( done->valid() ) done->wait(); } catch ( const fc::exception& ) {}
+      }
+   }
+
+   static void forward( fc::tcp_socket& from, fc::tcp_socket& to, size_t chunk_size, uint64_t tamper_offset )
+   {
+      std::vector<char> buffer( chunk_size );
+      uint64_t offset = 0;
+      try {
+         while( true )
+         {
+            size_t count = from.readsome( buffer.data(), buffer.size() );
+            if( tamper_offset >= offset && tamper_offset < offset + count )
+               buffer[tamper_offset - offset] ^= 0x01;
+            to.write( buffer.data(), count );
+            to.flush();
+            offset += count;
+            // give the receiver a chance to read each chunk on its own
+            fc::usleep( fc::microseconds( 100 ) );
+         }
+      }
+      catch ( const fc::exception& )
+      {
+         // one of the sockets was closed
+      }
+   }
+
+   fc::tcp_server   receiver_server;
+   fc::tcp_server   relay_server;
+   stcp_socket      sender;
+   stcp_socket      receiver;
+   fc::tcp_socket   relay_in;
+   fc::tcp_socket   relay_out;
+   fc::future<void> forward_done;
+   fc::future<void> backward_done;
+};
+
+BOOST_AUTO_TEST_CASE( stcp_record_round_trip )
+{
+   try {
+      relayed_connection connection( stcp_socket::aes_gcm_records, 1000 );
+
+      // several records, each split across many reads by the relay
+      std::vector<char> data( 40000 );
+      for( size_t i = 0; i < data.size(); ++i )
+         data[i] = char( i * 7 + i / 251 );
+      connection.sender.write( data.data(), data.size() );
+      connection.sender.flush();
+
+      // a buffer smaller than a record leaves the rest of each record for the next reads
+      std::vector<char> received;
+      char buffer[100];
+      while( received.size() < data.size() )
+      {
+         size_t count = connection.receiver.readsome( buffer, sizeof(buffer) );
+         FC_ASSERT( count > 0 && count <= sizeof(buffer) );
+         received.insert( received.end(), buffer, buffer + count );
+      }
+      FC_ASSERT( received == data );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( stcp_rejects_tampered_record )
+{
+   try {
+      // after the public key, inside the encrypted data of the first record
+      uint64_t tamper_offset = sizeof(fc::ecc::public_key_data) + sizeof(uint32_t) + 8;
+      relayed_connection connection( stcp_socket::aes_gcm_records, 1000, tamper_offset );
+
+      std::vector<char> data( 512, 'x' );
+      connection.sender.write( data.data(), data.size() );
+      connection.sender.flush();
+
+      bool rejected = false;
+      try {
+         char buffer[1024];
+         connection.receiver.readsome( buffer, sizeof(buffer) );
+      }
+      catch ( const fc::exception& ) { rejected = true; }
+      FC_ASSERT( rejected, "a modified record was accepted" );
+   }
+   catch ( const fc::exception& e )
+   {
+      elog( "${e}", ("e",e.to_detail_string() ) );
+      throw;
+   }
+}
+
+/**
+ *  A chain of empty blocks held in memory that only accepts the block following its head,
+ *  taking validation_time to validate each one without yielding, like push_block.
+ */
+class test_chain : public node_delegate
+{
+  public:
+    explicit test_chain( fc::microseconds validation_time = fc::microseconds() )
+    :validation_time(validation_time),rejected(0){}
+
+    void extend( uint32_t count )
+    {
+      for( uint32_t i = 0; i < count; ++i )
+      {
+        bts::blockchain::full_block block;
+        block.block_num = blocks.size() + 1;
+        block.previous  = head();
+        block.timestamp = fc::time_point_sec( block.block_num );
+        add( block );
+      }
+    }
+
+    item_hash_t head()const { return blocks.empty() ? item_hash_t() : blocks.back().id(); }
+
+    virtual bool has_item( const item_id& id ) override
+    {
+      return block_nums.find( id.item_hash ) != block_nums.end();
+    }
+
+    virtual void handle_message( const message& message_to_handle ) override
+    {
+      auto block = message_to_handle.as<bts::client::block_message>().block;
+      std::this_thread::sleep_for( std::chrono::microseconds( validation_time.count() ) );
+      if( block.previous != head() )
+      {
+        ++rejected;
+        FC_THROW( "block ${num} does not follow the head", ("num",block.block_num) );
+      }
+      add( block );
+    }
+
+    virtual std::vector<item_hash_t> get_item_ids( const item_id& from_id,
+                                                   uint32_t& remaining_item_count,
+                                                   uint32_t limit = 2000 ) override
+    {
+      uint32_t next = 0;
+      if( from_id.item_hash != item_hash_t() )
+      {
+        auto from = block_nums.find( from_id.item_hash );
+        if( from == block_nums.end() )
+        {
+          remaining_item_count = 0;
+          return std::vector<item_hash_t>();
+        }
+        next = from->second;
+      }
+      std::vector<item_hash_t> ids;
+      for( ; next < blocks.size() && ids.size() < limit; ++next )
+        ids.push_back( blocks[next].id() );
+      remaining_item_count = blocks.size() - next;
+      return ids;
+    }
+
+    virtual message get_item( const item_id& id ) override
+    {
+      auto num = block_nums.find( id.item_hash );
+      FC_ASSERT( num != block_nums.end() );
+      return bts::client::block_message( blocks[num->second - 1] );
+    }
+
+    virtual fc::sha256 get_chain_id()const override { return fc::sha256::hash( std::string( "net_tests" ) ); }
+
+    virtual std::vector<item_hash_t> get_blockchain_synopsis() override
+    {
+      std::vector<item_hash_t> synopsis;
+      for( uint32_t low = 1; low <= blocks.size(); low += (blocks.size() - low + 2) / 2 )
+        synopsis.push_back( blocks[low - 1].id() );
+      return synopsis;
+    }
+
+    virtual void sync_status( uint32_t item_type, uint32_t item_count ) override {}
+    virtual void connection_count_changed( uint32_t c ) override {}
+
+    fc::microseconds                                  validation_time;
+    uint32_t                                          rejected;
+    std::vector<bts::blockchain::full_block>          blocks;
+    /** the number of each block by id */
+    std::unordered_map<item_hash_t,uint32_t>          block_nums;
+
+  private:
+    void add( const bts::blockchain::full_block& block )
+    {
+      blocks.push_back( block );
+      block_nums[block.id()] = blocks.size();
+    }
+};
+
+/** a node listening on a random port that serves and accepts the blocks of chain */
+struct test_node
+{
+  test_node( uint32_t blocks, fc::microseconds validation_time = fc::microseconds() )
+  :chain(validation_time),node(std::make_shared<bts::net::node>())
+  {
+    chain.extend( blocks );
+    node->set_node_delegate( &chain );
+    node->load_configuration( dir.path() );
+    node->listen_on_port( 0 );
+    node->sync_from( item_id( bts::client::block_message_type, chain.head() ) );
+    node->connect_to_p2p_network();
+  }
+
+  fc::ip::endpoint endpoint()const
+  {
+    return fc::ip::endpoint( fc::ip::address( "127.0.0.1" ), node->get_actual_listening_endpoint().port() );
+  }
+
+  fc::temp_directory dir;
+  test_chain         chain;
+  node_ptr           node;
+};
+
+/** node can't stop the tasks it started, so the nodes of the tests run until the tests exit */
+test_node& start_node( uint32_t blocks, fc::microseconds validation_time = fc::microseconds() )
+{
+  static auto running_nodes = new std::vector< std::unique_ptr<test_node> >();
+  running_nodes->emplace_back( new test_node( blocks, validation_time ) );
+  return *running_nodes->back();
+}
+
+template<typename Condition>
+void wait_for( Condition done, fc::microseconds timeout )
+{
+  auto give_up = fc::time_point::now() + timeout;
+  while( !done() )
+  {
+    FC_ASSERT( fc::time_point::now() < give_up, "timed out" );
+    fc::usleep( fc::milliseconds( 10 ) );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( sync_from_several_peers )
+{
+  try {
+    const uint32_t num_blocks = BTS_NET_MAX_SYNC_BACKLOG_SIZE + 500;
+    test_node& syncing = start_node( 0, fc::microseconds( 200 ) );
+    std::vector<test_node*> sources;
+    for( uint32_t i = 0; i < 3; ++i )
+    {
+      sources.push_back( &start_node( num_blocks ) );
+      syncing.node->connect_to( sources.back()->endpoint() );
+    }
+
+    // every block is applied once and in order, however the peers' batches arrive
+    wait_for( [&]() { return syncing.chain.blocks.size() == num_blocks; }, fc::seconds( 120 ) );
+    FC_ASSERT( syncing.chain.head() == sources[0]->chain.head() );
+    FC_ASSERT( syncing.chain.rejected == 0 );
+
+    // the backlog stays within its bound, the first block of each peer's list being exempt, and empties
+    auto info = syncing.node->network_get_info();
+    FC_ASSERT( info["max_sync_backlog_size"].as_uint64() > 0 );
+    FC_ASSERT( info["max_sync_backlog_size"].as_uint64() <= BTS_NET_MAX_SYNC_BACKLOG_SIZE + sources.size(),
+               "${info}", ("info",info) );
+    wait_for( [&]()
+    {
+      auto info = syncing.node->network_get_info();
+      return info["sync_backlog_size"].as_uint64() == 0 && info["active_sync_requests"].as_uint64() == 0;
+    }, fc::seconds( 10 ) );
+  }
+  catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string() ) );
+    throw;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( slow_validation_yields_between_blocks )
+{
+  try {
+    const uint32_t num_blocks = 100;
+    const auto     validation_time = fc::milliseconds( 10 );
+    test_node& syncing = start_node( 0, validation_time );
+    test_node& source  = start_node( num_blocks );
+    syncing.node->connect_to( source.endpoint() );
+
+    // the other tasks of the thread, such as the peers' read loops and this one, run between blocks
+    fc::microseconds longest_wait;
+    auto give_up = fc::time_point::now() + fc::seconds( 60 );
+    while( syncing.chain.blocks.size() < num_blocks )
+    {
+      FC_ASSERT( fc::time_point::now() < give_up, "timed out" );
+      auto before = fc::time_point::now();
+      fc::usleep( fc::milliseconds( 1 ) );
+      longest_wait = std::max( longest_wait, fc::time_point::now() - before );
+    }
+    FC_ASSERT( syncing.chain.rejected == 0 );
+    FC_ASSERT( longest_wait.count() < 20 * validation_time.count(), "waited ${w} us while blocks were applied",
+               ("w",longest_wait.count()) );
+  }
+  catch ( const fc::exception& e )
+  {
+    elog( "${e}", ("e",e.to_detail_string() ) );
+    throw;
+  }
+}